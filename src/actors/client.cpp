@@ -1,19 +1,84 @@
 #include "client.hpp"
 
+#include <core/snapshot.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
 #include <random>
 #include <thread>
 #include <chrono>
+#include <type_traits>
+#include <variant>
 
 using namespace home_task::actors;
 using namespace home_task::network_mock;
 using namespace home_task::api;
 
 
-void ClientRunner::Run() {
-    log::WriteClientRunner("ClientRunner::Run");
+void LatencyHistogram::Add(std::chrono::duration<double> _latency) {
+    uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(_latency).count();
+    uint64_t idx = micros;
+    if (micros >= SubBuckets) {
+        // the bits after the highest one choose the bucket inside the power of two
+        uint32_t shift = std::bit_width(micros) - std::bit_width(SubBuckets);
+        idx = (shift + 1) * SubBuckets + (micros >> shift) - SubBuckets;
+    }
+    Buckets_[std::min<uint64_t>(idx, Buckets_.size() - 1)]++;
+    Count_++;
+    Sum_ += _latency;
+    Max_ = std::max(Max_, _latency);
+}
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
+void LatencyHistogram::Merge(const LatencyHistogram &_other) {
+    for (uint32_t idx = 0; idx < Buckets_.size(); ++idx) {
+        Buckets_[idx] += _other.Buckets_[idx];
+    }
+    Count_ += _other.Count_;
+    Sum_ += _other.Sum_;
+    Max_ = std::max(Max_, _other.Max_);
+}
+
+std::chrono::duration<double> LatencyHistogram::Quantile(double _quantile) const {
+    uint64_t rank = std::ceil(_quantile * Count_);
+    uint64_t seen = 0;
+    for (uint32_t idx = 0; idx < Buckets_.size(); ++idx) {
+        seen += Buckets_[idx];
+        if (Buckets_[idx] && seen >= rank) {
+            uint64_t upper = idx + 1;
+            if (idx >= SubBuckets) {
+                upper = (idx % SubBuckets + SubBuckets + 1) << (idx / SubBuckets - 1);
+            }
+            return std::min<std::chrono::duration<double>>(std::chrono::microseconds(upper), Max_);
+        }
+    }
+    return std::chrono::duration<double>(0);
+}
+
+
+template <typename _ClientState>
+void BasicClientRunner<_ClientState>::SaveSnapshot() {
+    log::Stopwatch<log::ClientRunnerLogger> saving;
+    auto state = State_->MakeSnapshot();
+    state.Epoch_ = Epoch_;
+    snapshot::Save(SnapshotPath_, std::move(state));
+    log::WriteClientRunner("ClientRunner::SaveSnapshot{id=", Id_, ", duration ", [&] { return saving.Elapsed(); }, "s}");
+}
+
+template <typename _ClientState>
+void BasicClientRunner<_ClientState>::Start() {
+    if (!SnapshotPath_.empty()) {
+        Restored_ = snapshot::Load(SnapshotPath_);
+    }
+
+    Client_->Send(ServerId_, MakeConnectMessage());
+    if (ArrayId_) {
+        Client_->Send(ServerId_, MakeRequestMessage(OpenArrayRequest(*ArrayId_)));
+    }
+}
+
+template <typename _ClientState>
+std::unique_ptr<MessageRecord> BasicClientRunner<_ClientState>::MakeRequest(std::mt19937 &_gen) {
     enum {
         LOAD_STATE = 0,
         UPDATE_VALUE = 1,
@@ -27,7 +92,119 @@ void ClientRunner::Run() {
 
     std::uniform_int_distribution<> commandDstrib(leftRangeBorder, rightRangeBorder);
 
-    Client_.Send(magic_numbers::ServerId, MakeConnectMessage());
+    auto type = IteratoinCount_ ? (Reader_ ? SYNC : commandDstrib(_gen)) : LOAD_STATE;
+    std::unique_ptr<MessageRecord> msg;
+    switch (type) {
+    case LOAD_STATE:
+        if (Restored_) {
+            // the server sends only the history after the snapshot if it still has it
+            msg = MakeRequestMessage(ResumeRequest(Restored_->Iteration_, Restored_->Epoch_));
+        } else {
+            msg = MakeRequestMessage(State_->GenerateLoadStateRequest());
+        }
+        break;
+    case UPDATE_VALUE:
+        msg = MakeRequestMessage(State_->GenerateUpdateValueRequest(_gen));
+        break;
+    case INSERT_VALUE:
+        msg = MakeRequestMessage(State_->GenerateInsertValueRequest(_gen));
+        break;
+    case DELETE_VALUE:
+        msg = MakeRequestMessage(State_->GenerateDeleteValueRequest(_gen));
+        break;
+    case SYNC:
+        msg = MakeRequestMessage(State_->GenerateSyncRequest());
+        break;
+    }
+    // the first iteration is always LoadState
+    if (IteratoinCount_ || magic_numbers::CalculateFirstLoadState) {
+        SentBytes_ += msg->Size_;
+    }
+    msg->BeginTrace(true);
+    return msg;
+}
+
+template <typename _ClientState>
+bool BasicClientRunner<_ClientState>::HandleResponse(std::unique_ptr<MessageRecord> &&_message) {
+    if (IteratoinCount_ || magic_numbers::CalculateFirstLoadState) {
+        ReceivedBytes_ += _message->Size_;
+    }
+    if (_message->Type_ == static_cast<uint32_t>(EMessageType::Poison)) {
+        log::WriteClientRunner("ClientRunner::Run{id=", Id_, ", iteration=", IteratoinCount_, ", Poisoned}");
+        if (!SnapshotPath_.empty() && !Restored_) {
+            SaveSnapshot();
+        }
+        return false;
+    }
+
+    log::WriteClientRunner("ClientRunner::Run{id=", Id_, ", iteration=", IteratoinCount_, ", handling}");
+    log::Stopwatch<log::ClientRunnerLogger> handling;
+    log::SpanScope span("apply", Id_, _message->TraceId_, _message->Sender_, _message->Type_);
+    std::visit([&] <typename _Record> (_Record &_record) {
+        if constexpr (requires { _record.Iteration_; }) {
+            span.SetIteration(_record.Iteration_);
+        }
+        if constexpr (std::is_same_v<_Record, UpdateValueResponse>) {
+            State_->HandleUpdateValueResponse(_record);
+        } else if constexpr (std::is_same_v<_Record, InsertValueResponse>) {
+            State_->HandleInsertValueResponse(_record);
+        } else if constexpr (std::is_same_v<_Record, DeleteValueResponse>) {
+            State_->HandleDeleteValueResponse(_record);
+        } else if constexpr (std::is_same_v<_Record, SyncResponse>) {
+            if (Restored_) {
+                State_->HandleState(*Restored_);
+                Epoch_ = Restored_->Epoch_;
+                Resumed_ = true;
+            }
+            State_->HandleSyncResponse(_record);
+        } else if constexpr (std::is_same_v<_Record, State>) {
+            // the snapshot is dropped: it's behind the history or of another array
+            if (Restored_ && Restored_->Epoch_ != _record.Epoch_) {
+                log::WriteClientRunner("ClientRunner::HandleResponse{id=", Id_, ", the snapshot is of another array}");
+            }
+            State_->HandleState(_record);
+            Epoch_ = _record.Epoch_;
+        } else if constexpr (std::is_same_v<_Record, PushResponse>) {
+            SyncResponse diff;
+            static_cast<GenericResponse&>(diff) = std::move(_record);
+            State_->HandleSyncResponse(diff);
+            Pushes_++;
+        }
+    }, _message->Record_);
+    Restored_.reset();
+    log::WriteClientRunner("ClientRunner::Run{id=", Id_, ", iteration=", IteratoinCount_, log::Literal(", duratoin of handling message "),
+        [&] { return handling.Elapsed(); }, "s}");
+    if (!SnapshotPath_.empty() && (IteratoinCount_ + 1) % magic_numbers::SnapshotPeriod == 0) {
+        SaveSnapshot();
+    }
+    return true;
+}
+
+template <typename _ClientState>
+bool BasicClientRunner<_ClientState>::FinishIteration(std::chrono::duration<double> _latency) {
+    if (Latency_ && (IteratoinCount_ || magic_numbers::CalculateFirstLoadState)) {
+        Latency_->Add(_latency);
+    }
+    // the count of the finished iterations as after a poison
+    if (IteratoinCount_ + 1 == IterationLimit_) {
+        IteratoinCount_++;
+        return true;
+    }
+    return false;
+}
+
+template <typename _ClientState>
+void BasicClientRunner<_ClientState>::Run() {
+    log::WriteClientRunner("ClientRunner::Run");
+    if (SubscribeWindow_) {
+        RunSubscriber();
+        return;
+    }
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+
+    Start();
 
     auto start = std::chrono::steady_clock::now();
     for (IteratoinCount_ = 0;; ++IteratoinCount_) {
@@ -35,70 +212,117 @@ void ClientRunner::Run() {
             start = std::chrono::steady_clock::now();
         }
         log::WriteClientRunner("ClientRunner::Run{id=", Id_, ", iteration=", IteratoinCount_, ", start}");
-        auto type = IteratoinCount_ ? commandDstrib(gen) : 0;
-        std::unique_ptr<MessageRecord> msg;
-        switch (type) {
-        case LOAD_STATE:
-            msg = MakeRequestMessage(State_->GenerateLoadStateRequest());
-            break;
-        case UPDATE_VALUE:
-            msg = MakeRequestMessage(State_->GenerateUpdateValueRequest(gen));
-            break;
-        case INSERT_VALUE:
-            msg = MakeRequestMessage(State_->GenerateInsertValueRequest(gen));
-            break;
-        case DELETE_VALUE:
-            msg = MakeRequestMessage(State_->GenerateDeleteValueRequest(gen));
+        auto request = MakeRequest(gen);
+        auto sent = std::chrono::steady_clock::now();
+        Client_->Send(ServerId_, std::move(request));
+
+        log::Stopwatch<log::ClientRunnerLogger> receiving;
+        auto message = Client_->ReceiveWithWaiting();
+        auto received = std::chrono::steady_clock::now();
+        log::WriteClientRunner("ClientRunner::Run{id=", Id_, ", Wait response ", [&] { return receiving.Elapsed(); }, "s}");
+        if (!HandleResponse(std::move(message))) {
             break;
-        case SYNC:
-            msg = MakeRequestMessage(State_->GenerateSyncRequest());
+        }
+        if (FinishIteration(received - sent)) {
             break;
         }
-        if (IteratoinCount_ || magic_numbers::CalculateFirstLoadState || type != LOAD_STATE) {
-            SentBytes_ += msg->Size_;
+        if (ThinkTime_.count()) {
+            std::this_thread::sleep_for(ThinkTime_);
         }
-        Client_.Send(magic_numbers::ServerId, std::move(msg));
+    }
+    WorkTime_ = std::chrono::steady_clock::now() - start;
+}
 
-        auto startReceiving = std::chrono::steady_clock::now();
-        auto message = Client_.ReceiveWithWaiting();
-        if (IteratoinCount_ || magic_numbers::CalculateFirstLoadState || type != LOAD_STATE) {
-            ReceivedBytes_ += message->Size_;
-        }
-        std::chrono::duration<double> durationOfReceiving = std::chrono::steady_clock::now() - startReceiving;
-        log::WriteClientRunner("ClientRunner::Run{id=", Id_, ", Wait response ", durationOfReceiving.count(), "s}");
-        if (message->Type_ == static_cast<uint32_t>(EMessageType::Poison)) {
-            log::WriteClientRunner("ClientRunner::Run{id=", Id_, ", iteration=", IteratoinCount_, ", Poisoned}");
+template <typename _ClientState>
+void BasicClientRunner<_ClientState>::RunSubscriber() {
+    log::WriteClientRunner("ClientRunner::RunSubscriber");
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+
+    Start();
+
+    auto start = std::chrono::steady_clock::now();
+    Client_->Send(ServerId_, MakeRequest(gen));
+    if (!HandleResponse(Client_->ReceiveWithWaiting())) {
+        WorkTime_ = std::chrono::steady_clock::now() - start;
+        return;
+    }
+    auto subscribe = MakeRequestMessage(SubscribeRequest(State_->GenerateSyncRequest().PreviousIteration_, SubscribeWindow_));
+    SentBytes_ += subscribe->Size_;
+    Client_->Send(ServerId_, std::move(subscribe));
+    if (!magic_numbers::CalculateFirstLoadState) {
+        start = std::chrono::steady_clock::now();
+    }
+
+    // every push is an iteration
+    auto lastAck = std::chrono::steady_clock::now();
+    for (IteratoinCount_ = 1;; ++IteratoinCount_) {
+        auto message = Client_->ReceiveWithWaiting();
+        auto iteration = std::visit([] <typename _Record> (const _Record &_record) -> model::IterationId {
+            if constexpr (std::is_same_v<_Record, PushResponse>) {
+                return _record.Iteration_;
+            }
+            return 0;
+        }, message->Record_);
+        if (!HandleResponse(std::move(message))) {
             break;
         }
+        // the window opens only after the push is handled and the interval passed,
+        // so a slow or a throttled reader gets fewer and bigger pushes
+        std::this_thread::sleep_until(lastAck + CoalesceInterval_);
+        lastAck = std::chrono::steady_clock::now();
+        auto ack = MakeRequestMessage(PushAckRequest(iteration));
+        SentBytes_ += ack->Size_;
+        Client_->Send(ServerId_, std::move(ack));
+    }
+    WorkTime_ = std::chrono::steady_clock::now() - start;
+}
 
-        log::WriteClientRunner("ClientRunner::Run{id=", Id_, ", iteration=", IteratoinCount_, ", handling}");
-        auto startHandling = std::chrono::steady_clock::now();
-        switch (message->Type_) {
-        case (uint32_t)EAPIEventsType::UpdateValueResponse:
-            State_->HandleUpdateValueResponse(*std::any_cast<UpdateValueResponse>(&message->Record_));
-            break;
-        case (uint32_t)EAPIEventsType::InsertValueResponse:
-            State_->HandleInsertValueResponse(*std::any_cast<InsertValueResponse>(&message->Record_));
-            break;
-        case (uint32_t)EAPIEventsType::DeleteValueResponse:
-            State_->HandleDeleteValueResponse(*std::any_cast<DeleteValueResponse>(&message->Record_));
-            break;
-        case (uint32_t)EAPIEventsType::SyncResponse:
-            State_->HandleSyncResponse(*std::any_cast<SyncResponse>(&message->Record_));
+namespace {
+
+// Generators are per thread of the scheduler, a generator in every frame would be 5kB per client.
+// It's taken anew after every suspension, the coroutine may be resumed by another thread.
+std::mt19937& SchedulerGenerator() {
+    thread_local std::mt19937 gen(std::random_device{}());
+    return gen;
+}
+
+}
+
+template <typename _ClientState>
+Task BasicClientRunner<_ClientState>::RunAsync(CoroutineScheduler &_scheduler) {
+    log::WriteClientRunner("ClientRunner::RunAsync");
+
+    Start();
+
+    auto start = std::chrono::steady_clock::now();
+    for (IteratoinCount_ = 0;; ++IteratoinCount_) {
+        if (!magic_numbers::CalculateFirstLoadState && IteratoinCount_ == 1) {
+            start = std::chrono::steady_clock::now();
+        }
+        log::WriteClientRunner("ClientRunner::RunAsync{id=", Id_, ", iteration=", IteratoinCount_, ", start}");
+        auto request = MakeRequest(SchedulerGenerator());
+        auto sent = std::chrono::steady_clock::now();
+        Client_->Send(ServerId_, std::move(request));
+
+        auto message = co_await _scheduler.Receive(Client_.get());
+        auto received = std::chrono::steady_clock::now();
+        if (!HandleResponse(std::move(message))) {
             break;
-        case (uint32_t)EAPIEventsType::State:
-            State_->HandleState(*std::any_cast<State>(&message->Record_));
+        }
+        if (FinishIteration(received - sent)) {
             break;
         }
-        std::chrono::duration<double> durationOfHandling = std::chrono::steady_clock::now() - startHandling;
-        log::WriteClientRunner("ClientRunner::Run{id=", Id_, ", iteration=", IteratoinCount_, ", duratoin of handling message ", durationOfHandling.count(), "s}");
-        using namespace std::chrono_literals;
-        std::this_thread::sleep_for(200ms);
+        if (ThinkTime_.count()) {
+            co_await _scheduler.Sleep(ThinkTime_);
+        }
     }
     WorkTime_ = std::chrono::steady_clock::now() - start;
 }
 
-std::string ClientRunner::PrettyMemory(double _mem) const {
+template <typename _ClientState>
+std::string BasicClientRunner<_ClientState>::PrettyMemory(double _mem) const {
     std::ostringstream sout;
     sout << std::fixed << std::setprecision(2);
     if (_mem > 1e9) {
@@ -113,7 +337,8 @@ std::string ClientRunner::PrettyMemory(double _mem) const {
     return sout.str();
 }
 
-std::string ClientRunner::PrintStat() const {
+template <typename _ClientState>
+std::string BasicClientRunner<_ClientState>::PrintStat() const {
     std::ostringstream sout;
     sout << std::fixed << std::setprecision(2);
     sout << "Id# "  << Id_
@@ -124,5 +349,22 @@ std::string ClientRunner::PrintStat() const {
     sout << " Iterations# " << IteratoinCount_
         << " IterationsPerSecond# " << IteratoinCount_ / WorkTime_.count()
         << " WorkTime# " << WorkTime_.count() << 's' << std::endl;
+    if (!SnapshotPath_.empty()) {
+        sout << " Start# " << (Resumed_ ? "snapshot" : "state") << std::endl;
+    }
+    if (SubscribeWindow_) {
+        sout << " Pushes# " << Pushes_ << std::endl;
+    }
     return sout.str();
 }
+
+namespace home_task::actors {
+
+template struct BasicClientRunner<logic::IClientState>;
+template struct BasicClientRunner<logic::ClientStateNop>;
+template struct BasicClientRunner<logic::ClientState>;
+template struct BasicClientRunner<logic::FastClientState>;
+template struct BasicClientRunner<logic::BTreeClientState>;
+template struct BasicClientRunner<logic::FastSmallClientState>;
+
+}
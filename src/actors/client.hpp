@@ -1,39 +1,140 @@
 #pragma once
 
+#include "coroutine.hpp"
+
 #include <core/network_mock.hpp>
 #include <core/api.hpp>
 #include <core/log.hpp>
 #include <logic/client_state.hpp>
 
+#include <array>
 #include <memory>
 #include <chrono>
 #include <iomanip>
+#include <optional>
+#include <random>
+#include <string>
 
 namespace home_task::actors {
 
-struct ClientRunner {
-    network_mock::NetworkClient Client_;
-    std::unique_ptr<logic::IClientState> State_;
+// Response times in microseconds, SubBuckets buckets per power of two, so a quantile is off by a quarter at most.
+struct LatencyHistogram {
+    static constexpr uint32_t SubBuckets = 4;
+    static constexpr uint32_t Octaves = 32;
+
+    std::array<uint64_t, SubBuckets * Octaves> Buckets_{};
+    uint64_t Count_ = 0;
+    std::chrono::duration<double> Sum_{0};
+    std::chrono::duration<double> Max_{0};
+
+    void Add(std::chrono::duration<double> _latency);
+    void Merge(const LatencyHistogram &_other);
+    // The upper bound of the bucket of the quantile, 0 without samples.
+    std::chrono::duration<double> Quantile(double _quantile) const;
+
+    std::chrono::duration<double> Mean() const {
+        return Count_ ? Sum_ / Count_ : Sum_;
+    }
+};
+
+// Runner of the client actor, templated on the state as BasicServerRunner.
+template <typename _ClientState>
+struct BasicClientRunner {
+    std::unique_ptr<network_mock::INetworkClient> Client_;
+    std::unique_ptr<_ClientState> State_;
     model::ClientId Id_;
+    // the primary or a replica of it
+    model::ClientId ServerId_ = magic_numbers::ServerId;
+    // the array the client opens on a multi-array server
+    std::optional<model::ArrayId> ArrayId_;
 
     std::chrono::duration<double> WorkTime_;
     uint64_t IteratoinCount_ = 0;
     uint64_t SentBytes_ = 0;
     uint64_t ReceivedBytes_ = 0;
 
-    ClientRunner(network_mock::NetworkClient &&_client, std::unique_ptr<logic::IClientState> &&_state, model::ClientId _id)
+    // the state is saved to this file and restored from it on start, empty for none
+    std::string SnapshotPath_;
+    std::optional<api::State> Restored_;
+    bool Resumed_ = false;
+    // the array the state belongs to, saved with the snapshot
+    model::EpochId Epoch_ = 0;
+
+    // a reader only reads the array: it polls with SyncRequest or, with a window, subscribes to pushes
+    bool Reader_ = false;
+    uint32_t SubscribeWindow_ = 0;
+    // the least time between acknowledgements, with a full window the server gathers changes for this long
+    std::chrono::milliseconds CoalesceInterval_{0};
+    uint64_t Pushes_ = 0;
+
+    // the pause after a response before the next request
+    std::chrono::milliseconds ThinkTime_{200};
+    // the client stops by itself after this many iterations, 0 for until poisoned
+    uint64_t IterationLimit_ = 0;
+    // times of the requests of Run and RunAsync, nullptr for not measured
+    std::unique_ptr<LatencyHistogram> Latency_;
+
+    BasicClientRunner(std::unique_ptr<network_mock::INetworkClient> &&_client, std::unique_ptr<_ClientState> &&_state, model::ClientId _id)
         : Client_(std::move(_client))
         , State_(std::move(_state))
         , Id_(_id)
     {}
 
-    ~ClientRunner() {
+    BasicClientRunner(network_mock::NetworkClient &&_client, std::unique_ptr<_ClientState> &&_state, model::ClientId _id)
+        : BasicClientRunner(std::make_unique<network_mock::NetworkClient>(std::move(_client)), std::move(_state), _id)
+    {}
+
+    ~BasicClientRunner() {
         log::WriteDestructor("~ClientRunner");
     }
 
+    void SetServer(model::ClientId _serverId) {
+        ServerId_ = _serverId;
+    }
+
+    void SetArray(model::ArrayId _arrayId) {
+        ArrayId_ = _arrayId;
+    }
+
+    void EnableSnapshot(const std::string &_path) {
+        SnapshotPath_ = _path;
+    }
+
+    void SetReader(uint32_t _subscribeWindow, std::chrono::milliseconds _coalesceInterval = std::chrono::milliseconds(0)) {
+        Reader_ = true;
+        SubscribeWindow_ = _subscribeWindow;
+        CoalesceInterval_ = _coalesceInterval;
+    }
+
+    void SetThinkTime(std::chrono::milliseconds _thinkTime) {
+        ThinkTime_ = _thinkTime;
+    }
+
+    void SetIterationLimit(uint64_t _iterations) {
+        IterationLimit_ = _iterations;
+    }
+
+    void EnableLatency() {
+        Latency_ = std::make_unique<LatencyHistogram>();
+    }
+
+    void SaveSnapshot();
+    // Restores the snapshot and connects.
+    void Start();
+    std::unique_ptr<network_mock::MessageRecord> MakeRequest(std::mt19937 &_gen);
+    // Returns false when poisoned.
+    bool HandleResponse(std::unique_ptr<network_mock::MessageRecord> &&_message);
+    // Counts the request time of a handled response, returns true when the iteration limit is reached.
+    bool FinishIteration(std::chrono::duration<double> _latency);
     void Run();
+    // Loads the state and then only handles and acknowledges pushes.
+    void RunSubscriber();
+    // The same loop as Run, it waits for responses and sleeps without taking a thread.
+    Task RunAsync(CoroutineScheduler &_scheduler);
     std::string PrettyMemory(double _mem) const;
     std::string PrintStat() const;
 };
 
+using ClientRunner = BasicClientRunner<logic::IClientState>;
+
 }
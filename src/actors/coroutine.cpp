@@ -0,0 +1,96 @@
+#include "coroutine.hpp"
+
+#include <core/log.hpp>
+
+using namespace home_task::actors;
+
+
+CoroutineScheduler::CoroutineScheduler(uint32_t _threadCount) {
+    for (uint32_t idx = 0; idx < _threadCount; ++idx) {
+        Threads_.emplace_back(&CoroutineScheduler::Work, this);
+    }
+}
+
+CoroutineScheduler::~CoroutineScheduler() {
+    {
+        std::lock_guard<std::mutex> guard(Mutex_);
+        Stopped_ = true;
+    }
+    Wakeup_.notify_all();
+    for (auto &thread : Threads_) {
+        thread.join();
+    }
+    log::WriteDestructor("~CoroutineScheduler");
+}
+
+void CoroutineScheduler::Spawn(Task &&_task) {
+    auto handle = _task.Release();
+    handle.promise().Scheduler_ = this;
+    Alive_++;
+    Schedule(handle);
+}
+
+void CoroutineScheduler::Schedule(std::coroutine_handle<> _handle) {
+    {
+        std::lock_guard<std::mutex> guard(Mutex_);
+        Ready_.push_back(_handle);
+    }
+    Wakeup_.notify_one();
+}
+
+void CoroutineScheduler::ScheduleAt(Clock::time_point _deadline, std::coroutine_handle<> _handle) {
+    bool earliest = false;
+    {
+        std::lock_guard<std::mutex> guard(Mutex_);
+        earliest = Timers_.empty() || _deadline < Timers_.top().Deadline_;
+        Timers_.push(Timer{.Deadline_ = _deadline, .Handle_ = _handle});
+    }
+    // sleeping threads wait for the earliest timer, only a new earliest one changes their deadline
+    if (earliest) {
+        Wakeup_.notify_one();
+    }
+}
+
+void CoroutineScheduler::Join() {
+    std::unique_lock<std::mutex> lock(JoinMutex_);
+    Joined_.wait(lock, [&] { return !Alive_; });
+}
+
+void CoroutineScheduler::Finished() {
+    if (--Alive_ == 0) {
+        {
+            std::lock_guard<std::mutex> guard(JoinMutex_);
+        }
+        Joined_.notify_all();
+    }
+}
+
+void CoroutineScheduler::Work() {
+    std::unique_lock<std::mutex> lock(Mutex_);
+    while (!Stopped_) {
+        auto now = Clock::now();
+        while (!Timers_.empty() && Timers_.top().Deadline_ <= now) {
+            Ready_.push_back(Timers_.top().Handle_);
+            Timers_.pop();
+        }
+        if (!Ready_.empty()) {
+            auto handle = Ready_.front();
+            Ready_.pop_front();
+            if (!Ready_.empty()) {
+                Wakeup_.notify_one();
+            }
+            lock.unlock();
+            handle.resume();
+            Resumed_++;
+            lock.lock();
+            continue;
+        }
+        if (Timers_.empty()) {
+            Wakeup_.wait(lock);
+        } else {
+            // a copy: the heap may be reallocated while the lock is released
+            auto deadline = Timers_.top().Deadline_;
+            Wakeup_.wait_until(lock, deadline);
+        }
+    }
+}
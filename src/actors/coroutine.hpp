@@ -0,0 +1,191 @@
+#pragma once
+
+#include <core/network_mock.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace home_task::actors {
+
+class CoroutineScheduler;
+
+// Coroutine of an actor, it starts when spawned on a scheduler and destroys itself at the end.
+class Task {
+public:
+    struct promise_type {
+        CoroutineScheduler *Scheduler_ = nullptr;
+
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        auto final_suspend() noexcept;
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> _handle)
+        : Handle_(_handle)
+    {}
+
+    Task(Task &&_other)
+        : Handle_(std::exchange(_other.Handle_, nullptr))
+    {}
+
+    Task(const Task &) = delete;
+
+    ~Task() {
+        if (Handle_) {
+            Handle_.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> Release() {
+        return std::exchange(Handle_, nullptr);
+    }
+
+private:
+    std::coroutine_handle<promise_type> Handle_;
+};
+
+// Small pool of threads resuming coroutines: ready coroutines go in one queue, sleeping ones wait in a timer heap.
+// A coroutine waiting for a message leaves a waker in its mailbox, the sender puts it back to the ready queue,
+// so thousands of actors live on a few threads.
+class CoroutineScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Timer {
+        Clock::time_point Deadline_;
+        std::coroutine_handle<> Handle_;
+
+        bool operator>(const Timer &_other) const {
+            return Deadline_ > _other.Deadline_;
+        }
+    };
+
+    struct SleepAwaiter {
+        CoroutineScheduler *Scheduler_;
+        Clock::time_point Deadline_;
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> _handle) {
+            Scheduler_->ScheduleAt(Deadline_, _handle);
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    struct ReceiveAwaiter : network_mock::IWaker {
+        CoroutineScheduler *Scheduler_;
+        network_mock::INetworkClient *Client_;
+        std::coroutine_handle<> Handle_;
+        std::optional<std::unique_ptr<network_mock::MessageRecord>> Message_;
+
+        ReceiveAwaiter(CoroutineScheduler *_scheduler, network_mock::INetworkClient *_client)
+            : Scheduler_(_scheduler)
+            , Client_(_client)
+        {}
+
+        bool await_ready() {
+            Message_ = Client_->Receive();
+            return Message_.has_value();
+        }
+
+        bool await_suspend(std::coroutine_handle<> _handle) {
+            Handle_ = _handle;
+            // the coroutine may be resumed by the sender before this returns, nothing of the frame is touched after
+            return Client_->WakeOnMessage(this);
+        }
+
+        std::unique_ptr<network_mock::MessageRecord> await_resume() {
+            if (!Message_) {
+                Message_ = Client_->Receive();
+            }
+            return std::move(*Message_);
+        }
+
+        void Wake() override {
+            Scheduler_->Schedule(Handle_);
+        }
+    };
+
+    CoroutineScheduler(uint32_t _threadCount);
+    ~CoroutineScheduler();
+
+    void Spawn(Task &&_task);
+    void Schedule(std::coroutine_handle<> _handle);
+    void ScheduleAt(Clock::time_point _deadline, std::coroutine_handle<> _handle);
+    // Waits until every spawned coroutine ends.
+    void Join();
+    void Finished();
+
+    template <typename _Rep, typename _Period>
+    SleepAwaiter Sleep(std::chrono::duration<_Rep, _Period> _duration) {
+        return SleepAwaiter{this, Clock::now() + std::chrono::duration_cast<Clock::duration>(_duration)};
+    }
+
+    ReceiveAwaiter Receive(network_mock::INetworkClient *_client) {
+        return ReceiveAwaiter(this, _client);
+    }
+
+    uint64_t GetResumed() const {
+        return Resumed_;
+    }
+
+private:
+    void Work();
+
+    std::mutex Mutex_;
+    std::condition_variable Wakeup_;
+    std::deque<std::coroutine_handle<>> Ready_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> Timers_;
+    bool Stopped_ = false;
+    std::vector<std::thread> Threads_;
+
+    std::atomic<uint64_t> Alive_ = 0;
+    std::atomic<uint64_t> Resumed_ = 0;
+    std::mutex JoinMutex_;
+    std::condition_variable Joined_;
+};
+
+inline auto Task::promise_type::final_suspend() noexcept {
+    struct FinalAwaiter {
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<promise_type> _handle) const noexcept {
+            CoroutineScheduler *scheduler = _handle.promise().Scheduler_;
+            _handle.destroy();
+            scheduler->Finished();
+        }
+
+        void await_resume() const noexcept {}
+    };
+    return FinalAwaiter{};
+}
+
+}
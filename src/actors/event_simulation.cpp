@@ -0,0 +1,258 @@
+#include "event_simulation.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+using namespace home_task::actors;
+using namespace home_task::network_mock;
+
+
+EventQueue::EventQueue(const SimulationSettings &_settings)
+    : Settings_(_settings)
+    , Random_(_settings.Seed_)
+{}
+
+EventQueue::~EventQueue() {
+    uint64_t count = 0;
+    while (!Events_.empty()) {
+        if (Events_.top().Message_) {
+            delete Events_.top().Message_;
+            count++;
+        }
+        Events_.pop();
+    }
+    log::WriteDestructor("~EventQueue in flight# ", count);
+}
+
+const LinkSettings& EventQueue::GetSettings(model::ClientId _sender, model::ClientId _receiver) const {
+    auto it = Settings_.Links_.find(SimulationSettings::LinkKey(_sender, _receiver));
+    return it != Settings_.Links_.end() ? it->second : Settings_.Default_;
+}
+
+void EventQueue::Send(model::ClientId _sender, model::ClientId _receiver, std::unique_ptr<MessageRecord> &&_msg) {
+    _msg->Sender_ = _sender;
+    _msg->BeginTrace();
+    const LinkSettings &settings = GetSettings(_sender, _receiver);
+    Link &link = Links_[SimulationSettings::LinkKey(_sender, _receiver)];
+    SentCount_++;
+    SentBytes_ += _msg->Size_;
+
+    auto sent = Now_;
+    if (settings.BytesPerSecond_) {
+        auto transmission = std::chrono::duration_cast<Time>(
+                std::chrono::duration<double>(static_cast<double>(_msg->Size_) / settings.BytesPerSecond_));
+        link.BusyUntil_ = std::max(link.BusyUntil_, Now_) + transmission;
+        sent = link.BusyUntil_;
+    }
+    bool isControl = _msg->Type_ < static_cast<uint32_t>(EMessageType::PRIVATE);
+    if (!isControl) {
+        auto retransmits = SampleRetransmits(settings, Random_, &DroppedCount_);
+        if (retransmits.count()) {
+            log::WriteNetwork("EventQueue::Send{drop ", _sender, "->", _receiver, ", resent after ", retransmits.count(), "us}");
+            sent += retransmits;
+        }
+    }
+    auto delivery = sent + SampleLatency(settings, Random_);
+    if (settings.ReorderProbability_ > 0 && std::bernoulli_distribution(settings.ReorderProbability_)(Random_)) {
+        ReorderedCount_++;
+    } else {
+        delivery = std::max(delivery, link.LastDelivery_);
+    }
+    link.LastDelivery_ = std::max(link.LastDelivery_, delivery);
+
+    Events_.push(Event{
+        .Time_ = delivery,
+        .Sequence_ = NextSequence_++,
+        .Type_ = EEventType::Deliver,
+        .Actor_ = _receiver,
+        .Message_ = _msg.release(),
+    });
+}
+
+void EventQueue::Schedule(Time _time, EEventType _type, model::ClientId _actor) {
+    Events_.push(Event{
+        .Time_ = std::max(_time, Now_),
+        .Sequence_ = NextSequence_++,
+        .Type_ = _type,
+        .Actor_ = _actor,
+    });
+}
+
+std::optional<EventQueue::Event> EventQueue::Pop() {
+    if (Events_.empty()) {
+        return std::nullopt;
+    }
+    Event event = Events_.top();
+    Events_.pop();
+    Now_ = event.Time_;
+    EventCount_++;
+    return event;
+}
+
+std::string EventQueue::PrintStat() const {
+    std::ostringstream sout;
+    sout << std::fixed << std::setprecision(6);
+    sout << "Network Sent# " << SentCount_
+        << " SentBytes# " << SentBytes_
+        << " Dropped# " << DroppedCount_
+        << " Reordered# " << ReorderedCount_ << std::endl;
+    sout << "Events# " << EventCount_
+        << " VirtualTime# " << std::chrono::duration<double>(Now_).count() << 's' << std::endl;
+    return sout.str();
+}
+
+template <typename _ServerState, typename _ClientState>
+BasicEventSimulation<_ServerState, _ClientState>::BasicEventSimulation(const SimulationSettings &_settings,
+        uint32_t _clientCount, const model::CellVector &_cells, Time _duration)
+    : Network_(std::make_shared<NetworkMock>(_clientCount + 2))
+    , Queue_(_settings)
+    , Poisoned_(_clientCount + 2, false)
+    , Duration_(_duration)
+{
+    Server_ = std::make_unique<BasicServerRunner<_ServerState>>(
+            std::make_unique<EventNetworkClient>(&Queue_, Network_, magic_numbers::ServerId),
+            std::make_unique<_ServerState>(_cells));
+    Clients_.reserve(_clientCount);
+    Generators_.reserve(_clientCount);
+    for (uint32_t idx = 0; idx < _clientCount; ++idx) {
+        Clients_.push_back(std::make_unique<BasicClientRunner<_ClientState>>(
+                std::make_unique<EventNetworkClient>(&Queue_, Network_, idx + 1),
+                std::make_unique<_ClientState>(),
+                idx + 1));
+        // the generators of clients don't depend on each other, so adding a client doesn't change the others
+        std::seed_seq seed{_settings.Seed_, static_cast<uint64_t>(idx + 1)};
+        Generators_.emplace_back(seed);
+    }
+    Starts_.resize(_clientCount);
+}
+
+template <typename _ServerState, typename _ClientState>
+void BasicEventSimulation<_ServerState, _ClientState>::Run() {
+    log::WriteServerRunner("EventSimulation::Run");
+    for (uint32_t idx = 0; idx < Clients_.size(); ++idx) {
+        Clients_[idx]->Start();
+        SendRequest(idx);
+    }
+    Queue_.Schedule(Duration_, EventQueue::EEventType::Timer, MainId());
+
+    while (auto event = Queue_.Pop()) {
+        switch (event->Type_) {
+        case EventQueue::EEventType::Deliver:
+            Deliver(event->Actor_, event->Message_);
+            break;
+        case EventQueue::EEventType::Timer:
+            if (event->Actor_ == MainId()) {
+                Poison();
+            } else if (!Poisoned_[event->Actor_]) {
+                uint32_t idx = event->Actor_ - 1;
+                auto &client = *Clients_[idx];
+                client.IteratoinCount_++;
+                if (!magic_numbers::CalculateFirstLoadState && client.IteratoinCount_ == 1) {
+                    Starts_[idx] = Queue_.Now();
+                }
+                SendRequest(idx);
+            }
+            break;
+        case EventQueue::EEventType::Handle:
+            if (event->Actor_ == magic_numbers::ServerId) {
+                HandleServer();
+            } else {
+                HandleClient(event->Actor_ - 1);
+            }
+            break;
+        }
+    }
+}
+
+template <typename _ServerState, typename _ClientState>
+void BasicEventSimulation<_ServerState, _ClientState>::Deliver(model::ClientId _receiver, MessageRecord *_msg) {
+    std::unique_ptr<MessageRecord> msg(_msg);
+    if (_receiver == MainId() || Poisoned_[_receiver]) {
+        return;
+    }
+    Network_->Send(_receiver, msg->Sender_, std::move(msg));
+    if (_receiver == magic_numbers::ServerId) {
+        // the server takes everything delivered at this time as one batch
+        if (!ServerScheduled_) {
+            ServerScheduled_ = true;
+            Queue_.Schedule(Queue_.Now(), EventQueue::EEventType::Handle, _receiver);
+        }
+    } else {
+        Queue_.Schedule(Queue_.Now(), EventQueue::EEventType::Handle, _receiver);
+    }
+}
+
+template <typename _ServerState, typename _ClientState>
+void BasicEventSimulation<_ServerState, _ClientState>::HandleServer() {
+    ServerScheduled_ = false;
+    std::vector<std::unique_ptr<MessageRecord>> messages;
+    Server_->Client_->ReceiveAll(&messages);
+    if (!messages.empty() && !Server_->HandleBatch(messages)) {
+        Poisoned_[magic_numbers::ServerId] = true;
+    }
+}
+
+template <typename _ServerState, typename _ClientState>
+void BasicEventSimulation<_ServerState, _ClientState>::HandleClient(uint32_t _idx) {
+    auto &client = *Clients_[_idx];
+    while (!Poisoned_[_idx + 1]) {
+        auto message = client.Client_->Receive();
+        if (!message) {
+            break;
+        }
+        if (!client.HandleResponse(std::move(*message))) {
+            Poisoned_[_idx + 1] = true;
+            client.WorkTime_ = Queue_.Now() - Starts_[_idx];
+            break;
+        }
+        Queue_.Schedule(Queue_.Now() + ThinkTime_, EventQueue::EEventType::Timer, _idx + 1);
+    }
+}
+
+template <typename _ServerState, typename _ClientState>
+void BasicEventSimulation<_ServerState, _ClientState>::SendRequest(uint32_t _idx) {
+    auto &client = *Clients_[_idx];
+    client.Client_->Send(client.ServerId_, client.MakeRequest(Generators_[_idx]));
+}
+
+template <typename _ServerState, typename _ClientState>
+void BasicEventSimulation<_ServerState, _ClientState>::Poison() {
+    log::WriteServerRunner("EventSimulation::Poison{time ", std::chrono::duration<double>(Queue_.Now()).count(), "s}");
+    Queue_.Send(MainId(), magic_numbers::ServerId, MakePoisonMessage());
+    for (uint32_t idx = 0; idx < Clients_.size(); ++idx) {
+        Queue_.Send(MainId(), idx + 1, MakePoisonMessage());
+    }
+}
+
+template <typename _ServerState, typename _ClientState>
+std::string BasicEventSimulation<_ServerState, _ClientState>::PrintStat() const {
+    std::ostringstream sout;
+    for (auto &client : Clients_) {
+        sout << client->PrintStat();
+    }
+    sout << Queue_.PrintStat();
+    // FNV-1a of the cells of the server
+    auto state = Server_->State_->LoadState();
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&] (uint64_t _value) {
+        for (uint32_t byte = 0; byte < sizeof(_value); ++byte) {
+            hash = (hash ^ ((_value >> (byte * 8)) & 0xff)) * 1099511628211ull;
+        }
+    };
+    for (auto &cell : state.Cells_) {
+        mix(cell.CellId_);
+        mix(cell.Value_);
+    }
+    sout << "Cells# " << state.Cells_.size()
+        << " Iteration# " << Server_->State_->GetIteration()
+        << " StateHash# " << std::hex << hash << std::dec << std::endl;
+    return sout.str();
+}
+
+namespace home_task::actors {
+
+template struct BasicEventSimulation<logic::ServerState, logic::FastSmallClientState>;
+template struct BasicEventSimulation<logic::ServerStateNop, logic::ClientStateNop>;
+
+}
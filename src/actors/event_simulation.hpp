@@ -0,0 +1,181 @@
+#pragma once
+
+#include "client.hpp"
+#include "server.hpp"
+
+#include <core/network_mock.hpp>
+#include <core/network_simulation.hpp>
+#include <core/log.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <random>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace home_task::actors {
+
+// Events of the simulation in virtual time: deliveries of messages and wakeups of actors.
+// Events of the same time go in the order they were added and every random choice comes from one seeded generator,
+// so a run depends only on the seed.
+// Links work as in NetworkSimulation: latency, bandwidth, order, reorders and drops.
+class EventQueue {
+public:
+    using Time = std::chrono::microseconds;
+
+    enum class EEventType : uint32_t {
+        Deliver,
+        Timer,
+        // the actor takes all delivered messages, it's queued after the deliveries of the same time
+        Handle,
+    };
+
+    struct Event {
+        Time Time_;
+        uint64_t Sequence_;
+        EEventType Type_;
+        model::ClientId Actor_;
+        // owned by the event until delivered, Sender_ is set
+        network_mock::MessageRecord *Message_ = nullptr;
+
+        bool operator>(const Event &_other) const {
+            return std::tie(Time_, Sequence_) > std::tie(_other.Time_, _other.Sequence_);
+        }
+    };
+
+    EventQueue(const network_mock::SimulationSettings &_settings);
+    ~EventQueue();
+
+    void Send(model::ClientId _sender, model::ClientId _receiver, std::unique_ptr<network_mock::MessageRecord> &&_msg);
+    void Schedule(Time _time, EEventType _type, model::ClientId _actor);
+    // Moves the clock to the next event.
+    std::optional<Event> Pop();
+
+    Time Now() const {
+        return Now_;
+    }
+
+    uint64_t GetEventCount() const {
+        return EventCount_;
+    }
+
+    std::string PrintStat() const;
+
+private:
+    struct Link {
+        Time BusyUntil_{0};
+        Time LastDelivery_{0};
+    };
+
+    const network_mock::LinkSettings& GetSettings(model::ClientId _sender, model::ClientId _receiver) const;
+
+    network_mock::SimulationSettings Settings_;
+    std::mt19937_64 Random_;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> Events_;
+    std::unordered_map<uint64_t, Link> Links_;
+    Time Now_{0};
+    uint64_t NextSequence_ = 0;
+
+    uint64_t EventCount_ = 0;
+    uint64_t SentCount_ = 0;
+    uint64_t DroppedCount_ = 0;
+    uint64_t ReorderedCount_ = 0;
+    uint64_t SentBytes_ = 0;
+};
+
+// What an actor of the event simulation sees of the network: sending goes through the event queue,
+// delivered messages wait in its mailbox of NetworkMock. Nobody waits in the simulation,
+// the handler of an actor is called when there are messages.
+class EventNetworkClient : public network_mock::INetworkClient {
+    EventQueue *Queue_;
+    network_mock::NetworkClient Client_;
+    model::ClientId Id_;
+
+public:
+    EventNetworkClient(EventQueue *_queue, const std::shared_ptr<network_mock::NetworkMock> &_network, model::ClientId _id)
+        : Queue_(_queue)
+        , Client_(_network, _id)
+        , Id_(_id)
+    {}
+
+    void Send(model::ClientId _receiver, std::unique_ptr<network_mock::MessageRecord> &&_msg) override {
+        Queue_->Send(Id_, _receiver, std::move(_msg));
+    }
+
+    std::optional<std::unique_ptr<network_mock::MessageRecord>> Receive() override {
+        return Client_.Receive();
+    }
+
+    std::unique_ptr<network_mock::MessageRecord> ReceiveWithWaiting() override {
+        NoWaiting();
+    }
+
+    uint32_t ReceiveAll(std::vector<std::unique_ptr<network_mock::MessageRecord>> *_messages) override {
+        return Client_.ReceiveAll(_messages);
+    }
+
+    uint32_t ReceiveAllWithWaiting(std::vector<std::unique_ptr<network_mock::MessageRecord>> *) override {
+        NoWaiting();
+    }
+
+    void WaitMessage() override {
+        NoWaiting();
+    }
+
+private:
+    [[noreturn]] void NoWaiting() {
+        log::ForceWrite("the event simulation can't wait for messages");
+        std::exit(1);
+    }
+};
+
+// The server and the clients of exe::Test as handlers of events on one thread in virtual time.
+// The server handles a batch of the messages delivered at the same time, a client sends the next request
+// ThinkTime_ after the response. Mailboxes: the server, the clients from 1, the main actor that poisons
+// everybody after Duration_. A "100 seconds" run takes as long as handling its messages takes.
+template <typename _ServerState, typename _ClientState>
+struct BasicEventSimulation {
+    using Time = EventQueue::Time;
+
+    std::shared_ptr<network_mock::NetworkMock> Network_;
+    EventQueue Queue_;
+    std::unique_ptr<BasicServerRunner<_ServerState>> Server_;
+    std::vector<std::unique_ptr<BasicClientRunner<_ClientState>>> Clients_;
+    // by the client index
+    std::vector<std::mt19937> Generators_;
+    std::vector<Time> Starts_;
+    // by the mailbox, messages to poisoned actors are dropped
+    std::vector<bool> Poisoned_;
+    bool ServerScheduled_ = false;
+
+    Time Duration_;
+    Time ThinkTime_ = std::chrono::milliseconds(200);
+
+    BasicEventSimulation(const network_mock::SimulationSettings &_settings, uint32_t _clientCount,
+            const model::CellVector &_cells, Time _duration);
+
+    ~BasicEventSimulation() {
+        log::WriteDestructor("~EventSimulation");
+    }
+
+    model::ClientId MainId() const {
+        return Clients_.size() + 1;
+    }
+
+    // Runs until no events left.
+    void Run();
+    void Deliver(model::ClientId _receiver, network_mock::MessageRecord *_msg);
+    void HandleServer();
+    void HandleClient(uint32_t _idx);
+    void SendRequest(uint32_t _idx);
+    void Poison();
+    // The clients, the network and a hash of the server array, equal for equal seeds.
+    std::string PrintStat() const;
+};
+
+}
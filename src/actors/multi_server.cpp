@@ -0,0 +1,121 @@
+#include "multi_server.hpp"
+
+#include <sstream>
+#include <variant>
+
+using namespace home_task::actors;
+using namespace home_task::network_mock;
+using namespace home_task::api;
+using namespace home_task;
+
+
+namespace {
+
+// Network client of an array runner: answers go through the client of the whole server,
+// messages come from the receiving thread, so receiving is never called.
+class ArrayNetworkClient : public INetworkClient {
+    INetworkClient *Client_;
+
+public:
+    ArrayNetworkClient(INetworkClient *_client)
+        : Client_(_client)
+    {}
+
+    void Send(model::ClientId _receiver, std::unique_ptr<MessageRecord> &&_msg) override {
+        Client_->Send(_receiver, std::move(_msg));
+    }
+
+    std::optional<std::unique_ptr<MessageRecord>> Receive() override {
+        return std::nullopt;
+    }
+
+    std::unique_ptr<MessageRecord> ReceiveWithWaiting() override {
+        return nullptr;
+    }
+
+    uint32_t ReceiveAll(std::vector<std::unique_ptr<MessageRecord>> *) override {
+        return 0;
+    }
+
+    uint32_t ReceiveAllWithWaiting(std::vector<std::unique_ptr<MessageRecord>> *) override {
+        return 0;
+    }
+
+    void WaitMessage() override {
+    }
+};
+
+}
+
+MultiServerRunner::MultiServerRunner(std::unique_ptr<INetworkClient> &&_client, uint32_t _workerCount)
+    : Client_(std::move(_client))
+    , Pool_(_workerCount, [this] (Array *_array) { HandleArray(_array); })
+{}
+
+void MultiServerRunner::AddArray(model::ArrayId _id, const model::CellVector &_cells) {
+    auto array = std::make_unique<Array>();
+    array->Id_ = _id;
+    array->Runner_ = std::make_unique<ArrayRunner>(
+            std::make_unique<ArrayNetworkClient>(Client_.get()),
+            std::make_unique<logic::ServerState>(_cells));
+    Arrays_[_id] = std::move(array);
+}
+
+void MultiServerRunner::HandleArray(Array *_array) {
+    std::vector<std::unique_ptr<MessageRecord>> messages;
+    {
+        std::lock_guard<std::mutex> guard(_array->Mutex_);
+        messages.swap(_array->Inbox_);
+    }
+    _array->Runner_->HandleBatch(messages);
+}
+
+void MultiServerRunner::Run() {
+    log::WriteServerRunner("MultiServerRunner::Run{arrays=", Arrays_.size(), ", workers=", Pool_.Workers_.size(), '}');
+    Pool_.Start();
+
+    std::vector<std::unique_ptr<MessageRecord>> messages;
+    for (bool poisoned = false; !poisoned;) {
+        messages.clear();
+        Client_->ReceiveAllWithWaiting(&messages);
+        for (auto &message : messages) {
+            if (message->Type_ == static_cast<uint32_t>(EMessageType::Poison)) {
+                log::WriteServerRunner("MultiServerRunner::Run{Poisoned}");
+                poisoned = true;
+                break;
+            }
+            if (auto open = std::get_if<OpenArrayRequest>(&message->Record_)) {
+                auto it = Arrays_.find(open->ArrayId_);
+                if (it == Arrays_.end()) {
+                    log::Write("MultiServerRunner::Run{client ", message->Sender_, " opens unknown array ", open->ArrayId_, '}');
+                    continue;
+                }
+                ClientArrays_[message->Sender_] = it->second.get();
+                continue;
+            }
+            if (std::holds_alternative<std::monostate>(message->Record_)) {
+                continue;
+            }
+            auto it = ClientArrays_.find(message->Sender_);
+            if (it == ClientArrays_.end()) {
+                UnroutedMessages_++;
+                continue;
+            }
+            Pool_.Deliver(it->second, std::move(message));
+        }
+    }
+    Pool_.Stop();
+}
+
+std::string MultiServerRunner::PrintStat() const {
+    std::ostringstream sout;
+    sout << "Arrays# " << Arrays_.size()
+        << " Clients# " << ClientArrays_.size()
+        << " UnroutedMessages# " << UnroutedMessages_ << std::endl;
+    for (uint32_t idx = 0; idx < Pool_.Workers_.size(); ++idx) {
+        sout << " Worker# " << idx
+            << " Batches# " << Pool_.Workers_[idx]->Batches_
+            << " Stolen# " << Pool_.Workers_[idx]->Stolen_ << std::endl;
+    }
+    return sout.str();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "server.hpp"
+#include "worker_pool.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace home_task::actors {
+
+// Server of many independent arrays, every array has its own state and history.
+// The receiving thread routes messages by the array their client opened and queues them to the array,
+// an array with messages is put to a queue of the worker pool. An array is handled by one worker at a time:
+// the worker takes all its queued messages as one batch of its own BasicServerRunner.
+struct MultiServerRunner {
+    using ArrayRunner = BasicServerRunner<logic::ServerState>;
+
+    struct Array {
+        model::ArrayId Id_ = 0;
+        std::unique_ptr<ArrayRunner> Runner_;
+        std::mutex Mutex_;
+        std::vector<std::unique_ptr<network_mock::MessageRecord>> Inbox_;
+        // the array is in a worker queue or is being handled
+        bool Scheduled_ = false;
+    };
+
+    std::unique_ptr<network_mock::INetworkClient> Client_;
+    std::unordered_map<model::ArrayId, std::unique_ptr<Array>> Arrays_;
+    std::unordered_map<model::ClientId, Array*> ClientArrays_;
+    WorkerPool<Array> Pool_;
+
+    uint64_t UnroutedMessages_ = 0;
+
+    MultiServerRunner(std::unique_ptr<network_mock::INetworkClient> &&_client, uint32_t _workerCount);
+
+    MultiServerRunner(network_mock::NetworkClient &&_client, uint32_t _workerCount)
+        : MultiServerRunner(std::make_unique<network_mock::NetworkClient>(std::move(_client)), _workerCount)
+    {}
+
+    ~MultiServerRunner() {
+        log::WriteDestructor("~MultiServerRunner");
+    }
+
+    // Arrays are added before Run.
+    void AddArray(model::ArrayId _id, const model::CellVector &_cells);
+
+    // Receives messages until poisoned, workers live inside.
+    void Run();
+    std::string PrintStat() const;
+
+    void HandleArray(Array *_array);
+};
+
+}
@@ -0,0 +1,212 @@
+#include "relay.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+using namespace home_task::actors;
+using namespace home_task::network_mock;
+using namespace home_task::api;
+using namespace home_task;
+
+
+RelayRunner::RelayRunner(std::unique_ptr<INetworkClient> &&_client, model::ClientId _id, model::ClientId _upstreamId)
+    : Client_(std::move(_client))
+    , State_(std::make_unique<logic::BTreeClientState>())
+    , Id_(_id)
+    , UpstreamId_(_upstreamId)
+{}
+
+bool RelayRunner::HasChunksSince(model::IterationId _iteration) const {
+    if (_iteration == State_->Iteration_) {
+        return true;
+    }
+    auto it = std::lower_bound(Chunks_.begin(), Chunks_.end(), _iteration, [] (const Chunk &_chunk, model::IterationId _iteration) {
+        return _chunk.From_ < _iteration;
+    });
+    return it != Chunks_.end() && it->From_ == _iteration;
+}
+
+void RelayRunner::FillHistory(model::IterationId _iteration, GenericResponse *_response) const {
+    auto it = std::lower_bound(Chunks_.begin(), Chunks_.end(), _iteration, [] (const Chunk &_chunk, model::IterationId _iteration) {
+        return _chunk.From_ < _iteration;
+    });
+    // chunks follow each other, so their diffs put together are the diff of the whole range
+    for (; it != Chunks_.end(); ++it) {
+        auto &diff = it->Diff_;
+        _response->Updates_.insert(_response->Updates_.end(), diff.Updates_.begin(), diff.Updates_.end());
+        _response->Insertions_.insert(_response->Insertions_.end(), diff.Insertions_.begin(), diff.Insertions_.end());
+        _response->Deletions_.insert(_response->Deletions_.end(), diff.Deletions_.begin(), diff.Deletions_.end());
+    }
+}
+
+void RelayRunner::AnswerState(model::ClientId _client, model::IterationId _iteration) {
+    auto state = State_->MakeSnapshot();
+    if (magic_numbers::WithStateChecking && HasChunksSince(_iteration)) {
+        FillHistory(_iteration, &state);
+    }
+    Cursors_[_client] = state.Iteration_;
+    state.Epoch_ = Epoch_;
+    Client_->Send(_client, MakeResponseMessage(std::move(state)));
+}
+
+void RelayRunner::HandleDownstream(std::unique_ptr<MessageRecord> &&_message) {
+    bool request = std::visit([] <typename _Record> (const _Record &) {
+        return IsRequest<_Record>;
+    }, _message->Record_);
+    if (!request) {
+        return;
+    }
+    if (!Loaded_) {
+        Pending_.push_back(std::move(_message));
+        return;
+    }
+    model::ClientId sender = _message->Sender_;
+    bool upstream = false;
+    std::visit([&] <typename _Record> (_Record &_record) {
+        if constexpr (std::is_same_v<_Record, LoadStateRequest>) {
+            AnswerState(sender, _record.PreviousIteration_);
+        } else if constexpr (std::is_same_v<_Record, SyncRequest> || std::is_same_v<_Record, ResumeRequest>) {
+            bool otherArray = false;
+            if constexpr (std::is_same_v<_Record, ResumeRequest>) {
+                otherArray = _record.Epoch_ != Epoch_;
+            }
+            if (otherArray || !HasChunksSince(_record.PreviousIteration_)) {
+                log::WriteRelayRunner("RelayRunner::HandleDownstream{id=", sender, ", unknown iteration ", _record.PreviousIteration_, '}');
+                // the iteration of another array means nothing here
+                AnswerState(sender, otherArray ? 0 : _record.PreviousIteration_);
+                return;
+            }
+            SyncResponse response;
+            FillHistory(_record.PreviousIteration_, &response);
+            response.Iteration_ = State_->Iteration_;
+            Cursors_[sender] = response.Iteration_;
+            Client_->Send(sender, MakeResponseMessage(std::move(response)));
+            RefreshWanted_ = true;
+        } else if constexpr (IsMutation<_Record>) {
+            upstream = true;
+        }
+    }, _message->Record_);
+    if (upstream) {
+        Pending_.push_back(std::move(_message));
+    }
+}
+
+void RelayRunner::HandleUpstream(MessageRecord *_message) {
+    std::visit([&] <typename _Record> (_Record &_record) {
+        if constexpr (std::is_same_v<_Record, State>) {
+            log::WriteRelayRunner("RelayRunner::HandleUpstream{id=", Id_, ", loaded ", _record.Cells_.size(), " cells}");
+            State_->HandleState(_record);
+            Epoch_ = _record.Epoch_;
+            Loaded_ = true;
+            InFlight_ = false;
+            auto deferred = std::move(Pending_);
+            Pending_.clear();
+            for (auto &message : deferred) {
+                HandleDownstream(std::move(message));
+            }
+        } else if constexpr (std::is_base_of_v<GenericResponse, _Record>) {
+            model::IterationId from = State_->Iteration_;
+            SyncResponse diff;
+            static_cast<GenericResponse&>(diff) = _record;
+            State_->HandleSyncResponse(diff);
+            if (diff.Iteration_ != from) {
+                Chunks_.push_back(Chunk{.From_ = from, .To_ = diff.Iteration_, .Diff_ = std::move(diff)});
+            }
+            InFlight_ = false;
+            if (std::exchange(Refreshing_, false)) {
+                return;
+            }
+            auto request = std::move(Pending_.front());
+            Pending_.pop_front();
+            model::IterationId iteration = std::visit([] <typename _Request> (const _Request &_request) -> model::IterationId {
+                if constexpr (IsMutation<_Request>) {
+                    return _request.PreviousIteration_;
+                } else {
+                    return 0;
+                }
+            }, request->Record_);
+            _record.Updates_.clear();
+            _record.Insertions_.clear();
+            _record.Deletions_.clear();
+            if (HasChunksSince(iteration)) {
+                FillHistory(iteration, &_record);
+            }
+            _record.Iteration_ = State_->Iteration_;
+            Cursors_[request->Sender_] = _record.Iteration_;
+            Client_->Send(request->Sender_, MakeResponseMessage(std::move(_record)));
+        }
+    }, _message->Record_);
+}
+
+void RelayRunner::SendUpstream() {
+    if (!Pending_.empty()) {
+        std::visit([&] <typename _Record> (const _Record &_record) {
+            if constexpr (IsMutation<_Record>) {
+                // the server sees only the relay, so the request goes from the iteration of the relay
+                auto request = _record;
+                request.PreviousIteration_ = State_->Iteration_;
+                Client_->Send(UpstreamId_, MakeRequestMessage(std::move(request)));
+            }
+        }, Pending_.front()->Record_);
+    } else if (std::exchange(RefreshWanted_, false)) {
+        Refreshing_ = true;
+        Client_->Send(UpstreamId_, MakeRequestMessage(SyncRequest(State_->Iteration_)));
+    } else {
+        return;
+    }
+    InFlight_ = true;
+    UpstreamRequests_++;
+}
+
+void RelayRunner::DropChunks() {
+    model::IterationId oldest = State_->Iteration_;
+    for (auto &[client, iteration] : Cursors_) {
+        oldest = std::min(oldest, iteration);
+    }
+    while (!Chunks_.empty() && Chunks_.front().To_ <= oldest) {
+        Chunks_.pop_front();
+    }
+}
+
+void RelayRunner::Run() {
+    log::WriteRelayRunner("RelayRunner::Run");
+    Client_->Send(UpstreamId_, MakeConnectMessage());
+    Client_->Send(UpstreamId_, MakeRequestMessage(LoadStateRequest(0)));
+    InFlight_ = true;
+    UpstreamRequests_++;
+
+    std::vector<std::unique_ptr<MessageRecord>> messages;
+    for (;;) {
+        messages.clear();
+        Client_->ReceiveAllWithWaiting(&messages);
+        for (auto &message : messages) {
+            if (message->Type_ == static_cast<uint32_t>(EMessageType::Poison)) {
+                log::WriteRelayRunner("RelayRunner::Run{Poisoned}");
+                return;
+            }
+            if (message->Sender_ == UpstreamId_) {
+                HandleUpstream(message.get());
+            } else {
+                DownstreamRequests_++;
+                HandleDownstream(std::move(message));
+            }
+        }
+        if (Loaded_ && !InFlight_) {
+            SendUpstream();
+        }
+        DropChunks();
+    }
+}
+
+std::string RelayRunner::PrintStat() const {
+    std::ostringstream sout;
+    sout << "Relay# " << Id_
+        << " Downstream# " << Cursors_.size()
+        << " DownstreamRequests# " << DownstreamRequests_
+        << " UpstreamRequests# " << UpstreamRequests_
+        << " Chunks# " << Chunks_.size() << std::endl;
+    return sout.str();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <core/network_mock.hpp>
+#include <core/api.hpp>
+#include <core/log.hpp>
+#include <logic/client_state.hpp>
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace home_task::actors {
+
+// Relay between many downstream clients and one upstream session with the server.
+// The relay is an ordinary client for the server: it keeps the whole array in a client state
+// and asks the server one request at a time, so the server tracks and diffs one client per relay.
+// Every diff from upstream is kept as a chunk, downstream clients get the chunks after their
+// iteration, which is always the end of some chunk, and LoadState is answered from the local array.
+struct RelayRunner {
+    struct Chunk {
+        model::IterationId From_ = 0;
+        model::IterationId To_ = 0;
+        api::GenericResponse Diff_;
+    };
+
+    std::unique_ptr<network_mock::INetworkClient> Client_;
+    std::unique_ptr<logic::BTreeClientState> State_;
+    model::ClientId Id_;
+    model::ClientId UpstreamId_;
+
+    bool Loaded_ = false;
+    // of the upstream array, from its state
+    model::EpochId Epoch_ = 0;
+    // downstream requests waiting for the upstream session, the front one is in flight,
+    // until the array is loaded all downstream requests wait here
+    std::deque<std::unique_ptr<network_mock::MessageRecord>> Pending_;
+    bool InFlight_ = false;
+    // the relay asked upstream for new history by itself
+    bool Refreshing_ = false;
+    bool RefreshWanted_ = false;
+
+    std::deque<Chunk> Chunks_;
+    // the iteration every downstream client got last, chunks before all of them are dropped
+    std::unordered_map<model::ClientId, model::IterationId> Cursors_;
+
+    uint64_t DownstreamRequests_ = 0;
+    uint64_t UpstreamRequests_ = 0;
+
+    RelayRunner(std::unique_ptr<network_mock::INetworkClient> &&_client, model::ClientId _id, model::ClientId _upstreamId);
+
+    RelayRunner(network_mock::NetworkClient &&_client, model::ClientId _id, model::ClientId _upstreamId)
+        : RelayRunner(std::make_unique<network_mock::NetworkClient>(std::move(_client)), _id, _upstreamId)
+    {}
+
+    ~RelayRunner() {
+        log::WriteDestructor("~RelayRunner");
+    }
+
+    void Run();
+    std::string PrintStat() const;
+
+    // whether the history after _iteration can be built from the chunks
+    bool HasChunksSince(model::IterationId _iteration) const;
+    void FillHistory(model::IterationId _iteration, api::GenericResponse *_response) const;
+
+    void HandleDownstream(std::unique_ptr<network_mock::MessageRecord> &&_message);
+    void HandleUpstream(network_mock::MessageRecord *_message);
+    void AnswerState(model::ClientId _client, model::IterationId _iteration);
+    void SendUpstream();
+    void DropChunks();
+};
+
+}
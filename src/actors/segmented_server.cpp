@@ -0,0 +1,452 @@
+#include "segmented_server.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <type_traits>
+#include <variant>
+
+using namespace home_task::actors;
+using namespace home_task::network_mock;
+using namespace home_task::api;
+using namespace home_task;
+
+namespace {
+
+// The cell an operation needs in the segment: the changed one or the one before the inserted one.
+model::CellId TargetCellId(const model::Operation &_operation) {
+    return std::visit([] <typename _Operation> (const _Operation &_record) -> model::CellId {
+        if constexpr (std::is_same_v<_Operation, model::UpdateValue>) {
+            return _record.Cell_.CellId_;
+        } else if constexpr (std::is_same_v<_Operation, model::DeleteValue>) {
+            return _record.CellId_;
+        } else {
+            return _record.NearCellId_;
+        }
+    }, _operation);
+}
+
+model::IterationId Sum(const std::vector<model::IterationId> &_version) {
+    model::IterationId sum = 0;
+    for (model::IterationId iteration : _version) {
+        sum += iteration;
+    }
+    return sum;
+}
+
+}
+
+SegmentedServerRunner::SegmentedServerRunner(std::unique_ptr<INetworkClient> &&_client, const model::CellVector &_cells, uint32_t _workerCount)
+    : Client_(std::move(_client))
+    , Pool_(_workerCount, [this] (Segment *_segment) { HandleSegment(_segment); })
+{
+    for (uint64_t begin = 0; begin < _cells.size() || Order_.empty(); begin += magic_numbers::SegmentCells) {
+        uint64_t end = std::min<uint64_t>(begin + magic_numbers::SegmentCells, _cells.size());
+        model::CellVector cells(_cells.begin() + std::min<uint64_t>(begin, end), _cells.begin() + end);
+        Order_.push_back(AddSegment(cells, Order_.empty()));
+    }
+    for (auto &cell : _cells) {
+        NextCellId_ = std::max(NextCellId_, cell.CellId_ + 1);
+    }
+}
+
+SegmentedServerRunner::Segment* SegmentedServerRunner::AddSegment(const model::CellVector &_cells, bool _first) {
+    auto segment = std::make_unique<Segment>();
+    segment->Id_ = NextSegmentId_++;
+    segment->First_ = _first;
+    segment->State_ = std::make_unique<logic::ServerState>(_cells);
+    segment->LiveCells_ = _cells.size();
+    for (auto &cell : _cells) {
+        if (Owners_.size() <= cell.CellId_) {
+            Owners_.resize(cell.CellId_ + 1, nullptr);
+            DeletedCells_.resize(cell.CellId_ + 1, false);
+        }
+        Owners_[cell.CellId_] = segment.get();
+    }
+    // clients know the cells of a new segment from the old ones, they start from its first iteration
+    for (auto &[client, version] : Versions_) {
+        segment->State_->MoveIterationForClient(client, 0);
+    }
+    Segment *result = segment.get();
+    Segments_[result->Id_] = std::move(segment);
+    return result;
+}
+
+void SegmentedServerRunner::HandleSegment(Segment *_segment) {
+    std::lock_guard<std::mutex> guard(_segment->StateMutex_);
+    std::vector<Operation> operations;
+    {
+        std::lock_guard<std::mutex> inboxGuard(_segment->Mutex_);
+        operations.swap(_segment->Inbox_);
+    }
+    Apply(_segment, operations);
+    _segment->State_->CutHistory();
+    _segment->LiveCells_ = _segment->State_->LiveCells_;
+}
+
+void SegmentedServerRunner::Apply(Segment *_segment, std::vector<Operation> &_operations) {
+    logic::ServerState &state = *_segment->State_;
+    auto bounce = [&] (Operation &&_operation) {
+        std::lock_guard<std::mutex> guard(BouncedMutex_);
+        Bounced_.push_back(Bounced{.From_ = _segment->Id_, .Operation_ = std::move(_operation)});
+    };
+    for (auto &operation : _operations) {
+        // the routing drops operations on deleted cells, a missing cell is a bounced one that isn't placed yet
+        if (!operation.Append_ && !state.FindState(TargetCellId(operation.Operation_))) {
+            bounce(std::move(operation));
+            continue;
+        }
+        std::visit([&] <typename _Operation> (const _Operation &_operation) {
+            if constexpr (std::is_same_v<_Operation, model::UpdateValue>) {
+                state.UpdateValue(UpdateValueRequest(_operation.Cell_.CellId_, _operation.Cell_.Value_, 0));
+            } else if constexpr (std::is_same_v<_Operation, model::DeleteValue>) {
+                state.DeleteValue(DeleteValueRequest(_operation.CellId_, 0));
+            } else if constexpr (std::is_same_v<_Operation, model::InsertValue>) {
+                logic::CellState *near = operation.Append_ ? state.Root_.FindNear() : state.FindState(_operation.NearCellId_);
+                // the history names the live cell before the inserted one, the root of a segment after the first
+                // isn't a cell of the array, so such an insertion belongs to the end of the previous segment
+                bool placed = _segment->First_
+                    || (near != &state.Root_ && (!near->Deleted_ || near->FindNear() != &state.Root_));
+                if (!placed) {
+                    bounce(Operation{
+                        .Operation_ = model::InsertValue{.NearCellId_ = 0, .Cell_ = _operation.Cell_},
+                        .Append_ = true});
+                    return;
+                }
+                state.NextCellId_ = _operation.Cell_.CellId_;
+                state.InsertValue(InsertValueRequest(near->CellId_, _operation.Cell_.Value_, 0));
+            }
+        }, operation.Operation_);
+    }
+}
+
+void SegmentedServerRunner::Drain(Segment *_segment) {
+    std::vector<Operation> operations;
+    {
+        std::lock_guard<std::mutex> guard(_segment->Mutex_);
+        operations.swap(_segment->Inbox_);
+    }
+    Apply(_segment, operations);
+}
+
+void SegmentedServerRunner::Deliver(Segment *_segment, Operation &&_operation) {
+    Pool_.Deliver(_segment, std::move(_operation));
+}
+
+model::IterationId SegmentedServerRunner::Version(model::ClientId _client) {
+    auto it = Versions_.find(_client);
+    return it == Versions_.end() ? 0 : Sum(it->second);
+}
+
+bool SegmentedServerRunner::RestoreVersion(model::ClientId _client, model::IterationId _sum) {
+    auto it = Versions_.find(_client);
+    if (it == Versions_.end()) {
+        return false;
+    }
+    if (Sum(it->second) == _sum) {
+        return true;
+    }
+    // the client saves the snapshot on a poison with the answer to its last request still on the way
+    auto previous = PreviousVersions_.find(_client);
+    if (previous == PreviousVersions_.end() || Sum(previous->second) != _sum) {
+        return false;
+    }
+    it->second = previous->second;
+    return true;
+}
+
+SegmentedServerRunner::Segment* SegmentedServerRunner::LiveSegment(SegmentId _id) {
+    for (auto it = MergedInto_.find(_id); it != MergedInto_.end(); it = MergedInto_.find(_id)) {
+        _id = it->second;
+    }
+    return Segments_.at(_id).get();
+}
+
+void SegmentedServerRunner::Collect(model::ClientId _client, GenericResponse *_response, model::CellVector *_cells, bool _ready) {
+    auto &version = Versions_[_client];
+    version.resize(NextSegmentId_, 0);
+    // the segments are moved only to this vector below, so they keep the history after it
+    PreviousVersions_[_client] = version;
+    std::unordered_map<SegmentId, model::CellVector> parts;
+    for (auto &[id, segment] : Segments_) {
+        std::unique_lock<std::mutex> lock(segment->StateMutex_, std::defer_lock);
+        if (!_ready) {
+            lock.lock();
+        } else if (!lock.try_lock()) {
+            // newer segments may hold cells moved from this one, their history can't go before its own
+            break;
+        }
+        logic::ServerState &state = *segment->State_;
+        state.MoveIterationForClient(_client, version[id]);
+        if (_response) {
+            state.GetNextHistory(_client, _response);
+        }
+        if (_cells && !segment->Retired_) {
+            parts[id] = std::move(state.LoadState().Cells_);
+        }
+        version[id] = state.Iteration_;
+    }
+    if (_cells) {
+        for (Segment *segment : Order_) {
+            auto &part = parts[segment->Id_];
+            _cells->insert(_cells->end(), part.begin(), part.end());
+        }
+    }
+}
+
+void SegmentedServerRunner::Route(model::ClientId _sender, MessageRecord *_message) {
+    auto owner = [&] (model::CellId _cellId) -> Segment* {
+        return _cellId < Owners_.size() && !DeletedCells_[_cellId] ? Owners_[_cellId] : nullptr;
+    };
+    std::visit([&] <typename _Record> (_Record &_record) {
+        if constexpr (std::is_same_v<_Record, UpdateValueRequest>) {
+            if (Segment *segment = owner(_record.CellId_)) {
+                Deliver(segment, Operation{.Operation_ = model::UpdateValue{.Cell_ = model::Cell(_record.CellId_, _record.Value_)}});
+            }
+            UpdateValueResponse response;
+            Collect(_sender, &response, nullptr, true);
+            response.Iteration_ = Version(_sender);
+            Client_->Send(_sender, MakeResponseMessage(std::move(response)));
+        } else if constexpr (std::is_same_v<_Record, InsertValueRequest>) {
+            // an unknown or deleted near cell is rejected before the answer, as ServerState does
+            Segment *segment = _record.NearCellId_ ? owner(_record.NearCellId_) : Order_.front();
+            model::CellId cellId = 0;
+            if (segment) {
+                cellId = NextCellId_++;
+                Owners_.resize(NextCellId_, nullptr);
+                DeletedCells_.resize(NextCellId_, false);
+                Owners_[cellId] = segment;
+                Deliver(segment, Operation{.Operation_ = model::InsertValue{
+                        .NearCellId_ = _record.NearCellId_,
+                        .Cell_ = model::Cell(cellId, _record.Value_)}});
+            }
+            InsertValueResponse response(cellId);
+            Collect(_sender, &response, nullptr, true);
+            response.Iteration_ = Version(_sender);
+            Client_->Send(_sender, MakeResponseMessage(std::move(response)));
+        } else if constexpr (std::is_same_v<_Record, DeleteValueRequest>) {
+            if (Segment *segment = owner(_record.CellId_)) {
+                DeletedCells_[_record.CellId_] = true;
+                Deliver(segment, Operation{.Operation_ = model::DeleteValue{.CellId_ = _record.CellId_}});
+            }
+            DeleteValueResponse response;
+            Collect(_sender, &response, nullptr, true);
+            response.Iteration_ = Version(_sender);
+            Client_->Send(_sender, MakeResponseMessage(std::move(response)));
+        } else if constexpr (std::is_same_v<_Record, SyncRequest>) {
+            SyncResponse response;
+            Collect(_sender, &response, nullptr);
+            response.Iteration_ = Version(_sender);
+            Client_->Send(_sender, MakeResponseMessage(std::move(response)));
+        } else if constexpr (std::is_same_v<_Record, LoadStateRequest> || std::is_same_v<_Record, ResumeRequest>) {
+            if constexpr (std::is_same_v<_Record, ResumeRequest>) {
+                if (_record.Epoch_ == Epoch_ && RestoreVersion(_sender, _record.PreviousIteration_)) {
+                    SyncResponse response;
+                    Collect(_sender, &response, nullptr);
+                    response.Iteration_ = Version(_sender);
+                    Client_->Send(_sender, MakeResponseMessage(std::move(response)));
+                    return;
+                }
+            }
+            // the iteration of an older snapshot is a sum, the versions of the segments can't be restored from it
+            State state({});
+            Collect(_sender, magic_numbers::WithStateChecking ? &state : nullptr, &state.Cells_);
+            state.Iteration_ = Version(_sender);
+            state.Epoch_ = Epoch_;
+            Client_->Send(_sender, MakeResponseMessage(std::move(state)));
+        }
+    }, _message->Record_);
+}
+
+void SegmentedServerRunner::RouteBounced() {
+    std::vector<Bounced> bounced;
+    {
+        std::lock_guard<std::mutex> guard(BouncedMutex_);
+        bounced.swap(Bounced_);
+    }
+    for (auto &bounce : bounced) {
+        Operation &operation = bounce.Operation_;
+        Segment *segment = nullptr;
+        if (operation.Append_) {
+            // the insertion goes before the cells of its segment, they are held by the segment it was merged into,
+            // the insertions of a segment merged after another one are placed by the merge
+            auto it = std::find(Order_.begin(), Order_.end(), LiveSegment(bounce.From_));
+            if (it == Order_.begin()) {
+                operation.Append_ = false;
+                segment = *it;
+            } else {
+                segment = *std::prev(it);
+            }
+        } else {
+            model::CellId cellId = TargetCellId(operation.Operation_);
+            segment = cellId < Owners_.size() ? Owners_[cellId] : nullptr;
+            if (!segment && std::holds_alternative<model::InsertValue>(operation.Operation_)) {
+                // the cell before it is deleted and gone with a merge, the insertion isn't lost at least
+                log::WriteServerRunner("SegmentedServerRunner::RouteBounced{near cell is gone, cellId# ", cellId, '}');
+                std::get<model::InsertValue>(operation.Operation_).NearCellId_ = 0;
+                segment = Order_.front();
+            }
+        }
+        BouncedOperations_++;
+        if (!segment) {
+            // a change of a cell deleted and gone with a merge
+            continue;
+        }
+        if (auto *insertion = std::get_if<model::InsertValue>(&operation.Operation_)) {
+            Owners_[insertion->Cell_.CellId_] = segment;
+        }
+        Deliver(segment, std::move(operation));
+    }
+}
+
+void SegmentedServerRunner::Split(uint32_t _position) {
+    Segment *source = Order_[_position];
+    model::CellVector tail;
+    {
+        std::lock_guard<std::mutex> guard(source->StateMutex_);
+        Drain(source);
+        model::CellVector cells = std::move(source->State_->LoadState().Cells_);
+        tail.assign(cells.begin() + cells.size() / 2, cells.end());
+        for (auto &cell : tail) {
+            source->State_->Detach(cell.CellId_);
+        }
+        source->State_->CutHistory();
+        source->LiveCells_ = source->State_->LiveCells_;
+    }
+    log::WriteServerRunner("SegmentedServerRunner::Split{segment=", source->Id_, ", moved ", tail.size(), " cells}");
+    Order_.insert(Order_.begin() + _position + 1, AddSegment(tail, false));
+    Splits_++;
+}
+
+void SegmentedServerRunner::Merge(uint32_t _position) {
+    Segment *left = Order_[_position];
+    Segment *right = Order_[_position + 1];
+    model::CellVector cells;
+    model::CellId leftLast = 0;
+    for (Segment *segment : {left, right}) {
+        std::lock_guard<std::mutex> guard(segment->StateMutex_);
+        Drain(segment);
+        auto part = std::move(segment->State_->LoadState().Cells_);
+        if (segment == left && !part.empty()) {
+            leftLast = part.back().CellId_;
+        }
+        cells.insert(cells.end(), part.begin(), part.end());
+        segment->Retired_ = true;
+        // deleted cells stay behind, requests to them are dropped from now on
+        for (auto &[cellId, cell] : segment->State_->States_) {
+            if (cellId && Owners_[cellId] == segment) {
+                Owners_[cellId] = nullptr;
+            }
+        }
+    }
+    log::WriteServerRunner("SegmentedServerRunner::Merge{segments=", left->Id_, ' ', right->Id_, ", cells ", cells.size(), '}');
+    Segment *merged = AddSegment(cells, left->First_);
+    Order_[_position] = merged;
+    Order_.erase(Order_.begin() + _position + 1);
+
+    // Insertions bounced from the right segment belong between the cells of the two, they go after
+    // the last cell of the left one in the order they came. Bounced cells of both now belong to the merged one.
+    std::vector<Operation> boundary;
+    {
+        std::lock_guard<std::mutex> guard(BouncedMutex_);
+        model::CellId near = leftLast;
+        std::erase_if(Bounced_, [&] (Bounced &_bounce) {
+            auto *insertion = std::get_if<model::InsertValue>(&_bounce.Operation_.Operation_);
+            if (!insertion) {
+                return false;
+            }
+            model::CellId cellId = insertion->Cell_.CellId_;
+            if (Owners_[cellId] == left || Owners_[cellId] == right) {
+                Owners_[cellId] = merged;
+            }
+            if (!_bounce.Operation_.Append_ || LiveSegment(_bounce.From_) != right) {
+                return false;
+            }
+            boundary.push_back(Operation{.Operation_ = model::InsertValue{.NearCellId_ = near, .Cell_ = insertion->Cell_}});
+            near = cellId;
+            return true;
+        });
+    }
+    MergedInto_[left->Id_] = merged->Id_;
+    MergedInto_[right->Id_] = merged->Id_;
+    for (auto &operation : boundary) {
+        Deliver(merged, std::move(operation));
+    }
+    Merges_++;
+}
+
+void SegmentedServerRunner::DropRetired() {
+    for (auto it = Segments_.begin(); it != Segments_.end();) {
+        Segment &segment = *it->second;
+        if (segment.Retired_) {
+            bool cut = false;
+            {
+                std::lock_guard<std::mutex> guard(segment.StateMutex_);
+                segment.State_->CutHistory();
+                cut = segment.State_->LastCutIteration_ == segment.State_->Iteration_;
+            }
+            std::lock_guard<std::mutex> guard(segment.Mutex_);
+            if (cut && !segment.Scheduled_) {
+                it = Segments_.erase(it);
+                continue;
+            }
+        }
+        ++it;
+    }
+}
+
+void SegmentedServerRunner::Rebalance() {
+    for (uint32_t position = 0; position < Order_.size(); ++position) {
+        if (Order_[position]->LiveCells_ > 2 * magic_numbers::SegmentCells) {
+            Split(position);
+        }
+    }
+    for (uint32_t position = 0; position + 1 < Order_.size();) {
+        if (Order_[position]->LiveCells_ + Order_[position + 1]->LiveCells_ < magic_numbers::SegmentCells / 2) {
+            Merge(position);
+        } else {
+            position++;
+        }
+    }
+    DropRetired();
+}
+
+void SegmentedServerRunner::Run() {
+    log::WriteServerRunner("SegmentedServerRunner::Run{segments=", Order_.size(), ", workers=", Pool_.Workers_.size(), '}');
+    Pool_.Start();
+    std::vector<std::unique_ptr<MessageRecord>> messages;
+    for (bool poisoned = false; !poisoned;) {
+        messages.clear();
+        Client_->ReceiveAllWithWaiting(&messages);
+        for (auto &message : messages) {
+            if (message->Type_ == static_cast<uint32_t>(EMessageType::Poison)) {
+                log::WriteServerRunner("SegmentedServerRunner::Run{Poisoned}");
+                poisoned = true;
+                break;
+            }
+            Route(message->Sender_, message.get());
+        }
+        RouteBounced();
+        Rebalance();
+    }
+    Pool_.Stop();
+}
+
+std::string SegmentedServerRunner::PrintStat() const {
+    std::ostringstream sout;
+    uint64_t cells = 0;
+    for (Segment *segment : Order_) {
+        cells += segment->LiveCells_;
+    }
+    sout << "Segments# " << Order_.size()
+        << " Retired# " << Segments_.size() - Order_.size()
+        << " Cells# " << cells
+        << " Splits# " << Splits_
+        << " Merges# " << Merges_
+        << " BouncedOperations# " << BouncedOperations_ << std::endl;
+    for (uint32_t idx = 0; idx < Pool_.Workers_.size(); ++idx) {
+        sout << " Worker# " << idx
+            << " Batches# " << Pool_.Workers_[idx]->Batches_
+            << " Stolen# " << Pool_.Workers_[idx]->Stolen_ << std::endl;
+    }
+    return sout.str();
+}
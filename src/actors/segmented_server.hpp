@@ -0,0 +1,134 @@
+#pragma once
+
+#include "worker_pool.hpp"
+
+#include <core/network_mock.hpp>
+#include <core/api.hpp>
+#include <core/log.hpp>
+#include <logic/server_state.hpp>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace home_task::actors {
+
+// Server of one array cut into segments of neighbouring cells, every segment is a ServerState
+// with its own history and iteration, so mutations of different segments are applied by different workers.
+// The receiving thread owns the routing: it gives ids to new cells, knows the segment of every cell,
+// queues mutations to the segments and answers them at once. Reads are answered by the receiving thread too,
+// it takes the segments one by one, so every segment gives a consistent part of the answer.
+// An answer to a mutation carries the history of the segments in the order of creation up to the first one
+// a worker holds, so it doesn't wait for the workers. It isn't read-your-writes: the mutation comes
+// to the client with a later answer after a worker applies it.
+// The version of a client is a vector of the iterations it got from every segment, the server keeps it,
+// the client sees only the sum of the vector as its iteration. A snapshot of one of the last two answers
+// resumes with the history: components never go back, so an equal sum means the same vector.
+// A grown segment is split: its tail goes to a new segment. Small neighbours are merged into a new segment.
+// Segments are numbered in the order of creation and cells only move to newer segments, so the histories
+// put together in this order keep the order of operations on every cell.
+// The source segments keep the history before the move until all clients get it.
+struct SegmentedServerRunner {
+    using SegmentId = uint32_t;
+
+    struct Operation {
+        model::Operation Operation_;
+        // the insertion goes after the last live cell of the segment, the next segment had no live cell before it
+        bool Append_ = false;
+    };
+
+    struct Segment {
+        SegmentId Id_ = 0;
+        // the segment holds the beginning of the array
+        bool First_ = false;
+        bool Retired_ = false;
+        std::unique_ptr<logic::ServerState> State_;
+        // taken by the worker for the whole batch and by the receiving thread for reads, splits and merges
+        std::mutex StateMutex_;
+        std::mutex Mutex_;
+        std::vector<Operation> Inbox_;
+        // the segment is in a worker queue or is being handled
+        bool Scheduled_ = false;
+        std::atomic<uint64_t> LiveCells_ = 0;
+    };
+
+    // An operation a segment couldn't apply: an insertion with no live cell before it in the segment,
+    // or an operation on a cell that is bounced itself and isn't placed yet.
+    struct Bounced {
+        SegmentId From_ = 0;
+        Operation Operation_;
+    };
+
+    std::unique_ptr<network_mock::INetworkClient> Client_;
+    // in the order of creation, retired segments stay here until their history is cut
+    std::map<SegmentId, std::unique_ptr<Segment>> Segments_;
+    // live segments in the order of the array
+    std::vector<Segment*> Order_;
+    // the segment of every cell by its id, a bounced cell belongs to the segment that gets it next
+    std::vector<Segment*> Owners_;
+    // deletions of these cells are routed, operations near them or on them are dropped
+    std::vector<bool> DeletedCells_;
+    // the segment a merged one went to
+    std::unordered_map<SegmentId, SegmentId> MergedInto_;
+    // the iteration every client got from every segment by the id of the segment
+    std::unordered_map<model::ClientId, std::vector<model::IterationId>> Versions_;
+    // the vector before the last answer, the segments keep the history after it
+    std::unordered_map<model::ClientId, std::vector<model::IterationId>> PreviousVersions_;
+    SegmentId NextSegmentId_ = 0;
+    model::CellId NextCellId_ = 1;
+    model::EpochId Epoch_ = api::NewEpoch();
+
+    // operations segments couldn't apply, the receiving thread routes them again by position
+    std::mutex BouncedMutex_;
+    std::vector<Bounced> Bounced_;
+
+    WorkerPool<Segment> Pool_;
+
+    uint64_t Splits_ = 0;
+    uint64_t Merges_ = 0;
+    uint64_t BouncedOperations_ = 0;
+
+    SegmentedServerRunner(std::unique_ptr<network_mock::INetworkClient> &&_client, const model::CellVector &_cells, uint32_t _workerCount);
+
+    SegmentedServerRunner(network_mock::NetworkClient &&_client, const model::CellVector &_cells, uint32_t _workerCount)
+        : SegmentedServerRunner(std::make_unique<network_mock::NetworkClient>(std::move(_client)), _cells, _workerCount)
+    {}
+
+    ~SegmentedServerRunner() {
+        log::WriteDestructor("~SegmentedServerRunner");
+    }
+
+    // Receives messages until poisoned, workers live inside.
+    void Run();
+    std::string PrintStat() const;
+
+    Segment* AddSegment(const model::CellVector &_cells, bool _first);
+    void HandleSegment(Segment *_segment);
+    // The caller holds the state mutex of the segment.
+    void Apply(Segment *_segment, std::vector<Operation> &_operations);
+    void Drain(Segment *_segment);
+
+    void Route(model::ClientId _sender, network_mock::MessageRecord *_message);
+    void RouteBounced();
+    void Deliver(Segment *_segment, Operation &&_operation);
+    // The live segment holding the cells of the segment with the id, merged segments are followed.
+    Segment* LiveSegment(SegmentId _id);
+    // A sum of the vector of the client, segments dropped after a merge keep their terms, so it never goes back.
+    model::IterationId Version(model::ClientId _client);
+    // Makes the kept vector of the client with the sum current, false if there is no such vector.
+    bool RestoreVersion(model::ClientId _client, model::IterationId _sum);
+    // Puts the history of every segment after the version of the client, with cells when they are given.
+    // With _ready it stops at the first segment a worker holds instead of waiting, cells aren't collected then.
+    void Collect(model::ClientId _client, api::GenericResponse *_response, model::CellVector *_cells, bool _ready = false);
+
+    void Rebalance();
+    void Split(uint32_t _position);
+    void Merge(uint32_t _position);
+    void DropRetired();
+};
+
+}
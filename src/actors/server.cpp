@@ -1,8 +1,11 @@
 #include "server.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <iostream>
+#include <type_traits>
+#include <variant>
 
 using namespace home_task::actors;
 using namespace home_task::network_mock;
@@ -10,95 +13,259 @@ using namespace home_task::api;
 
 
 
-void ServerRunner::UpdateValue(UpdateValueRequest *_request, uint64_t _sender) {
+template <typename _ServerState>
+template <typename _Request>
+void BasicServerRunner<_ServerState>::Forward(_Request *_request, uint64_t _sender) {
+    Forwarded_.emplace_back(_sender, _request->PreviousIteration_);
+    Client_->Send(*Primary_, MakeRequestMessage(std::move(*_request)));
+}
+
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::HandlePrimary(MessageRecord *_message) {
+    std::visit([&] <typename _Record> (_Record &_record) {
+        if constexpr (std::is_same_v<_Record, SyncResponse>) {
+            State_->ApplyReplicatedHistory(_record);
+        } else if constexpr (std::is_same_v<_Record, UpdateValueResponse>
+                || std::is_same_v<_Record, InsertValueResponse>
+                || std::is_same_v<_Record, DeleteValueResponse>) {
+            auto [client, iteration] = Forwarded_.front();
+            Forwarded_.pop_front();
+            State_->MoveIterationForClient(client, iteration);
+            State_->GetNextHistory(client, &_record);
+            _record.Iteration_ = State_->GetIteration();
+            Client_->Send(client, MakeResponseMessage(std::move(_record)));
+        }
+    }, _message->Record_);
+}
+
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::PushHistory() {
+    model::IterationId current = State_->GetIteration();
+    for (auto &[replica, iteration] : Replicas_) {
+        if (iteration == current) {
+            continue;
+        }
+        api::SyncResponse response;
+        State_->GetNextHistory(replica, &response);
+        response.Iteration_ = current;
+        iteration = current;
+        State_->MoveIterationForClient(replica, current);
+        Client_->Send(replica, MakeResponseMessage(std::move(response)));
+    }
+}
+
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::PushSubscribers() {
+    model::IterationId current = State_->GetIteration();
+    for (auto &subscriber : Subscribers_) {
+        // a full window gathers the changes into the push after the next acknowledgement
+        if (subscriber.Iteration_ == current || subscriber.InFlight_ >= subscriber.Window_) {
+            continue;
+        }
+        api::PushResponse response;
+        State_->GetNextHistory(subscriber.Id_, &response);
+        response.Iteration_ = current;
+        State_->MoveIterationForClient(subscriber.Id_, current);
+        subscriber.Iteration_ = current;
+        subscriber.InFlight_++;
+        Client_->Send(subscriber.Id_, MakeResponseMessage(std::move(response)));
+    }
+}
+
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::UpdateValue(UpdateValueRequest *_request, uint64_t _sender) {
+    if (Primary_) {
+        Forward(_request, _sender);
+        return;
+    }
     auto response = State_->UpdateValue(*_request);
-    if (!magic_numbers::WithDelayedHistory || !Counter_) {
+    // a replica sends the history to its client itself
+    if (!IsReplica(_sender) && (!magic_numbers::WithDelayedHistory || !Counter_)) {
         State_->MoveIterationForClient(_sender, _request->PreviousIteration_);
         State_->GetNextHistory(_sender, &response);
         response.Iteration_ = State_->GetIteration();
     } else {
         response.Iteration_ = _request->PreviousIteration_;
     }
-    Client_.Send(_sender, MakeResponseMessage(std::move(response)));
+    Client_->Send(_sender, MakeResponseMessage(std::move(response)));
 }
 
-void ServerRunner::InsertValue(InsertValueRequest *_request, uint64_t _sender) {
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::InsertValue(InsertValueRequest *_request, uint64_t _sender) {
+    if (Primary_) {
+        Forward(_request, _sender);
+        return;
+    }
     auto response = State_->InsertValue(*_request);
-    if (!magic_numbers::WithDelayedHistory || !Counter_) {
+    if (!IsReplica(_sender) && (!magic_numbers::WithDelayedHistory || !Counter_)) {
         State_->MoveIterationForClient(_sender, _request->PreviousIteration_);
         State_->GetNextHistory(_sender, &response);
         response.Iteration_ = State_->GetIteration();
     } else {
         response.Iteration_ = _request->PreviousIteration_;
     }
-    Client_.Send(_sender, MakeResponseMessage(std::move(response)));
+    Client_->Send(_sender, MakeResponseMessage(std::move(response)));
 }
 
-void ServerRunner::DeleteValue(DeleteValueRequest *_request, uint64_t _sender) {
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::DeleteValue(DeleteValueRequest *_request, uint64_t _sender) {
+    if (Primary_) {
+        Forward(_request, _sender);
+        return;
+    }
     auto response = State_->DeleteValue(*_request);
-    if (!magic_numbers::WithDelayedHistory || !Counter_) {
+    if (!IsReplica(_sender) && (!magic_numbers::WithDelayedHistory || !Counter_)) {
         State_->MoveIterationForClient(_sender, _request->PreviousIteration_);
         State_->GetNextHistory(_sender, &response);
         response.Iteration_ = State_->GetIteration();
     } else {
         response.Iteration_ = _request->PreviousIteration_;
     }
-    Client_.Send(_sender, MakeResponseMessage(std::move(response)));
+    Client_->Send(_sender, MakeResponseMessage(std::move(response)));
 }
 
-void ServerRunner::LoadState(LoadStateRequest *_request, uint64_t _sender) {
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::LoadState(LoadStateRequest *_request, uint64_t _sender) {
     State_->MoveIterationForClient(_sender, _request->PreviousIteration_);
     auto state = State_->LoadState();
     if (magic_numbers::WithStateChecking) {
         State_->GetNextHistory(_sender, &state);;
     }
     state.Iteration_ = State_->GetIteration();
-    Client_.Send(_sender, MakeResponseMessage(std::move(state)));
+    state.Epoch_ = Epoch_;
+    Client_->Send(_sender, MakeResponseMessage(std::move(state)));
 }
 
-void ServerRunner::Sync(SyncRequest *_request, uint64_t _sender) {
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::Sync(SyncRequest *_request, uint64_t _sender) {
     State_->MoveIterationForClient(_sender, _request->PreviousIteration_);
     api::SyncResponse response;
     State_->GetNextHistory(_sender, &response);
     response.Iteration_ = State_->GetIteration();
-    Client_.Send(_sender, MakeResponseMessage(std::move(response)));
+    Client_->Send(_sender, MakeResponseMessage(std::move(response)));
 }
 
-void ServerRunner::Run() {
-    log::WriteServerRunner("ServerRunner::Run");
-    for (;;) {
-        auto startReceiving = std::chrono::steady_clock::now();
-        auto message = Client_.ReceiveWithWaiting();
-        std::chrono::duration<double> durationOfReceiving = std::chrono::steady_clock::now() - startReceiving;
-        log::WriteServerRunner("ServerRunner::Run{Wait message ", durationOfReceiving.count(), "s}");
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::Resume(ResumeRequest *_request, uint64_t _sender) {
+    // the iterations of another array say nothing about this one, the client gets the state as a new one
+    if (_request->Epoch_ != Epoch_) {
+        log::WriteServerRunner("ServerRunner::Resume{id=", _sender, ", iteration=", _request->PreviousIteration_, ", snapshot of another array}");
+        LoadStateRequest request(0);
+        LoadState(&request, _sender);
+        return;
+    }
+    if (!State_->HasHistorySince(_request->PreviousIteration_)) {
+        log::WriteServerRunner("ServerRunner::Resume{id=", _sender, ", iteration=", _request->PreviousIteration_, ", history is cut}");
+        LoadStateRequest request(_request->PreviousIteration_);
+        LoadState(&request, _sender);
+        return;
+    }
+    State_->MoveIterationForClient(_sender, _request->PreviousIteration_);
+    api::SyncResponse response;
+    State_->GetNextHistory(_sender, &response);
+    response.Iteration_ = State_->GetIteration();
+    Client_->Send(_sender, MakeResponseMessage(std::move(response)));
+}
+
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::Subscribe(SubscribeRequest *_request, uint64_t _sender) {
+    log::WriteServerRunner("ServerRunner::Subscribe{id=", _sender, ", iteration=", _request->PreviousIteration_, ", window=", _request->Window_, '}');
+    State_->MoveIterationForClient(_sender, _request->PreviousIteration_);
+    Subscriber subscriber{
+        .Id_ = static_cast<model::ClientId>(_sender),
+        .Iteration_ = _request->PreviousIteration_,
+        .Window_ = std::max<uint32_t>(_request->Window_, 1),
+    };
+    for (auto &other : Subscribers_) {
+        if (other.Id_ == _sender) {
+            other = subscriber;
+            return;
+        }
+    }
+    Subscribers_.push_back(subscriber);
+}
+
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::PushAck(PushAckRequest *, uint64_t _sender) {
+    for (auto &subscriber : Subscribers_) {
+        if (subscriber.Id_ == _sender && subscriber.InFlight_) {
+            subscriber.InFlight_--;
+        }
+    }
+}
+
+template <typename _ServerState>
+bool BasicServerRunner<_ServerState>::HandleBatch(std::vector<std::unique_ptr<MessageRecord>> &_messages) {
+    for (auto &message : _messages) {
         if (message->Type_ == static_cast<uint32_t>(EMessageType::Poison)) {
             log::WriteServerRunner("ServerRunner::Run{Poisoned}");
-            break;
+            return false;
         }
-        Counter_++;
-        auto startProcessing = std::chrono::steady_clock::now();
-        switch (message->Type_) {
-        case (uint32_t)EAPIEventsType::UpdateValueRequest:
-            UpdateValue(std::any_cast<UpdateValueRequest>(&message->Record_), message->Sender_);
-            break;
-        case (uint32_t)EAPIEventsType::InsertValueRequest:
-            InsertValue(std::any_cast<InsertValueRequest>(&message->Record_), message->Sender_);
-            break;
-        case (uint32_t)EAPIEventsType::DeleteValueRequest:
-            DeleteValue(std::any_cast<DeleteValueRequest>(&message->Record_), message->Sender_);
-            break;
-        case (uint32_t)EAPIEventsType::SyncRequest:
-            Sync(std::any_cast<SyncRequest>(&message->Record_), message->Sender_);
-            break;
-        case (uint32_t)EAPIEventsType::LoadStateRequest:
-            LoadState(std::any_cast<LoadStateRequest>(&message->Record_), message->Sender_);
-            break;
+        if (Primary_ && message->Sender_ == *Primary_) {
+            HandlePrimary(message.get());
+            continue;
         }
-        std::chrono::duration<double> durationOfProcessing = std::chrono::steady_clock::now() - startProcessing;
-        log::WriteServerRunner("ServerRunner::Run{Processing message ", durationOfReceiving.count(), "s}");
-        State_->CutHistory();
+        Counter_++;
+        log::Stopwatch<log::ServerRunnerLogger> processing;
+        // the response is sent inside, so it joins the trace of the request
+        log::SpanScope span("process", magic_numbers::ServerId, message->TraceId_, message->Sender_, message->Type_);
+        std::visit([&] <typename _Record> (_Record &_record) {
+            if constexpr (std::is_same_v<_Record, UpdateValueRequest>) {
+                UpdateValue(&_record, message->Sender_);
+            } else if constexpr (std::is_same_v<_Record, InsertValueRequest>) {
+                InsertValue(&_record, message->Sender_);
+            } else if constexpr (std::is_same_v<_Record, DeleteValueRequest>) {
+                DeleteValue(&_record, message->Sender_);
+            } else if constexpr (std::is_same_v<_Record, SyncRequest>) {
+                Sync(&_record, message->Sender_);
+            } else if constexpr (std::is_same_v<_Record, LoadStateRequest>) {
+                LoadState(&_record, message->Sender_);
+            } else if constexpr (std::is_same_v<_Record, ResumeRequest>) {
+                Resume(&_record, message->Sender_);
+            } else if constexpr (std::is_same_v<_Record, SubscribeRequest>) {
+                Subscribe(&_record, message->Sender_);
+            } else if constexpr (std::is_same_v<_Record, PushAckRequest>) {
+                PushAck(&_record, message->Sender_);
+            }
+        }, message->Record_);
+        span.SetIteration(State_->GetIteration());
+        log::WriteServerRunner("ServerRunner::Run{Processing message ", [&] { return processing.Elapsed(); }, "s}");
         if (Counter_ == 10) {
             Counter_ = 0;
         }
     }
+    if (!Replicas_.empty()) {
+        PushHistory();
+    }
+    if (!Subscribers_.empty()) {
+        PushSubscribers();
+    }
+    // history is cut once per batch, every message of the batch has already moved its client
+    log::SpanScope span("CutHistory", magic_numbers::ServerId);
+    State_->CutHistory();
+    span.SetIteration(State_->GetIteration());
+    return true;
+}
+
+template <typename _ServerState>
+void BasicServerRunner<_ServerState>::Run() {
+    log::WriteServerRunner("ServerRunner::Run");
+    std::vector<std::unique_ptr<MessageRecord>> messages;
+    for (;;) {
+        log::Stopwatch<log::ServerRunnerLogger> receiving;
+        messages.clear();
+        Client_->ReceiveAllWithWaiting(&messages);
+        log::WriteServerRunner("ServerRunner::Run{Wait messages ", [&] { return receiving.Elapsed(); }, "s, batch ", messages.size(), '}');
+        if (!HandleBatch(messages)) {
+            return;
+        }
+    }
+}
+
+namespace home_task::actors {
+
+template struct BasicServerRunner<logic::IServerState>;
+template struct BasicServerRunner<logic::ServerStateNop>;
+template struct BasicServerRunner<logic::ServerState>;
+
 }
@@ -5,31 +5,99 @@
 #include <core/log.hpp>
 #include <logic/server_state.hpp>
 
+#include <deque>
 #include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
 
 
 namespace home_task::actors {
 
-struct ServerRunner {
-    network_mock::NetworkClient Client_;
-    std::unique_ptr<logic::IServerState> State_;
+// Runner of the server actor.
+// Templated on the state so that a concrete (final) state is called without virtual calls,
+// ServerRunner keeps working with any IServerState.
+// The primary pushes its history after every batch to its replicas. A replica answers reads from its own state
+// and forwards mutations to the primary, the answers of the primary go back to the clients with the replica's history.
+// Subscribed clients get the history pushed after every batch that changed the array, each with its own window
+// of unacknowledged pushes; a subscriber only reads, its requests would move its iteration back.
+template <typename _ServerState>
+struct BasicServerRunner {
+    std::unique_ptr<network_mock::INetworkClient> Client_;
+    std::unique_ptr<_ServerState> State_;
     uint32_t Counter_ = 0;
+    // states sent to clients carry it, a snapshot of another epoch can't be resumed with the history
+    model::EpochId Epoch_ = api::NewEpoch();
 
-    ServerRunner(network_mock::NetworkClient &&_client, std::unique_ptr<logic::IServerState> &&_state)
+    // replicas of the primary and the iteration pushed to each of them
+    std::vector<std::pair<model::ClientId, model::IterationId>> Replicas_;
+    // set on a replica
+    std::optional<model::ClientId> Primary_;
+    // clients waiting for answers of the primary in the order of forwarding and their iterations
+    std::deque<std::pair<model::ClientId, model::IterationId>> Forwarded_;
+
+    struct Subscriber {
+        model::ClientId Id_;
+        // the last pushed iteration
+        model::IterationId Iteration_;
+        uint32_t Window_;
+        uint32_t InFlight_ = 0;
+    };
+    std::vector<Subscriber> Subscribers_;
+
+    BasicServerRunner(std::unique_ptr<network_mock::INetworkClient> &&_client, std::unique_ptr<_ServerState> &&_state)
         : Client_(std::move(_client))
         , State_(std::move(_state))
     {}
 
-    ~ServerRunner() {
+    BasicServerRunner(network_mock::NetworkClient &&_client, std::unique_ptr<_ServerState> &&_state)
+        : BasicServerRunner(std::make_unique<network_mock::NetworkClient>(std::move(_client)), std::move(_state))
+    {}
+
+    ~BasicServerRunner() {
         log::WriteDestructor("~ServerRunner");
     }
 
+    // Both states must be built from the same cells and the replica must be added before the primary runs.
+    void AddReplica(model::ClientId _replica) {
+        Replicas_.emplace_back(_replica, State_->GetIteration());
+        State_->MoveIterationForClient(_replica, State_->GetIteration());
+    }
+
+    // The replica serves the array of the primary, so its states carry the epoch of the primary.
+    void EnableReplica(model::ClientId _primary, model::EpochId _epoch) {
+        Primary_ = _primary;
+        Epoch_ = _epoch;
+    }
+
+    bool IsReplica(model::ClientId _id) const {
+        for (auto &[replica, iteration] : Replicas_) {
+            if (replica == _id) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename _Request>
+    void Forward(_Request *_request, uint64_t _sender);
+    void HandlePrimary(network_mock::MessageRecord *_message);
+    void PushHistory();
+    void PushSubscribers();
+
     void UpdateValue(api::UpdateValueRequest *_request, uint64_t _sender);
     void InsertValue(api::InsertValueRequest *_request, uint64_t _sender);
     void DeleteValue(api::DeleteValueRequest *_request, uint64_t _sender);
     void Sync(api::SyncRequest *_request, uint64_t _sender);
     void LoadState(api::LoadStateRequest *_request, uint64_t _sender);
+    void Resume(api::ResumeRequest *_request, uint64_t _sender);
+    void Subscribe(api::SubscribeRequest *_request, uint64_t _sender);
+    void PushAck(api::PushAckRequest *_request, uint64_t _sender);
+    // Handles received messages, returns false when poisoned.
+    bool HandleBatch(std::vector<std::unique_ptr<network_mock::MessageRecord>> &_messages);
     void Run();
 };
 
+using ServerRunner = BasicServerRunner<logic::IServerState>;
+
 }
\ No newline at end of file
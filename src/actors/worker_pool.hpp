@@ -0,0 +1,142 @@
+#pragma once
+
+#include <core/log.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace home_task::actors {
+
+// Fixed pool of workers over units of work (arrays, segments).
+// A unit keeps its work in Inbox_ under Mutex_, a unit with work is put to a worker queue once (Scheduled_),
+// so a unit is handled by one worker at a time. The handler takes the inbox of the unit by itself.
+// Idle workers steal ready units from the back of the other queues.
+template <typename _Unit>
+struct WorkerPool {
+    struct Worker {
+        std::mutex Mutex_;
+        std::deque<_Unit*> Queue_;
+        std::atomic<uint64_t> Batches_ = 0;
+        std::atomic<uint64_t> Stolen_ = 0;
+    };
+
+    std::vector<std::unique_ptr<Worker>> Workers_;
+    std::function<void(_Unit*)> Handle_;
+    std::vector<std::thread> Threads_;
+    uint32_t NextWorker_ = 0;
+
+    // units in all worker queues
+    std::atomic<uint32_t> Ready_ = 0;
+    std::atomic<bool> Stopped_ = false;
+    std::mutex SleepMutex_;
+    std::condition_variable Wakeup_;
+
+    WorkerPool(uint32_t _workerCount, std::function<void(_Unit*)> _handle)
+        : Handle_(std::move(_handle))
+    {
+        for (uint32_t idx = 0; idx < _workerCount; ++idx) {
+            Workers_.push_back(std::make_unique<Worker>());
+        }
+    }
+
+    void Start() {
+        for (uint32_t idx = 0; idx < Workers_.size(); ++idx) {
+            Threads_.emplace_back(&WorkerPool::Work, this, idx);
+        }
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> guard(SleepMutex_);
+            Stopped_ = true;
+        }
+        Wakeup_.notify_all();
+        for (auto &thread : Threads_) {
+            thread.join();
+        }
+        Threads_.clear();
+    }
+
+    template <typename _Item>
+    void Deliver(_Unit *_unit, _Item &&_item) {
+        std::lock_guard<std::mutex> guard(_unit->Mutex_);
+        _unit->Inbox_.push_back(std::forward<_Item>(_item));
+        ScheduleLocked(_unit);
+    }
+
+    // The caller holds the mutex of the unit.
+    void ScheduleLocked(_Unit *_unit) {
+        if (!_unit->Scheduled_ && !_unit->Inbox_.empty()) {
+            _unit->Scheduled_ = true;
+            Schedule(_unit, NextWorker_++ % Workers_.size());
+        }
+    }
+
+    void Schedule(_Unit *_unit, uint32_t _worker) {
+        {
+            // counted before the unit is seen in the queue, so Take can't decrement first and wrap Ready_
+            std::lock_guard<std::mutex> guard(Workers_[_worker]->Mutex_);
+            Ready_++;
+            Workers_[_worker]->Queue_.push_back(_unit);
+        }
+        {
+            // a worker checks Ready_ under the mutex before sleeping, so it can't miss the notification
+            std::lock_guard<std::mutex> guard(SleepMutex_);
+        }
+        Wakeup_.notify_one();
+    }
+
+    _Unit* Take(uint32_t _worker) {
+        {
+            Worker &worker = *Workers_[_worker];
+            std::lock_guard<std::mutex> guard(worker.Mutex_);
+            if (!worker.Queue_.empty()) {
+                _Unit *unit = worker.Queue_.front();
+                worker.Queue_.pop_front();
+                Ready_--;
+                return unit;
+            }
+        }
+        for (uint32_t shift = 1; shift < Workers_.size(); ++shift) {
+            Worker &victim = *Workers_[(_worker + shift) % Workers_.size()];
+            std::lock_guard<std::mutex> guard(victim.Mutex_);
+            if (!victim.Queue_.empty()) {
+                _Unit *unit = victim.Queue_.back();
+                victim.Queue_.pop_back();
+                Ready_--;
+                Workers_[_worker]->Stolen_++;
+                return unit;
+            }
+        }
+        return nullptr;
+    }
+
+    void Work(uint32_t _worker) {
+        log::WriteServerRunner("WorkerPool::Work{worker=", _worker, '}');
+        while (!Stopped_) {
+            _Unit *unit = Take(_worker);
+            if (!unit) {
+                std::unique_lock<std::mutex> lock(SleepMutex_);
+                Wakeup_.wait(lock, [&] { return Ready_ || Stopped_; });
+                continue;
+            }
+            Handle_(unit);
+            Workers_[_worker]->Batches_++;
+            std::lock_guard<std::mutex> guard(unit->Mutex_);
+            if (unit->Inbox_.empty()) {
+                unit->Scheduled_ = false;
+            } else {
+                // work came while the batch was handled, the unit goes to the back of the own queue
+                Schedule(unit, _worker);
+            }
+        }
+    }
+};
+
+}
@@ -1,17 +1,40 @@
 #include <core/api.hpp>
+#include <core/columnar.hpp>
+#include <core/compact.hpp>
+
+#include <random>
 
 using namespace home_task::api;
 
 
+home_task::model::EpochId home_task::api::NewEpoch() {
+    std::random_device rd;
+    model::EpochId epoch = 0;
+    while (!epoch) {
+        epoch = (static_cast<model::EpochId>(rd()) << 32) | rd();
+    }
+    return epoch;
+}
+
 uint32_t State::CalculateSize() const {
-    return sizeof(model::Cell) * Cells_.size();
+    if constexpr (magic_numbers::WithColumnarState) {
+        return CalculateDiffSize(Iteration_) + sizeof(Epoch_) + wire::ColumnarCellsSize(Cells_);
+    }
+    return CalculateDiffSize(Iteration_) + sizeof(Epoch_) + wire::ArraySize<model::Cell>(Cells_.size());
 }
 
 uint32_t GenericResponse::CalculateSize() const {
-    uint32_t acc = 0;
-    acc += Insertions_.size() * sizeof(model::InsertValue);
-    acc += Updates_.size() * sizeof(model::UpdateValue);
-    acc += Deletions_.size() * sizeof(model::DeleteValue);
+    return CalculateDiffSize(Iteration_);
+}
+
+uint32_t GenericResponse::CalculateDiffSize(model::IterationId _iteration) const {
+    if constexpr (magic_numbers::WithCompactDiff) {
+        return wire::CompactDiffSize(*this, _iteration);
+    }
+    uint32_t acc = sizeof(_iteration);
+    acc += wire::ArraySize<model::UpdateValue>(Updates_.size());
+    acc += wire::ArraySize<model::InsertValue>(Insertions_.size());
+    acc += wire::ArraySize<model::DeleteValue>(Deletions_.size());
     return acc;
 }
 
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "compact.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+
+namespace home_task::wire {
+
+// Columnar snapshot layout (EFlags::ColumnarState) for the cells of api::State:
+//   cell count                   varint
+//   run count                    varint
+//   runs                         zigzag (start - previous run end) varint, length varint
+//   values                       blocks of ValuesBlockSize values, every block starts
+//                                with its bit width (u8) followed by the bitpacked values
+// Ids of a long-lived array mostly go in ascending runs (initial load, append bursts),
+// so a run takes a couple of bytes instead of eight per cell.
+constexpr uint32_t ValuesBlockSize = 128;
+
+template <typename _Callback>
+void ForEachIdRun(const model::CellVector &_cells, _Callback &&_callback) {
+    uint64_t idx = 0;
+    while (idx < _cells.size()) {
+        uint64_t length = 1;
+        model::CellId start = _cells[idx].CellId_;
+        while (idx + length < _cells.size() && _cells[idx + length].CellId_ == start + length) {
+            length++;
+        }
+        _callback(start, length);
+        idx += length;
+    }
+}
+
+inline uint32_t ValuesBitWidth(const model::Cell *_cells, uint64_t _count) {
+    model::Value acc = 0;
+    for (uint64_t idx = 0; idx < _count; ++idx) {
+        acc |= _cells[idx].Value_;
+    }
+    return std::bit_width(acc);
+}
+
+inline uint64_t PackedSize(uint32_t _width, uint64_t _count) {
+    return (static_cast<uint64_t>(_width) * _count + 7) / 8;
+}
+
+inline uint32_t ColumnarCellsSize(const model::CellVector &_cells) {
+    uint64_t acc = VarintSize(_cells.size());
+    uint64_t runCount = 0;
+    uint64_t runsSize = 0;
+    model::CellId prevEnd = 0;
+    ForEachIdRun(_cells, [&] (model::CellId _start, uint64_t _length) {
+        runCount++;
+        runsSize += VarintSize(ZigZagDelta(_start, prevEnd)) + VarintSize(_length);
+        prevEnd = _start + _length;
+    });
+    acc += VarintSize(runCount) + runsSize;
+    for (uint64_t begin = 0; begin < _cells.size(); begin += ValuesBlockSize) {
+        uint64_t count = std::min<uint64_t>(ValuesBlockSize, _cells.size() - begin);
+        acc += sizeof(uint8_t) + PackedSize(ValuesBitWidth(_cells.data() + begin, count), count);
+    }
+    return acc;
+}
+
+inline void PutColumnarCells(Writer &_writer, const model::CellVector &_cells) {
+    PutVarint(_writer, _cells.size());
+    uint64_t runCount = 0;
+    ForEachIdRun(_cells, [&] (model::CellId, uint64_t) {
+        runCount++;
+    });
+    PutVarint(_writer, runCount);
+    model::CellId prevEnd = 0;
+    ForEachIdRun(_cells, [&] (model::CellId _start, uint64_t _length) {
+        PutVarint(_writer, ZigZagDelta(_start, prevEnd));
+        PutVarint(_writer, _length);
+        prevEnd = _start + _length;
+    });
+    for (uint64_t begin = 0; begin < _cells.size(); begin += ValuesBlockSize) {
+        uint64_t count = std::min<uint64_t>(ValuesBlockSize, _cells.size() - begin);
+        uint32_t width = ValuesBitWidth(_cells.data() + begin, count);
+        _writer.PutU8(width);
+        if (width == 32) {
+            for (uint64_t idx = 0; idx < count; ++idx) {
+                _writer.PutU32(_cells[begin + idx].Value_);
+            }
+            continue;
+        }
+        uint8_t *dst = _writer.Grow(PackedSize(width, count));
+        uint64_t bit = 0;
+        for (uint64_t idx = 0; idx < count; ++idx, bit += width) {
+            uint64_t value = _cells[begin + idx].Value_;
+            for (uint32_t done = 0; done < width;) {
+                uint32_t shift = (bit + done) % 8;
+                uint32_t take = std::min<uint32_t>(8 - shift, width - done);
+                dst[(bit + done) / 8] |= static_cast<uint8_t>(((value >> done) & ((1u << take) - 1)) << shift);
+                done += take;
+            }
+        }
+    }
+}
+
+// Decodes the cells column into _cells (resized to the cell count).
+// Ids are expanded run by run with a plain counting loop and full-width value
+// blocks are copied as is, both compile to vectorized code.
+inline bool GetColumnarCells(Reader &_reader, model::CellVector *_cells) {
+    uint64_t count = GetVarint(_reader);
+    uint64_t runCount = GetVarint(_reader);
+    // every block of values takes at least its width byte
+    if (!_reader.Ok_ || runCount > count || count > static_cast<uint64_t>(_reader.End_ - _reader.Current_) * ValuesBlockSize) {
+        _reader.Ok_ = false;
+        return false;
+    }
+    _cells->assign(count, model::Cell(0, 0));
+    model::Cell *cells = _cells->data();
+
+    std::vector<uint64_t> runs(2 * runCount);
+    if (!GetVarints(_reader, runs.data(), runs.size())) {
+        return false;
+    }
+    uint64_t filled = 0;
+    model::CellId prevEnd = 0;
+    for (uint64_t run = 0; run < runCount; ++run) {
+        model::CellId start = ApplyDelta(prevEnd, runs[2 * run]);
+        uint64_t length = runs[2 * run + 1];
+        if (length > count - filled) {
+            _reader.Ok_ = false;
+            return false;
+        }
+        model::Cell *dst = cells + filled;
+        for (uint64_t idx = 0; idx < length; ++idx) {
+            dst[idx].CellId_ = start + idx;
+        }
+        filled += length;
+        prevEnd = start + length;
+    }
+    if (filled != count) {
+        _reader.Ok_ = false;
+        return false;
+    }
+
+    for (uint64_t begin = 0; begin < count; begin += ValuesBlockSize) {
+        uint64_t blockCount = std::min<uint64_t>(ValuesBlockSize, count - begin);
+        uint32_t width = _reader.GetU8();
+        if (width > 32) {
+            _reader.Ok_ = false;
+        }
+        const uint8_t *src = _reader.Take(PackedSize(width, blockCount));
+        if (!src) {
+            return false;
+        }
+        model::Cell *dst = cells + begin;
+        if (width == 32) {
+            for (uint64_t idx = 0; idx < blockCount; ++idx) {
+                dst[idx].Value_ = LoadU32(src + sizeof(model::Value) * idx);
+            }
+            continue;
+        }
+        uint64_t mask = (1ull << width) - 1;
+        uint64_t bit = 0;
+        for (uint64_t idx = 0; idx < blockCount; ++idx, bit += width) {
+            // at most 32 + 7 bits are needed, read them byte by byte to stay inside the block
+            uint64_t word = 0;
+            uint64_t first = bit / 8;
+            uint64_t last = std::min<uint64_t>((bit + width + 7) / 8, PackedSize(width, blockCount));
+            for (uint64_t byte = first; byte < last; ++byte) {
+                word |= static_cast<uint64_t>(src[byte]) << (8 * (byte - first));
+            }
+            dst[idx].Value_ = static_cast<model::Value>((word >> (bit % 8)) & mask);
+        }
+    }
+    return _reader.Ok_;
+}
+
+}
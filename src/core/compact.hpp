@@ -0,0 +1,270 @@
+#pragma once
+
+#include "wire.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+
+namespace home_task::wire {
+
+// Compact diff layout (EFlags::CompactDiff), columns instead of records:
+//   iteration                    varint
+//   presence                     u8, bit per non-empty array (updates, insertions, deletions)
+//   updates                      varint count, zigzag id deltas, u32 values
+//   insertions                   varint count, chain bitmap, zigzag id deltas,
+//                                zigzag (near - id) for unchained insertions, u32 values
+//   deletions                    varint count, zigzag id deltas
+// An insertion is chained when it goes right after the previous inserted cell,
+// its near id is not written at all.
+enum ECompactPresence : uint8_t {
+    HasUpdates = 1,
+    HasInsertions = 2,
+    HasDeletions = 4,
+};
+
+constexpr uint64_t VarintStopMask = 0x8080808080808080ull;
+
+inline uint64_t ZigZag(int64_t _value) {
+    return (static_cast<uint64_t>(_value) << 1) ^ static_cast<uint64_t>(_value >> 63);
+}
+
+inline int64_t UnZigZag(uint64_t _value) {
+    return static_cast<int64_t>(_value >> 1) ^ -static_cast<int64_t>(_value & 1);
+}
+
+inline uint64_t ZigZagDelta(uint64_t _value, uint64_t _base) {
+    return ZigZag(static_cast<int64_t>(_value - _base));
+}
+
+inline uint64_t ApplyDelta(uint64_t _base, uint64_t _zigzag) {
+    return _base + static_cast<uint64_t>(UnZigZag(_zigzag));
+}
+
+inline uint32_t VarintSize(uint64_t _value) {
+    return 1 + (63 - std::countl_zero(_value | 1)) / 7;
+}
+
+inline void PutVarint(Writer &_writer, uint64_t _value) {
+    while (_value >= 0x80) {
+        _writer.PutU8(static_cast<uint8_t>(_value) | 0x80);
+        _value >>= 7;
+    }
+    _writer.PutU8(static_cast<uint8_t>(_value));
+}
+
+inline uint64_t GetVarint(Reader &_reader) {
+    uint64_t value = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = _reader.GetU8();
+        if (!_reader.Ok_) {
+            return 0;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    _reader.Ok_ = false;
+    return 0;
+}
+
+// Decodes _count varints in a row. While eight bytes are available the stream is
+// read a machine word at a time: a word without continuation bits holds eight
+// one-byte varints (the common case for sequential ids), otherwise the position of
+// the first stop bit gives the varint length without a per-byte branch.
+inline bool GetVarints(Reader &_reader, uint64_t *_out, uint64_t _count) {
+    const uint8_t *current = _reader.Current_;
+    const uint8_t *end = _reader.End_;
+    uint64_t idx = 0;
+    while (idx < _count && end - current >= 8) {
+        uint64_t word = LoadU64(current);
+        uint64_t stops = ~word & VarintStopMask;
+        if (stops == VarintStopMask && _count - idx >= 8) {
+            for (uint32_t byte = 0; byte < 8; ++byte) {
+                _out[idx + byte] = (word >> (8 * byte)) & 0x7f;
+            }
+            idx += 8;
+            current += 8;
+            continue;
+        }
+        if (!stops) {
+            break;
+        }
+        uint32_t length = (std::countr_zero(stops) >> 3) + 1;
+        uint64_t value = 0;
+        for (uint32_t byte = 0; byte < length; ++byte) {
+            value |= ((word >> (8 * byte)) & 0x7f) << (7 * byte);
+        }
+        _out[idx++] = value;
+        current += length;
+    }
+    _reader.Current_ = current;
+    for (; idx < _count; ++idx) {
+        _out[idx] = GetVarint(_reader);
+        if (!_reader.Ok_) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+template <typename _Response>
+uint32_t CompactDiffSize(const _Response &_response, model::IterationId _iteration) {
+    uint32_t acc = VarintSize(_iteration) + sizeof(uint8_t);
+    if (_response.Updates_.size()) {
+        acc += VarintSize(_response.Updates_.size());
+        model::CellId prev = 0;
+        for (auto &update : _response.Updates_) {
+            acc += VarintSize(ZigZagDelta(update.Cell_.CellId_, std::exchange(prev, update.Cell_.CellId_)));
+            acc += sizeof(model::Value);
+        }
+    }
+    if (_response.Insertions_.size()) {
+        acc += VarintSize(_response.Insertions_.size()) + (_response.Insertions_.size() + 7) / 8;
+        model::CellId prev = 0;
+        for (auto &insert : _response.Insertions_) {
+            if (!prev || insert.NearCellId_ != prev) {
+                acc += VarintSize(ZigZagDelta(insert.NearCellId_, insert.Cell_.CellId_));
+            }
+            acc += VarintSize(ZigZagDelta(insert.Cell_.CellId_, std::exchange(prev, insert.Cell_.CellId_)));
+            acc += sizeof(model::Value);
+        }
+    }
+    if (_response.Deletions_.size()) {
+        acc += VarintSize(_response.Deletions_.size());
+        model::CellId prev = 0;
+        for (auto &del : _response.Deletions_) {
+            acc += VarintSize(ZigZagDelta(del.CellId_, std::exchange(prev, del.CellId_)));
+        }
+    }
+    return acc;
+}
+
+template <typename _Response>
+void PutCompactDiff(Writer &_writer, const _Response &_response, model::IterationId _iteration) {
+    PutVarint(_writer, _iteration);
+    uint8_t presence = (_response.Updates_.size() ? HasUpdates : 0)
+        | (_response.Insertions_.size() ? HasInsertions : 0)
+        | (_response.Deletions_.size() ? HasDeletions : 0);
+    _writer.PutU8(presence);
+
+    if (presence & HasUpdates) {
+        PutVarint(_writer, _response.Updates_.size());
+        model::CellId prev = 0;
+        for (auto &update : _response.Updates_) {
+            PutVarint(_writer, ZigZagDelta(update.Cell_.CellId_, std::exchange(prev, update.Cell_.CellId_)));
+        }
+        for (auto &update : _response.Updates_) {
+            _writer.PutU32(update.Cell_.Value_);
+        }
+    }
+    if (presence & HasInsertions) {
+        PutVarint(_writer, _response.Insertions_.size());
+        size_t chains = _writer.Buffer_->size();
+        _writer.Grow((_response.Insertions_.size() + 7) / 8);
+        model::CellId prev = 0;
+        uint32_t idx = 0;
+        for (auto &insert : _response.Insertions_) {
+            if (prev && insert.NearCellId_ == prev) {
+                (*_writer.Buffer_)[chains + idx / 8] |= 1 << (idx % 8);
+            }
+            prev = insert.Cell_.CellId_;
+            idx++;
+        }
+        prev = 0;
+        for (auto &insert : _response.Insertions_) {
+            PutVarint(_writer, ZigZagDelta(insert.Cell_.CellId_, std::exchange(prev, insert.Cell_.CellId_)));
+        }
+        prev = 0;
+        for (auto &insert : _response.Insertions_) {
+            if (!prev || insert.NearCellId_ != prev) {
+                PutVarint(_writer, ZigZagDelta(insert.NearCellId_, insert.Cell_.CellId_));
+            }
+            prev = insert.Cell_.CellId_;
+        }
+        for (auto &insert : _response.Insertions_) {
+            _writer.PutU32(insert.Cell_.Value_);
+        }
+    }
+    if (presence & HasDeletions) {
+        PutVarint(_writer, _response.Deletions_.size());
+        model::CellId prev = 0;
+        for (auto &del : _response.Deletions_) {
+            PutVarint(_writer, ZigZagDelta(del.CellId_, std::exchange(prev, del.CellId_)));
+        }
+    }
+}
+
+// Fills the arrays of _response, returns the encoded iteration or std::nullopt on malformed input.
+template <typename _Response>
+std::optional<model::IterationId> GetCompactDiff(Reader &_reader, _Response *_response) {
+    model::IterationId iteration = GetVarint(_reader);
+    uint8_t presence = _reader.GetU8();
+    std::vector<uint64_t> ids;
+
+    auto getCount = [&] () -> uint64_t {
+        uint64_t count = GetVarint(_reader);
+        // every record takes at least a byte, so a larger count can't be valid
+        if (count > static_cast<uint64_t>(_reader.End_ - _reader.Current_)) {
+            _reader.Ok_ = false;
+            return 0;
+        }
+        return count;
+    };
+
+    if (presence & HasUpdates) {
+        uint64_t count = getCount();
+        ids.resize(count);
+        if (!GetVarints(_reader, ids.data(), count)) {
+            return std::nullopt;
+        }
+        model::CellId prev = 0;
+        for (uint64_t idx = 0; idx < count; ++idx) {
+            prev = ApplyDelta(prev, ids[idx]);
+            _response->Updates_.push_back(model::UpdateValue{.Cell_ = model::Cell(prev, _reader.GetU32())});
+        }
+    }
+    if (presence & HasInsertions) {
+        uint64_t count = getCount();
+        const uint8_t *chains = _reader.Take((count + 7) / 8);
+        ids.resize(count);
+        if (!chains || !GetVarints(_reader, ids.data(), count)) {
+            return std::nullopt;
+        }
+        model::CellId prev = 0;
+        for (uint64_t idx = 0; idx < count; ++idx) {
+            model::CellId cellId = ApplyDelta(prev, ids[idx]);
+            model::CellId nearCellId = prev;
+            if (!(chains[idx / 8] & (1 << (idx % 8)))) {
+                nearCellId = ApplyDelta(cellId, GetVarint(_reader));
+            }
+            _response->Insertions_.push_back(model::InsertValue{.NearCellId_ = nearCellId, .Cell_ = model::Cell(cellId, 0)});
+            prev = cellId;
+        }
+        for (auto &insert : _response->Insertions_) {
+            insert.Cell_.Value_ = _reader.GetU32();
+        }
+    }
+    if (presence & HasDeletions) {
+        uint64_t count = getCount();
+        ids.resize(count);
+        if (!GetVarints(_reader, ids.data(), count)) {
+            return std::nullopt;
+        }
+        model::CellId prev = 0;
+        for (uint64_t idx = 0; idx < count; ++idx) {
+            prev = ApplyDelta(prev, ids[idx]);
+            _response->Deletions_.push_back(model::DeleteValue{.CellId_ = prev});
+        }
+    }
+    if (!_reader.Ok_) {
+        return std::nullopt;
+    }
+    return iteration;
+}
+
+}
@@ -1,101 +1,163 @@
 #pragma once
 
 #include "magic_numbers.hpp"
+#include "span.hpp"
+#include "trace.hpp"
 
+#include <chrono>
 #include <sstream>
 #include <iostream>
+#include <type_traits>
 
 namespace home_task::log {
 
+// A disabled category compiles to nothing, but the arguments are still computed at the call site:
+// pass a costly one as a lambda, it's called only when the category is enabled,
+// and measure a duration that only goes to the log with a Stopwatch of the category.
+template <typename _Arg>
+decltype(auto) Evaluate(_Arg &&_arg) {
+    if constexpr (std::is_invocable_v<_Arg>) {
+        return _arg();
+    } else {
+        return std::forward<_Arg>(_arg);
+    }
+}
+
 template <bool ... _Flags>
 struct Logger {
+    static constexpr bool Enabled = (false || ... || _Flags);
+
     template <typename ... _Args>
     static void Write(_Args&&... _args) {
-        if ((false || ... || _Flags)) {
-            std::ostringstream sout;
-            (sout << ... << std::forward<_Args>(_args)) << std::endl;
-            std::cerr << sout.str();
+        if constexpr (Enabled) {
+            if constexpr (magic_numbers::WithAsyncLog) {
+                Trace(std::forward<_Args>(_args)...);
+            } else {
+                WriteNow(std::forward<_Args>(_args)...);
+            }
+        }
+    }
+
+    template <typename ... _Args>
+    static void WriteNow(_Args&&... _args) {
+        std::ostringstream sout;
+        (sout << ... << Evaluate(std::forward<_Args>(_args))) << std::endl;
+        std::cerr << sout.str();
+    }
+};
+
+using ClientRunnerLogger = Logger<magic_numbers::WithRunnerLog, magic_numbers::WithClientRunnerLog>;
+using ServerRunnerLogger = Logger<magic_numbers::WithRunnerLog, magic_numbers::WithServerRunnerLog>;
+
+// Doesn't read the clock at all when the category of _Logger is disabled.
+template <typename _Logger>
+class Stopwatch {
+public:
+    Stopwatch() {
+        if constexpr (_Logger::Enabled) {
+            Start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    // Seconds since the construction.
+    double Elapsed() const {
+        if constexpr (_Logger::Enabled) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start_).count();
         }
+        return 0;
     }
+
+private:
+    std::chrono::steady_clock::time_point Start_;
 };
 
+// Written at once, fatal errors are followed by exit.
+// The rings are drained first, so the line goes after everything logged before it.
 template <typename ... _Args>
 void ForceWrite(_Args&&... _args) {
-    Logger<true>::Write(std::forward<_Args>(_args)...);
+    if constexpr (magic_numbers::WithAsyncLog) {
+        FlushTrace();
+    }
+    Logger<true>::WriteNow(std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void Write(_Args&&... _args) {
-    Logger<magic_numbers::WithLog>::Write(std::forward<_Args>(_args)...);
+void Write(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void WriteInit(_Args&&... _args) {
-    Logger<magic_numbers::WithInitLog>::Write(std::forward<_Args>(_args)...);
+void WriteInit(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithInitLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void WriteFullStateLog(_Args&&... _args) {
-    Logger<magic_numbers::WithFullStateLog>::Write(std::forward<_Args>(_args)...);
+void WriteFullStateLog(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithFullStateLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void WriteHistoryLog(_Args&&... _args) {
-    Logger<magic_numbers::WithHistoryLog>::Write(std::forward<_Args>(_args)...);
+void WriteHistoryLog(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithHistoryLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void WriteMutex(_Args&&... _args) {
-    Logger<magic_numbers::WithMutexLog>::Write(std::forward<_Args>(_args)...);
+void WriteMutex(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithMutexLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void WriteNetwork(_Args&&... _args) {
-    Logger<magic_numbers::WithNetworkLog>::Write(std::forward<_Args>(_args)...);
+void WriteNetwork(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithNetworkLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 
 template <typename ... _Args>
-void WriteState(_Args&&... _args) {
-    Logger<magic_numbers::WithStateLog>::Write(std::forward<_Args>(_args)...);
+void WriteState(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithStateLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void WriteServerState(_Args&&... _args) {
-    Logger<magic_numbers::WithStateLog, magic_numbers::WithServerStateLog>::Write(std::forward<_Args>(_args)...);
+void WriteServerState(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithStateLog, magic_numbers::WithServerStateLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void WriteClientState(_Args&&... _args) {
-    Logger<magic_numbers::WithStateLog, magic_numbers::WithClientStateLog>::Write(std::forward<_Args>(_args)...);
+void WriteClientState(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithStateLog, magic_numbers::WithClientStateLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void WriteFastClientState(_Args&&... _args) {
+void WriteFastClientState(Literal _message, _Args&&... _args) {
     Logger<magic_numbers::WithStateLog, magic_numbers::WithClientStateLog, magic_numbers::WithFastClientStateLog>
-        ::Write(std::forward<_Args>(_args)...);
+        ::Write(_message, std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void WriteDestructor(_Args&&... _args) {
-    Logger<magic_numbers::WithDestructorLog>::Write(std::forward<_Args>(_args)...);
+void WriteDestructor(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithDestructorLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 
 template <typename ... _Args>
-void WriteClientRunner(_Args&&... _args) {
-    Logger<magic_numbers::WithRunnerLog, magic_numbers::WithClientRunnerLog>::Write(std::forward<_Args>(_args)...);
+void WriteClientRunner(Literal _message, _Args&&... _args) {
+    ClientRunnerLogger::Write(_message, std::forward<_Args>(_args)...);
 }
 
 
 template <typename ... _Args>
-void WriteServerRunner(_Args&&... _args) {
-    Logger<magic_numbers::WithRunnerLog, magic_numbers::WithServerRunnerLog>::Write(std::forward<_Args>(_args)...);
+void WriteServerRunner(Literal _message, _Args&&... _args) {
+    ServerRunnerLogger::Write(_message, std::forward<_Args>(_args)...);
+}
+
+template <typename ... _Args>
+void WriteRelayRunner(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithRunnerLog, magic_numbers::WithRelayRunnerLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 template <typename ... _Args>
-void WriteDecardTree(_Args&&... _args) {
-    Logger<magic_numbers::WithDecardTreeLog>::Write(std::forward<_Args>(_args)...);
+void WriteDecardTree(Literal _message, _Args&&... _args) {
+    Logger<magic_numbers::WithDecardTreeLog>::Write(_message, std::forward<_Args>(_args)...);
 }
 
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 
 
@@ -8,10 +9,27 @@ namespace home_task::magic_numbers {
 constexpr uint64_t ServerId = 0;
 
 constexpr bool WithSizeCalculation = true;
+constexpr bool WithCompactDiff = true;
+constexpr bool WithColumnarState = true;
 constexpr bool CalculateFirstLoadState = false;
 constexpr bool WithStateChecking = false;
 constexpr bool WithDelayedHistory= false;
 
+constexpr uint32_t MailBoxSpinCount = 512;
+// free message records kept by every thread
+constexpr uint32_t MessagePoolSize = 4096;
+
+// threads building the client tree from a State, every thread gets at least BuildChunkSize cells
+constexpr uint32_t BuildThreadCount = 4;
+constexpr uint32_t BuildChunkSize = 1 << 18;
+// client diffs from this many operations are applied by one sweep over the array
+constexpr uint32_t BatchApplySize = 8;
+// a client with a snapshot file saves its state every this many iterations
+constexpr uint32_t SnapshotPeriod = 64;
+// cells of a segment of the segmented server: a segment twice larger is split,
+// neighbours smaller together than a half are merged
+constexpr uint64_t SegmentCells = 1 << 16;
+
 constexpr bool FastSwith = false;
 
 constexpr bool WithLog = true;
@@ -25,10 +43,22 @@ constexpr bool WithDestructorLog = false;
 constexpr bool WithRunnerLog = false;
 constexpr bool WithServerRunnerLog = false;
 constexpr bool WithClientRunnerLog = false;
+constexpr bool WithRelayRunnerLog = false;
 constexpr bool WithDecardTreeLog = false;
 constexpr bool WithInitLog = false;
 constexpr bool WithFullStateLog = FastSwith;
 constexpr bool WithHistoryLog = FastSwith;
+// enabled categories write binary records to per thread rings, a background thread formats them
+constexpr bool WithAsyncLog = true;
+// records of the ring of every logging thread, 128 bytes each
+constexpr uint64_t TraceRingRecords = 1 << 12;
+constexpr auto TracePollInterval = std::chrono::milliseconds(1);
+// stages of every SpanSampleRate-th request and its response are written to SpanFile in the Chrome trace-event format
+constexpr bool WithSpans = false;
+constexpr uint32_t SpanSampleRate = 64;
+// spans kept for the file, the rest are dropped
+constexpr uint64_t SpanLimit = 1 << 20;
+constexpr const char *SpanFile = "spans.json";
 
 constexpr bool UserSendLoadState = false;
 constexpr bool UserSendSync = true;
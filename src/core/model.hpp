@@ -47,5 +47,8 @@ using OperationDeq = std::deque<Operation>;
 
 using IterationId = uint64_t;
 using ClientId = uint32_t;
+using ArrayId = uint64_t;
+// The array a state and its iterations belong to, a server makes a new one on every start, 0 is none.
+using EpochId = uint64_t;
 
 }
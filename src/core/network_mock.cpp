@@ -1,5 +1,8 @@
 #include "network_mock.hpp"
 
+#include <new>
+#include <utility>
+
 using namespace home_task::network_mock;
 
 
@@ -10,29 +13,163 @@ NetworkMock::NetworkMock(uint32_t _mailBoxCount) {
     }
 }
 
+NetworkMock::NetworkMock(uint32_t _mailBoxCount, const SimulationSettings &_settings)
+    : NetworkMock(_mailBoxCount)
+{
+    Simulation_ = std::make_unique<NetworkSimulation>(_settings, [this] (model::ClientId _receiver, MessageRecord *_msg) {
+        Deliver(_receiver, _msg);
+    });
+}
+
+namespace {
+
+// Free list of message records of the thread.
+// A record is usually freed by the receiver, but the receiver answers with records of
+// the same size, so in the steady state every thread takes records from its own list.
+struct MessagePool {
+    struct FreeRecord {
+        FreeRecord *Next_;
+    };
+
+    FreeRecord *Head_ = nullptr;
+    uint32_t Count_ = 0;
+
+    ~MessagePool() {
+        while (Head_) {
+            ::operator delete(std::exchange(Head_, Head_->Next_));
+        }
+    }
+};
+
+thread_local MessagePool Pool;
+
+void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+}
+
+
+void* MessageRecord::operator new(size_t _size) {
+    if (_size == sizeof(MessageRecord) && Pool.Head_) {
+        Pool.Count_--;
+        return std::exchange(Pool.Head_, Pool.Head_->Next_);
+    }
+    return ::operator new(_size);
+}
+
+void MessageRecord::operator delete(void *_ptr, size_t _size) {
+    if (_size == sizeof(MessageRecord) && Pool.Count_ < magic_numbers::MessagePoolSize) {
+        Pool.Head_ = new (_ptr) MessagePool::FreeRecord{.Next_ = Pool.Head_};
+        Pool.Count_++;
+        return;
+    }
+    ::operator delete(_ptr);
+}
+
+void NetworkMock::MailBox::Push(MessageRecord *_msg) {
+    MessageRecord *head = Head_.load(std::memory_order_relaxed);
+    do {
+        _msg->Next_ = head;
+    } while (!Head_.compare_exchange_weak(head, _msg));
+    // pairs with the Waiting_ store in Wait: either the receiver sees the message or we see it parking
+    if (Waiting_.load()) {
+        Doorbell_.fetch_add(1);
+        Doorbell_.notify_one();
+    }
+    if (Waker_.load()) {
+        if (IWaker *waker = Waker_.exchange(nullptr)) {
+            waker->Wake();
+        }
+    }
+}
+
+MessageRecord* NetworkMock::MailBox::Pop() {
+    if (!Local_) {
+        MessageRecord *stack = Head_.exchange(nullptr, std::memory_order_acquire);
+        while (stack) {
+            MessageRecord *next = std::exchange(stack->Next_, Local_);
+            Local_ = std::exchange(stack, next);
+        }
+    }
+    if (!Local_) {
+        return nullptr;
+    }
+    MessageRecord *msg = std::exchange(Local_, Local_->Next_);
+    msg->Next_ = nullptr;
+    return msg;
+}
+
+bool NetworkMock::MailBox::Empty() const {
+    return !Local_ && !Head_.load(std::memory_order_acquire);
+}
+
+void NetworkMock::MailBox::Wait() {
+    for (uint32_t spin = 0; spin < magic_numbers::MailBoxSpinCount; ++spin) {
+        if (!Empty()) {
+            return;
+        }
+        CpuRelax();
+    }
+    Waiting_.store(true);
+    uint32_t doorbell = Doorbell_.load();
+    while (!Local_ && !Head_.load()) {
+        Doorbell_.wait(doorbell);
+        doorbell = Doorbell_.load();
+    }
+    Waiting_.store(false, std::memory_order_relaxed);
+}
+
+bool NetworkMock::MailBox::WakeOnMessage(IWaker *_waker) {
+    // Local_ belongs to the consumer: once the waker is published, a sender may resume it on another thread
+    if (Local_) {
+        return false;
+    }
+    // pairs with the Waker_ load in Push: either a sender sees the waker or we see the message
+    Waker_.store(_waker);
+    if (!Head_.load()) {
+        return true;
+    }
+    // a message came, take the waker back unless a sender has already taken it to call
+    return !Waker_.exchange(nullptr);
+}
+
+NetworkMock::MailBox::~MailBox() {
+    uint32_t count = 0;
+    while (MessageRecord *msg = Pop()) {
+        delete msg;
+        count++;
+    }
+    log::WriteDestructor("~MailBox queue# ", count);
+}
+
+void NetworkMock::Deliver(model::ClientId _receiver, MessageRecord *_msg) {
+    _msg->EndStage("send", _receiver);
+    MailBoxes_[_receiver]->Push(_msg);
+}
+
 void NetworkMock::Send(model::ClientId _receiver, model::ClientId _sender, std::unique_ptr<MessageRecord> &&_msg) {
     _msg->Sender_ = _sender;
-    auto mailBox = MailBoxes_[_receiver].get();
-    log::WriteMutex("NetworkMock::Send{lock queue mutex ", _receiver, '}');
-    std::lock_guard<std::mutex> guard(mailBox->QueueMutex_);
-    log::WriteMutex("NetworkMock::Send{locked queue mutex ", _receiver, '}');
-    mailBox->Queue_.push(std::move(_msg));
-    mailBox->Notifier_.notify_one();
-    log::WriteMutex("NetworkMock::Send{unlock queue mutex ", _receiver, '}');
+    _msg->BeginTrace();
+    log::WriteNetwork("NetworkMock::Send{push to ", _receiver, '}');
+    if (Simulation_) {
+        Simulation_->Send(_receiver, _msg.release());
+        return;
+    }
+    Deliver(_receiver, _msg.release());
 }
 
 std::optional<std::unique_ptr<MessageRecord>> NetworkMock::Receive(model::ClientId _mailbox) {
-    log::WriteMutex("NetworkMock::Receive{lock queue mutex ", _mailbox, '}');
-    std::lock_guard<std::mutex> guard(MailBoxes_[_mailbox]->QueueMutex_);
-    log::WriteMutex("NetworkMock::Receive{locked queue mutex ", _mailbox, '}');
-    auto &queue = MailBoxes_[_mailbox]->Queue_;
-    if (queue.empty()) {
+    MessageRecord *msg = MailBoxes_[_mailbox]->Pop();
+    if (!msg) {
         return std::nullopt;
     }
-    auto msg = std::move(queue.front());
-    queue.pop();
-    log::WriteMutex("NetworkMock::Receive{unlock queue mutex ", _mailbox, '}');
-    return msg;
+    msg->EndStage("queue", _mailbox);
+    return std::unique_ptr<MessageRecord>(msg);
 }
 
 std::unique_ptr<MessageRecord> NetworkMock::ReceiveWithWaiting(model::ClientId _mailbox) {
@@ -44,13 +181,36 @@ std::unique_ptr<MessageRecord> NetworkMock::ReceiveWithWaiting(model::ClientId _
     return std::move(*msg);
 }
 
-void NetworkMock::WaitMessage(model::ClientId _mailbox) {
+uint32_t NetworkMock::ReceiveAll(model::ClientId _mailbox, std::vector<std::unique_ptr<MessageRecord>> *_messages) {
     auto mailBox = MailBoxes_[_mailbox].get();
-    log::WriteMutex("NetworkMock::Receive{lock notifier mutex ", _mailbox, '}');
-    std::unique_lock<std::mutex> lock(mailBox->NotifierMutex_);
-    log::WriteMutex("NetworkMock::Receive{locked notifier mutex ", _mailbox, '}');
-    mailBox->Notifier_.wait(lock, [&]{ return mailBox->Queue_.size(); });
-    log::WriteMutex("NetworkMock::Receive{unlock notifier mutex ", _mailbox, '}');
+    uint32_t count = 0;
+    while (MessageRecord *msg = mailBox->Pop()) {
+        msg->EndStage("queue", _mailbox);
+        _messages->emplace_back(msg);
+        count++;
+    }
+    return count;
+}
+
+uint32_t NetworkMock::ReceiveAllWithWaiting(model::ClientId _mailbox, std::vector<std::unique_ptr<MessageRecord>> *_messages) {
+    uint32_t count = ReceiveAll(_mailbox, _messages);
+    while (!count) {
+        WaitMessage(_mailbox);
+        count = ReceiveAll(_mailbox, _messages);
+    }
+    return count;
+}
+
+void NetworkMock::WaitMessage(model::ClientId _mailbox) {
+    MailBoxes_[_mailbox]->Wait();
+}
+
+bool NetworkMock::WakeOnMessage(model::ClientId _mailbox, IWaker *_waker) {
+    return MailBoxes_[_mailbox]->WakeOnMessage(_waker);
+}
+
+NetworkSimulation* NetworkMock::GetSimulation() const {
+    return Simulation_.get();
 }
 
 NetworkClient::NetworkClient(const std::shared_ptr<network_mock::NetworkMock> &_network, model::ClientId _mailBox)
@@ -74,7 +234,22 @@ std::unique_ptr<MessageRecord> NetworkClient::ReceiveWithWaiting() {
     return Network_->ReceiveWithWaiting(MailBox_);
 }
 
+uint32_t NetworkClient::ReceiveAll(std::vector<std::unique_ptr<MessageRecord>> *_messages) {
+    log::WriteNetwork("NetworkClient::ReceiveAll ", MailBox_);
+    return Network_->ReceiveAll(MailBox_, _messages);
+}
+
+uint32_t NetworkClient::ReceiveAllWithWaiting(std::vector<std::unique_ptr<MessageRecord>> *_messages) {
+    log::WriteNetwork("NetworkClient::ReceiveAllWithWaiting ", MailBox_);
+    return Network_->ReceiveAllWithWaiting(MailBox_, _messages);
+}
+
 void NetworkClient::WaitMessage() {
     log::WriteNetwork("NetworkClient::WaitMessage ", MailBox_);
     Network_->WaitMessage(MailBox_);
 }
+
+bool NetworkClient::WakeOnMessage(IWaker *_waker) {
+    log::WriteNetwork("NetworkClient::WakeOnMessage ", MailBox_);
+    return Network_->WakeOnMessage(MailBox_, _waker);
+}
@@ -3,49 +3,112 @@
 #include "model.hpp"
 #include "magic_numbers.hpp"
 #include "log.hpp"
+#include "network_simulation.hpp"
+#include "records.hpp"
+#include "wire.hpp"
 
-#include <any>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <memory>
 #include <optional>
-#include <queue>
-#include <mutex>
 #include <string>
-#include <condition_variable>
+#include <variant>
+#include <vector>
 
 namespace home_task::network_mock {
 
-
-enum class EMessageType : uint32_t {
-    Ping,
-    Pong,
-    String,
-    Poison,
-    Connect,
-    PRIVATE = 1024
-};
+// Every payload a message can carry, stored in place: control messages carry std::monostate.
+using Payload = std::variant<
+    std::monostate,
+    std::string,
+    api::LoadStateRequest,
+    api::UpdateValueRequest,
+    api::InsertValueRequest,
+    api::DeleteValueRequest,
+    api::SyncRequest,
+    api::ResumeRequest,
+    api::OpenArrayRequest,
+    api::SubscribeRequest,
+    api::PushAckRequest,
+    api::State,
+    api::UpdateValueResponse,
+    api::InsertValueResponse,
+    api::DeleteValueResponse,
+    api::SyncResponse,
+    api::PushResponse>;
 
 struct MessageRecord {
     uint32_t Type_;
-    std::any Record_;
+    Payload Record_;
     model::ClientId Sender_;
     uint32_t Size_ = 0;
+    // intrusive link of the mailbox queue
+    MessageRecord *Next_ = nullptr;
+    // sampled messages only, see WithSpans: the trace and when the current stage started
+    uint64_t TraceId_ = 0;
+    uint64_t StageStart_ = 0;
 
     ~MessageRecord() {
         log::WriteDestructor("~MessageRecord");
     }
+
+    // A message sent while the thread handles a sampled message joins its trace,
+    // with _sample a new message may start its own trace.
+    void BeginTrace(bool _sample = false) {
+        if constexpr (magic_numbers::WithSpans) {
+            if (!TraceId_) {
+                TraceId_ = log::SpanScope::CurrentTraceId();
+                if (!TraceId_ && _sample && log::SampleSpan()) {
+                    TraceId_ = log::NewTraceId();
+                }
+                StageStart_ = log::SpanClock();
+            }
+        }
+    }
+
+    // Writes the stage that ends now at _actor and starts the next one.
+    void EndStage(const char *_stage, model::ClientId _actor) {
+        if constexpr (magic_numbers::WithSpans) {
+            if (TraceId_) {
+                uint64_t now = log::SpanClock();
+                log::WriteSpan(log::SpanRecord{
+                    .Name_ = _stage,
+                    .TraceId_ = TraceId_,
+                    .Start_ = StageStart_,
+                    .End_ = now,
+                    .Actor_ = static_cast<uint32_t>(_actor),
+                    .Sender_ = static_cast<uint32_t>(Sender_),
+                    .Type_ = Type_,
+                    .Iteration_ = 0,
+                });
+                StageStart_ = now;
+            }
+        }
+    }
+
+    // Records are recycled through a free list of the thread, see MessagePoolSize.
+    static void* operator new(size_t _size);
+    static void operator delete(void *_ptr, size_t _size);
 };
 
 
 inline std::unique_ptr<MessageRecord> MakePingMessage() {
     auto msg = std::make_unique<MessageRecord>();
     msg->Type_ = static_cast<uint32_t>(home_task::network_mock::EMessageType::Ping);
+    if constexpr (magic_numbers::WithSizeCalculation) {
+        msg->Size_ = wire::HeaderSize;
+    }
     return msg;
 }
 
 inline std::unique_ptr<MessageRecord> MakePongMessage() {
     auto msg = std::make_unique<MessageRecord>();
     msg->Type_ = static_cast<uint32_t>(home_task::network_mock::EMessageType::Pong);
+    if constexpr (magic_numbers::WithSizeCalculation) {
+        msg->Size_ = wire::HeaderSize;
+    }
     return msg;
 }
 
@@ -54,7 +117,7 @@ inline std::unique_ptr<MessageRecord> MakeStringMessage(const std::string &str)
     msg->Type_ = (uint32_t)home_task::network_mock::EMessageType::String;
     msg->Record_ = str;
     if constexpr (magic_numbers::WithSizeCalculation) {
-        msg->Size_ = str.size() + sizeof(MessageRecord) + sizeof(std::string);
+        msg->Size_ = wire::HeaderSize + sizeof(uint32_t) + str.size();
     }
     return msg;
 }
@@ -63,7 +126,7 @@ inline std::unique_ptr<MessageRecord> MakePoisonMessage() {
     auto msg = std::make_unique<MessageRecord>();
     msg->Type_ = static_cast<uint32_t>(home_task::network_mock::EMessageType::Poison);
     if constexpr (magic_numbers::WithSizeCalculation) {
-        msg->Size_ = sizeof(MessageRecord);
+        msg->Size_ = wire::HeaderSize;
     }
     return msg;
 }
@@ -72,30 +135,58 @@ inline std::unique_ptr<MessageRecord> MakeConnectMessage() {
     auto msg = std::make_unique<MessageRecord>();
     msg->Type_ = static_cast<uint32_t>(home_task::network_mock::EMessageType::Connect);
     if constexpr (magic_numbers::WithSizeCalculation) {
-        msg->Size_ = sizeof(MessageRecord);
+        msg->Size_ = wire::HeaderSize;
     }
     return msg;
 }
 
+// Wakes a receiver that doesn't block its thread on the mailbox, see WakeOnMessage.
+class IWaker {
+public:
+    virtual ~IWaker() = default;
+
+    virtual void Wake() = 0;
+};
+
 class NetworkMock {
     friend class NetworkClient;
 
+    // Multi-producer single-consumer queue.
+    // Senders push onto a lock-free stack, the owner takes the whole stack with one
+    // exchange and keeps it reversed in Local_, so every message costs one CAS on
+    // the sender side and nothing on the receiver side until Local_ runs out.
+    // A receiver without messages spins for a while and then parks on Doorbell_,
+    // senders only ring the doorbell when the receiver announced it's parking.
+    // A receiver that must not block its thread leaves a waker instead, the first sender takes and calls it.
     struct MailBox {
-        std::queue<std::unique_ptr<MessageRecord>> Queue_;
-        std::condition_variable Notifier_;
-        std::mutex QueueMutex_;
-        std::mutex NotifierMutex_;
-
-        ~MailBox() {
-            log::WriteDestructor("~MailBox queue# ", Queue_.size());
-        }
+        std::atomic<MessageRecord*> Head_ = nullptr;
+        std::atomic<uint32_t> Doorbell_ = 0;
+        std::atomic<bool> Waiting_ = false;
+        std::atomic<IWaker*> Waker_ = nullptr;
+        MessageRecord *Local_ = nullptr;
+
+        void Push(MessageRecord *_msg);
+        MessageRecord* Pop();
+        bool Empty() const;
+        void Wait();
+        bool WakeOnMessage(IWaker *_waker);
+
+        ~MailBox();
     };
 
+    // the send stage of a sampled message ends when it's queued
+    void Deliver(model::ClientId _receiver, MessageRecord *_msg);
+
     std::vector<std::unique_ptr<MailBox>> MailBoxes_;
+    // declared after the mailboxes to stop delivering before they are destroyed
+    std::unique_ptr<NetworkSimulation> Simulation_;
 
 public:
     NetworkMock(uint32_t _mailBoxCount);
 
+    // Messages go through the simulated links instead of being delivered instantly.
+    NetworkMock(uint32_t _mailBoxCount, const SimulationSettings &_settings);
+
     ~NetworkMock() {
         log::WriteDestructor("~NetworkMock");
     }
@@ -106,24 +197,66 @@ public:
 
     std::unique_ptr<MessageRecord> ReceiveWithWaiting(model::ClientId _mailbox);
 
+    // Moves every queued message to _messages in the order they were sent, returns their count.
+    uint32_t ReceiveAll(model::ClientId _mailbox, std::vector<std::unique_ptr<MessageRecord>> *_messages);
+
+    uint32_t ReceiveAllWithWaiting(model::ClientId _mailbox, std::vector<std::unique_ptr<MessageRecord>> *_messages);
+
     void WaitMessage(model::ClientId _mailbox);
 
+    // Returns true when _waker is left in the mailbox and will be called on the next message,
+    // false when messages are already there and the waker won't be called.
+    bool WakeOnMessage(model::ClientId _mailbox, IWaker *_waker);
+
+    // nullptr without simulation
+    NetworkSimulation* GetSimulation() const;
+
 };
 
-class NetworkClient {
+// What an actor sees of the network: its own mailbox and sending to the others.
+class INetworkClient {
+public:
+    virtual ~INetworkClient() = default;
+
+    virtual void Send(model::ClientId _receiver, std::unique_ptr<MessageRecord> &&_msg) = 0;
+
+    virtual std::optional<std::unique_ptr<MessageRecord>> Receive() = 0;
+
+    virtual std::unique_ptr<MessageRecord> ReceiveWithWaiting() = 0;
+
+    virtual uint32_t ReceiveAll(std::vector<std::unique_ptr<MessageRecord>> *_messages) = 0;
+
+    virtual uint32_t ReceiveAllWithWaiting(std::vector<std::unique_ptr<MessageRecord>> *_messages) = 0;
+
+    virtual void WaitMessage() = 0;
+
+    // The waiting of coroutines, see NetworkMock::WakeOnMessage.
+    virtual bool WakeOnMessage(IWaker *) {
+        log::ForceWrite("the network client can't wake receivers");
+        std::exit(1);
+    }
+};
+
+class NetworkClient : public INetworkClient {
     std::shared_ptr<NetworkMock> Network_;
     uint64_t MailBox_;
 
 public:
     NetworkClient(const std::shared_ptr<network_mock::NetworkMock> &_network, model::ClientId _mailBox);
 
-    void Send(model::ClientId _receiver, std::unique_ptr<MessageRecord> &&_msg);
+    void Send(model::ClientId _receiver, std::unique_ptr<MessageRecord> &&_msg) override;
+
+    std::optional<std::unique_ptr<MessageRecord>> Receive() override;
+
+    std::unique_ptr<MessageRecord> ReceiveWithWaiting() override;
+
+    uint32_t ReceiveAll(std::vector<std::unique_ptr<MessageRecord>> *_messages) override;
 
-    std::optional<std::unique_ptr<MessageRecord>> Receive();
+    uint32_t ReceiveAllWithWaiting(std::vector<std::unique_ptr<MessageRecord>> *_messages) override;
 
-    std::unique_ptr<MessageRecord> ReceiveWithWaiting();
+    void WaitMessage() override;
 
-    void WaitMessage();
+    bool WakeOnMessage(IWaker *_waker) override;
 
 };
 
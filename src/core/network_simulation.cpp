@@ -0,0 +1,201 @@
+#include "network_simulation.hpp"
+#include "network_mock.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace home_task::network_mock;
+
+namespace {
+
+// as tcp_retries2 of Linux, a link that drops everything still delivers after so many drops
+constexpr uint32_t MaxRetransmits = 15;
+
+}
+
+NetworkSimulation::NetworkSimulation(const SimulationSettings &_settings, TDeliver &&_deliver)
+    : Settings_(_settings)
+    , Deliver_(std::move(_deliver))
+    , Start_(TClock::now())
+    , Wheel_(WheelSize)
+    , Random_(_settings.Seed_)
+{
+    if (Settings_.Tick_.count() <= 0) {
+        Settings_.Tick_ = std::chrono::microseconds(1);
+    }
+    Thread_ = std::thread(&NetworkSimulation::Run, this);
+}
+
+NetworkSimulation::~NetworkSimulation() {
+    {
+        std::lock_guard lock(Mutex_);
+        Stopped_ = true;
+    }
+    WakeUp_.notify_one();
+    Thread_.join();
+    uint64_t count = 0;
+    for (auto &slot : Wheel_) {
+        for (auto &timer : slot) {
+            delete timer.Message_;
+            count++;
+        }
+    }
+    log::WriteDestructor("~NetworkSimulation in flight# ", count);
+}
+
+NetworkSimulation::Link& NetworkSimulation::GetLink(model::ClientId _sender, model::ClientId _receiver) {
+    uint64_t key = SimulationSettings::LinkKey(_sender, _receiver);
+    auto it = Links_.find(key);
+    if (it == Links_.end()) {
+        auto settingsIt = Settings_.Links_.find(key);
+        Link link{
+            .Settings_ = (settingsIt != Settings_.Links_.end() ? settingsIt->second : Settings_.Default_),
+            .BusyUntil_ = TClock::now(),
+            .LastDelivery_ = TClock::now(),
+        };
+        it = Links_.emplace(key, link).first;
+    }
+    return it->second;
+}
+
+void NetworkSimulation::SetLink(model::ClientId _sender, model::ClientId _receiver, const LinkSettings &_settings) {
+    std::lock_guard lock(Mutex_);
+    Settings_.SetLink(_sender, _receiver, _settings);
+    GetLink(_sender, _receiver).Settings_ = _settings;
+}
+
+std::chrono::microseconds home_task::network_mock::SampleLatency(const LinkSettings &_settings, std::mt19937_64 &_random) {
+    double latency = _settings.Latency_.count();
+    double jitter = _settings.Jitter_.count();
+    switch (_settings.Distribution_) {
+    case ELatencyDistribution::Constant:
+        break;
+    case ELatencyDistribution::Uniform:
+        latency = std::uniform_real_distribution<double>(latency - jitter, latency + jitter)(_random);
+        break;
+    case ELatencyDistribution::Normal:
+        latency = std::normal_distribution<double>(latency, jitter)(_random);
+        break;
+    case ELatencyDistribution::Exponential:
+        if (jitter > 0) {
+            latency += std::exponential_distribution<double>(1 / jitter)(_random);
+        }
+        break;
+    }
+    return std::chrono::microseconds(static_cast<int64_t>(std::max(latency, 0.0)));
+}
+
+std::chrono::microseconds home_task::network_mock::SampleRetransmits(const LinkSettings &_settings, std::mt19937_64 &_random, uint64_t *_drops) {
+    std::chrono::microseconds delay{0};
+    if (_settings.DropProbability_ <= 0) {
+        return delay;
+    }
+    auto timeout = std::max(_settings.RetransmitTimeout_, std::chrono::microseconds(1));
+    for (uint32_t drops = 0; drops < MaxRetransmits && std::bernoulli_distribution(_settings.DropProbability_)(_random); ++drops) {
+        delay += timeout;
+        timeout *= 2;
+        ++*_drops;
+    }
+    return delay;
+}
+
+NetworkSimulation::TClock::duration NetworkSimulation::SampleLatency(const LinkSettings &_settings) {
+    return std::chrono::duration_cast<TClock::duration>(network_mock::SampleLatency(_settings, Random_));
+}
+
+uint64_t NetworkSimulation::ToTick(TClock::time_point _time) const {
+    if (_time <= Start_) {
+        return 0;
+    }
+    // rounded up, a message is never delivered before its time
+    auto tick = std::chrono::duration_cast<TClock::duration>(Settings_.Tick_);
+    return (_time - Start_ + tick - TClock::duration(1)) / tick;
+}
+
+void NetworkSimulation::Send(model::ClientId _receiver, MessageRecord *_msg) {
+    auto now = TClock::now();
+    std::unique_lock lock(Mutex_);
+    Link &link = GetLink(_msg->Sender_, _receiver);
+    const LinkSettings &settings = link.Settings_;
+    SentCount_++;
+    SentBytes_ += _msg->Size_;
+
+    // the link transmits one message at a time, the message leaves when its last byte is sent
+    auto sent = now;
+    if (settings.BytesPerSecond_) {
+        auto transmission = std::chrono::duration_cast<TClock::duration>(
+                std::chrono::duration<double>(static_cast<double>(_msg->Size_) / settings.BytesPerSecond_));
+        link.BusyUntil_ = std::max(link.BusyUntil_, now) + transmission;
+        sent = link.BusyUntil_;
+    }
+    bool isControl = _msg->Type_ < static_cast<uint32_t>(EMessageType::PRIVATE);
+    if (!isControl) {
+        auto retransmits = network_mock::SampleRetransmits(settings, Random_, &DroppedCount_);
+        if (retransmits.count()) {
+            log::WriteNetwork("NetworkSimulation::Send{drop ", _msg->Sender_, "->", _receiver, ", resent after ", retransmits.count(), "us}");
+            sent += retransmits;
+        }
+    }
+    auto delivery = sent + SampleLatency(settings);
+    if (settings.ReorderProbability_ > 0 && std::bernoulli_distribution(settings.ReorderProbability_)(Random_)) {
+        ReorderedCount_++;
+    } else {
+        delivery = std::max(delivery, link.LastDelivery_);
+    }
+    link.LastDelivery_ = std::max(link.LastDelivery_, delivery);
+
+    // an idle wheel stands at the tick it stopped at, move it to now, or a message due before
+    // the thread wakes up would fall behind the wheel and wait for its next round
+    if (!InFlight_) {
+        CurrentTick_ = std::max(CurrentTick_, ToTick(now));
+    }
+    uint64_t tick = std::max(ToTick(delivery), CurrentTick_);
+    Wheel_[tick % WheelSize].push_back(Timer{.Tick_ = tick, .Receiver_ = _receiver, .Message_ = _msg});
+    bool wasIdle = !InFlight_++;
+    lock.unlock();
+    if (wasIdle) {
+        WakeUp_.notify_one();
+    }
+}
+
+void NetworkSimulation::Run() {
+    std::unique_lock lock(Mutex_);
+    while (!Stopped_) {
+        if (!InFlight_) {
+            // Send moves the idle wheel to its time, the ticks up to now are scanned below
+            WakeUp_.wait(lock, [&] { return Stopped_ || InFlight_; });
+            continue;
+        }
+        uint64_t nowTick = ToTick(TClock::now());
+        for (; CurrentTick_ <= nowTick && InFlight_; ++CurrentTick_) {
+            auto &slot = Wheel_[CurrentTick_ % WheelSize];
+            if (slot.empty()) {
+                continue;
+            }
+            // later rounds of the wheel stay in the slot in their order
+            auto middle = std::stable_partition(slot.begin(), slot.end(), [&] (const Timer &_timer) {
+                return _timer.Tick_ <= CurrentTick_;
+            });
+            Due_.insert(Due_.end(), slot.begin(), middle);
+            slot.erase(slot.begin(), middle);
+            InFlight_ -= Due_.size();
+            for (auto &timer : Due_) {
+                Deliver_(timer.Receiver_, timer.Message_);
+            }
+            Due_.clear();
+        }
+        CurrentTick_ = std::max(CurrentTick_, nowTick + 1);
+        WakeUp_.wait_until(lock, Start_ + CurrentTick_ * Settings_.Tick_);
+    }
+}
+
+std::string NetworkSimulation::PrintStat() const {
+    std::lock_guard lock(Mutex_);
+    std::ostringstream sout;
+    sout << "Network Sent# " << SentCount_
+        << " SentBytes# " << SentBytes_
+        << " Dropped# " << DroppedCount_
+        << " Reordered# " << ReorderedCount_
+        << " InFlight# " << InFlight_ << std::endl;
+    return sout.str();
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "model.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace home_task::network_mock {
+
+struct MessageRecord;
+
+enum class ELatencyDistribution : uint32_t {
+    Constant,
+    // Latency_ +- Jitter_
+    Uniform,
+    // mean Latency_, standard deviation Jitter_
+    Normal,
+    // Latency_ is the minimum, Jitter_ is the mean of the exponential tail
+    Exponential,
+};
+
+struct LinkSettings {
+    ELatencyDistribution Distribution_ = ELatencyDistribution::Constant;
+    std::chrono::microseconds Latency_{0};
+    std::chrono::microseconds Jitter_{0};
+    // 0 means unlimited, otherwise messages of the link are serialized with their Size_
+    uint64_t BytesPerSecond_ = 0;
+    // chance that a message ignores the link order and may overtake the previous ones
+    double ReorderProbability_ = 0;
+    // Chance that a copy of a message is lost, control messages (Poison, Connect, ...) are never dropped.
+    // The protocol has no timeouts and no resends, it relies on the transport as on TCP under the sockets,
+    // so the link sends a dropped message again after the timeout, doubled for every next drop of it.
+    // A drop costs the delay and holds the next messages of an ordered link, the message is never lost.
+    double DropProbability_ = 0;
+    std::chrono::microseconds RetransmitTimeout_{200'000};
+};
+
+// Latency of one message of the link, also used by the event simulation.
+std::chrono::microseconds SampleLatency(const LinkSettings &_settings, std::mt19937_64 &_random);
+
+// Delay of one message of the link by the drops of its copies, the count of the drops is added to _drops.
+std::chrono::microseconds SampleRetransmits(const LinkSettings &_settings, std::mt19937_64 &_random, uint64_t *_drops);
+
+struct SimulationSettings {
+    LinkSettings Default_;
+    // settings of the directed link sender -> receiver
+    std::unordered_map<uint64_t, LinkSettings> Links_;
+    std::chrono::microseconds Tick_{100};
+    uint64_t Seed_ = 0;
+
+    static uint64_t LinkKey(model::ClientId _sender, model::ClientId _receiver) {
+        return (static_cast<uint64_t>(_sender) << 32) | static_cast<uint32_t>(_receiver);
+    }
+
+    void SetLink(model::ClientId _sender, model::ClientId _receiver, const LinkSettings &_settings) {
+        Links_[LinkKey(_sender, _receiver)] = _settings;
+    }
+};
+
+// Delays messages of NetworkMock as a real network would.
+// Every message gets a delivery time from its link (bandwidth queue, latency, order)
+// and waits in a hashed timer wheel, a single thread moves due slots to the mailboxes.
+// Adding a message and delivering it are O(1), so thousands of messages in flight
+// cost only their wheel entries.
+class NetworkSimulation {
+public:
+    using TClock = std::chrono::steady_clock;
+    using TDeliver = std::function<void(model::ClientId, MessageRecord*)>;
+
+    NetworkSimulation(const SimulationSettings &_settings, TDeliver &&_deliver);
+
+    ~NetworkSimulation();
+
+    // takes the ownership of _msg, Sender_ must be already set
+    void Send(model::ClientId _receiver, MessageRecord *_msg);
+
+    void SetLink(model::ClientId _sender, model::ClientId _receiver, const LinkSettings &_settings);
+
+    std::string PrintStat() const;
+
+private:
+    static constexpr uint64_t WheelSize = 4096;
+
+    struct Timer {
+        uint64_t Tick_;
+        model::ClientId Receiver_;
+        MessageRecord *Message_;
+    };
+
+    struct Link {
+        LinkSettings Settings_;
+        TClock::time_point BusyUntil_;
+        TClock::time_point LastDelivery_;
+    };
+
+    Link& GetLink(model::ClientId _sender, model::ClientId _receiver);
+    TClock::duration SampleLatency(const LinkSettings &_settings);
+    uint64_t ToTick(TClock::time_point _time) const;
+    void Run();
+
+    SimulationSettings Settings_;
+    TDeliver Deliver_;
+    TClock::time_point Start_;
+
+    mutable std::mutex Mutex_;
+    std::condition_variable WakeUp_;
+    std::vector<std::vector<Timer>> Wheel_;
+    std::vector<Timer> Due_;
+    uint64_t CurrentTick_ = 0;
+    uint64_t InFlight_ = 0;
+    std::unordered_map<uint64_t, Link> Links_;
+    std::mt19937_64 Random_;
+    bool Stopped_ = false;
+
+    uint64_t SentCount_ = 0;
+    uint64_t DroppedCount_ = 0;
+    uint64_t ReorderedCount_ = 0;
+    uint64_t SentBytes_ = 0;
+
+    std::thread Thread_;
+};
+
+}
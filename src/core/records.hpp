@@ -0,0 +1,258 @@
+#pragma once
+
+#include "magic_numbers.hpp"
+#include "model.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+// Message types and payloads, everything a message can carry.
+// Kept apart from network_mock.hpp and api.hpp so that MessageRecord can hold them by value.
+namespace home_task::network_mock {
+
+enum class EMessageType : uint32_t {
+    Ping,
+    Pong,
+    String,
+    Poison,
+    Connect,
+    PRIVATE = 1024
+};
+
+}
+
+namespace home_task::api {
+
+enum class EAPIEventsType : uint32_t {
+    Begin = static_cast<uint32_t>(network_mock::EMessageType::PRIVATE),
+    LoadStateRequest = Begin,
+    UpdateValueRequest,
+    InsertValueRequest,
+    DeleteValueRequest,
+    SyncRequest,
+    ResumeRequest,
+    OpenArrayRequest,
+    SubscribeRequest,
+    PushAckRequest,
+
+    State = Begin + 1024,
+    UpdateValueResponse,
+    InsertValueResponse,
+    DeleteValueResponse,
+    SyncResponse,
+    PushResponse,
+};
+
+
+struct LoadStateRequest {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::LoadStateRequest;
+
+    model::IterationId PreviousIteration_ = 0;
+
+    LoadStateRequest(model::IterationId _iteration)
+        : PreviousIteration_(_iteration)
+    {}
+
+    uint32_t CalculateSize() const {
+        return sizeof(PreviousIteration_);
+    }
+};
+
+struct UpdateValueRequest {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::UpdateValueRequest;
+
+    model::IterationId PreviousIteration_ = 0;
+    model::CellId CellId_;
+    model::Value Value_;
+
+    UpdateValueRequest(model::CellId _cellId, model::Value _value, model::IterationId _iteration)
+        : PreviousIteration_(_iteration)
+        , CellId_(_cellId)
+        , Value_(_value)
+    {}
+
+    uint32_t CalculateSize() const {
+        return sizeof(PreviousIteration_) + sizeof(CellId_) + sizeof(Value_);
+    }
+};
+
+struct InsertValueRequest {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::InsertValueRequest;
+
+    model::IterationId PreviousIteration_ = 0;
+    model::CellId NearCellId_;
+    model::Value Value_;
+
+    InsertValueRequest(model::CellId _cellId, model::Value _value, model::IterationId _iteration)
+        : PreviousIteration_(_iteration)
+        , NearCellId_(_cellId)
+        , Value_(_value)
+    {}
+
+    uint32_t CalculateSize() const {
+        return sizeof(PreviousIteration_) + sizeof(NearCellId_) + sizeof(Value_);
+    }
+};
+
+struct DeleteValueRequest {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::DeleteValueRequest;
+
+    model::IterationId PreviousIteration_ = 0;
+    model::CellId CellId_;
+
+    DeleteValueRequest(model::CellId _cellId, model::IterationId _iteration)
+        : PreviousIteration_(_iteration)
+        , CellId_(_cellId)
+    {}
+
+    uint32_t CalculateSize() const {
+        return sizeof(PreviousIteration_) + sizeof(CellId_);
+    }
+};
+
+struct SyncRequest {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::SyncRequest;
+
+    model::IterationId PreviousIteration_ = 0;
+
+    SyncRequest(model::IterationId _iteration)
+        : PreviousIteration_(_iteration)
+    {}
+
+    uint32_t CalculateSize() const {
+        return sizeof(PreviousIteration_);
+    }
+};
+
+// Sent by a client restored from a snapshot instead of LoadStateRequest,
+// the server answers with the missing history or with the whole state when the history is cut
+// or the snapshot is of another array.
+struct ResumeRequest {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::ResumeRequest;
+
+    model::IterationId PreviousIteration_ = 0;
+    model::EpochId Epoch_ = 0;
+
+    ResumeRequest(model::IterationId _iteration, model::EpochId _epoch)
+        : PreviousIteration_(_iteration)
+        , Epoch_(_epoch)
+    {}
+
+    uint32_t CalculateSize() const {
+        return sizeof(PreviousIteration_) + sizeof(Epoch_);
+    }
+};
+
+// Binds the client to one of the arrays of a multi-array server, its next requests go to that array.
+struct OpenArrayRequest {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::OpenArrayRequest;
+
+    model::ArrayId ArrayId_ = 0;
+
+    OpenArrayRequest(model::ArrayId _arrayId)
+        : ArrayId_(_arrayId)
+    {}
+
+    uint32_t CalculateSize() const {
+        return sizeof(ArrayId_);
+    }
+};
+
+// The server pushes the history to the client after every batch that changed the array instead of waiting
+// for SyncRequest. At most Window_ pushes are unacknowledged, while the window is full the changes
+// are gathered into the next push.
+struct SubscribeRequest {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::SubscribeRequest;
+
+    model::IterationId PreviousIteration_ = 0;
+    uint32_t Window_ = 1;
+
+    SubscribeRequest(model::IterationId _iteration, uint32_t _window)
+        : PreviousIteration_(_iteration)
+        , Window_(_window)
+    {}
+
+    uint32_t CalculateSize() const {
+        return sizeof(PreviousIteration_) + sizeof(Window_);
+    }
+};
+
+// Acknowledges a push, the server sends nothing back.
+struct PushAckRequest {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::PushAckRequest;
+
+    model::IterationId Iteration_ = 0;
+
+    PushAckRequest(model::IterationId _iteration)
+        : Iteration_(_iteration)
+    {}
+
+    uint32_t CalculateSize() const {
+        return sizeof(Iteration_);
+    }
+};
+
+struct GenericResponse {
+    std::vector<model::UpdateValue> Updates_;
+    std::vector<model::InsertValue> Insertions_;
+    std::vector<model::DeleteValue> Deletions_;
+    model::IterationId Iteration_ = 0;
+
+    GenericResponse() = default;
+
+    uint32_t CalculateSize() const;
+    uint32_t CalculateDiffSize(model::IterationId _iteration) const;
+};
+
+struct State : GenericResponse {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::State;
+
+    std::vector<model::Cell> Cells_;
+    model::IterationId Iteration_ = 0;
+    // the array of the server, a snapshot keeps it to resume only on the same array
+    model::EpochId Epoch_ = 0;
+
+    State(std::vector<model::Cell> &&_cells) : Cells_(std::move(_cells))
+    {}
+
+    uint32_t CalculateSize() const;
+};
+
+struct UpdateValueResponse : GenericResponse {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::UpdateValueResponse;
+
+    using GenericResponse::GenericResponse;
+};
+
+struct InsertValueResponse : GenericResponse {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::InsertValueResponse;
+
+    model::CellId CellId_;
+
+    InsertValueResponse(uint64_t _cellId)
+        : CellId_(_cellId)
+    {}
+
+    uint32_t CalculateSize() const;
+};
+
+struct DeleteValueResponse : GenericResponse {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::DeleteValueResponse;
+
+    using GenericResponse::GenericResponse;
+};
+
+struct SyncResponse : GenericResponse {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::SyncResponse;
+
+    using GenericResponse::GenericResponse;
+};
+
+struct PushResponse : GenericResponse {
+    static constexpr EAPIEventsType Type_ = EAPIEventsType::PushResponse;
+
+    using GenericResponse::GenericResponse;
+};
+
+}
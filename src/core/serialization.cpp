@@ -0,0 +1,456 @@
+#include "serialization.hpp"
+#include "columnar.hpp"
+#include "compact.hpp"
+
+using namespace home_task;
+using namespace home_task::wire;
+using namespace home_task::api;
+using namespace home_task::network_mock;
+
+
+namespace {
+
+void PutGenericResponse(Writer &_writer, const GenericResponse &_response, model::IterationId _iteration) {
+    if constexpr (magic_numbers::WithCompactDiff) {
+        PutCompactDiff(_writer, _response, _iteration);
+        return;
+    }
+    _writer.PutU64(_iteration);
+    _writer.PutArray(_response.Updates_);
+    _writer.PutArray(_response.Insertions_);
+    _writer.PutArray(_response.Deletions_);
+}
+
+void GetGenericResponse(Reader &_reader, GenericResponseView *_view) {
+    _view->Iteration_ = _reader.GetU64();
+    _view->Updates_ = _reader.GetArray<model::UpdateValue>();
+    _view->Insertions_ = _reader.GetArray<model::InsertValue>();
+    _view->Deletions_ = _reader.GetArray<model::DeleteValue>();
+}
+
+void FillGenericResponse(const GenericResponseView &_view, GenericResponse *_response) {
+    _response->Updates_.assign(_view.Updates_.begin(), _view.Updates_.end());
+    _response->Insertions_.assign(_view.Insertions_.begin(), _view.Insertions_.end());
+    _response->Deletions_.assign(_view.Deletions_.begin(), _view.Deletions_.end());
+    _response->Iteration_ = _view.Iteration_;
+}
+
+template <typename _Record>
+std::unique_ptr<MessageRecord> MakeMessage(_Record &&_record, const MessageView &_view) {
+    auto msg = std::make_unique<MessageRecord>();
+    msg->Type_ = _view.Type_;
+    msg->Sender_ = _view.Sender_;
+    msg->Size_ = _view.FullSize();
+    msg->Record_.template emplace<std::decay_t<_Record>>(std::forward<_Record>(_record));
+    return msg;
+}
+
+bool IsResponseType(uint32_t _type) {
+    return _type >= (uint32_t)EAPIEventsType::State && _type <= (uint32_t)EAPIEventsType::PushResponse;
+}
+
+uint8_t GetFlags(uint32_t _type) {
+    uint8_t flags = EFlags::Plain;
+    if (magic_numbers::WithCompactDiff && IsResponseType(_type)) {
+        flags |= EFlags::CompactDiff;
+    }
+    if (magic_numbers::WithColumnarState && _type == (uint32_t)EAPIEventsType::State) {
+        flags |= EFlags::ColumnarState;
+    }
+    return flags;
+}
+
+// Compact diffs can't be viewed in place, they're decoded into the response arrays.
+template <typename _Response>
+bool GetCompactResponse(Reader &_reader, _Response *_response) {
+    auto iteration = GetCompactDiff(_reader, _response);
+    if (!iteration) {
+        return false;
+    }
+    _response->Iteration_ = *iteration;
+    return true;
+}
+
+std::unique_ptr<MessageRecord> DecodeCompactResponse(const MessageView &_message) {
+    Reader reader(_message.Body_, _message.BodySize_);
+    switch (_message.Type_) {
+    case (uint32_t)EAPIEventsType::InsertValueResponse: {
+        InsertValueResponse response(0);
+        if (!GetCompactResponse(reader, &response)) {
+            return nullptr;
+        }
+        response.CellId_ = reader.GetU64();
+        if (!reader.Finished()) {
+            return nullptr;
+        }
+        return MakeMessage(std::move(response), _message);
+    }
+    case (uint32_t)EAPIEventsType::UpdateValueResponse: {
+        UpdateValueResponse response;
+        if (!GetCompactResponse(reader, &response) || !reader.Finished()) {
+            return nullptr;
+        }
+        return MakeMessage(std::move(response), _message);
+    }
+    case (uint32_t)EAPIEventsType::DeleteValueResponse: {
+        DeleteValueResponse response;
+        if (!GetCompactResponse(reader, &response) || !reader.Finished()) {
+            return nullptr;
+        }
+        return MakeMessage(std::move(response), _message);
+    }
+    case (uint32_t)EAPIEventsType::SyncResponse: {
+        SyncResponse response;
+        if (!GetCompactResponse(reader, &response) || !reader.Finished()) {
+            return nullptr;
+        }
+        return MakeMessage(std::move(response), _message);
+    }
+    case (uint32_t)EAPIEventsType::PushResponse: {
+        PushResponse response;
+        if (!GetCompactResponse(reader, &response) || !reader.Finished()) {
+            return nullptr;
+        }
+        return MakeMessage(std::move(response), _message);
+    }
+    }
+    return nullptr;
+}
+
+std::unique_ptr<MessageRecord> DecodeState(const MessageView &_message) {
+    Reader reader(_message.Body_, _message.BodySize_);
+    State state({});
+    if (_message.Flags_ & EFlags::CompactDiff) {
+        if (!GetCompactResponse(reader, &state)) {
+            return nullptr;
+        }
+    } else {
+        GenericResponseView view;
+        GetGenericResponse(reader, &view);
+        FillGenericResponse(view, &state);
+        state.Iteration_ = view.Iteration_;
+    }
+    state.Epoch_ = reader.GetU64();
+    if (_message.Flags_ & EFlags::ColumnarState) {
+        GetColumnarCells(reader, &state.Cells_);
+    } else {
+        auto cells = reader.GetArray<model::Cell>();
+        state.Cells_.assign(cells.begin(), cells.end());
+    }
+    if (!reader.Finished()) {
+        return nullptr;
+    }
+    return MakeMessage(std::move(state), _message);
+}
+
+template <typename _Record>
+void PutBody(Writer &_writer, const _Record &_record) {
+    if constexpr (std::is_same_v<_Record, LoadStateRequest> || std::is_same_v<_Record, SyncRequest>) {
+        _writer.PutU64(_record.PreviousIteration_);
+    }
+    if constexpr (std::is_same_v<_Record, ResumeRequest>) {
+        _writer.PutU64(_record.PreviousIteration_);
+        _writer.PutU64(_record.Epoch_);
+    }
+    if constexpr (std::is_same_v<_Record, OpenArrayRequest>) {
+        _writer.PutU64(_record.ArrayId_);
+    }
+    if constexpr (std::is_same_v<_Record, SubscribeRequest>) {
+        _writer.PutU64(_record.PreviousIteration_);
+        _writer.PutU32(_record.Window_);
+    }
+    if constexpr (std::is_same_v<_Record, PushAckRequest>) {
+        _writer.PutU64(_record.Iteration_);
+    }
+    if constexpr (std::is_same_v<_Record, UpdateValueRequest>) {
+        _writer.PutU64(_record.PreviousIteration_);
+        _writer.PutU64(_record.CellId_);
+        _writer.PutU32(_record.Value_);
+    }
+    if constexpr (std::is_same_v<_Record, InsertValueRequest>) {
+        _writer.PutU64(_record.PreviousIteration_);
+        _writer.PutU64(_record.NearCellId_);
+        _writer.PutU32(_record.Value_);
+    }
+    if constexpr (std::is_same_v<_Record, DeleteValueRequest>) {
+        _writer.PutU64(_record.PreviousIteration_);
+        _writer.PutU64(_record.CellId_);
+    }
+    if constexpr (std::is_same_v<_Record, UpdateValueResponse>
+            || std::is_same_v<_Record, DeleteValueResponse>
+            || std::is_same_v<_Record, SyncResponse>
+            || std::is_same_v<_Record, PushResponse>) {
+        PutGenericResponse(_writer, _record, _record.Iteration_);
+    }
+    if constexpr (std::is_same_v<_Record, InsertValueResponse>) {
+        PutGenericResponse(_writer, _record, _record.Iteration_);
+        _writer.PutU64(_record.CellId_);
+    }
+    if constexpr (std::is_same_v<_Record, State>) {
+        PutGenericResponse(_writer, _record, _record.Iteration_);
+        _writer.PutU64(_record.Epoch_);
+        if constexpr (magic_numbers::WithColumnarState) {
+            PutColumnarCells(_writer, _record.Cells_);
+        } else {
+            _writer.PutArray(_record.Cells_);
+        }
+    }
+}
+
+template <typename _Record>
+bool PutRecord(Writer &_writer, const MessageRecord &_message) {
+    auto record = std::get_if<_Record>(&_message.Record_);
+    if (!record) {
+        return false;
+    }
+    PutBody(_writer, *record);
+    return true;
+}
+
+}
+
+
+std::optional<MessageView> wire::ParseMessage(const uint8_t *_data, uint64_t _size, bool *_malformed) {
+    if (_size < LengthSize) {
+        return std::nullopt;
+    }
+    uint32_t length = LoadU32(_data);
+    // a length shorter than the header would wrap BodySize_ around
+    if (length < HeaderSize - LengthSize) {
+        if (_malformed) {
+            *_malformed = true;
+        }
+        return std::nullopt;
+    }
+    if (_size < LengthSize + static_cast<uint64_t>(length)) {
+        return std::nullopt;
+    }
+    MessageView view;
+    view.Version_ = _data[4];
+    view.Flags_ = _data[5];
+    view.Type_ = LoadU32(_data + 8);
+    view.Sender_ = LoadU32(_data + 12);
+    view.Body_ = _data + HeaderSize;
+    view.BodySize_ = length + LengthSize - HeaderSize;
+    return view;
+}
+
+std::optional<GenericResponseView> wire::ViewGenericResponse(const MessageView &_message) {
+    if (_message.Flags_ & EFlags::CompactDiff) {
+        return std::nullopt;
+    }
+    Reader reader(_message.Body_, _message.BodySize_);
+    GenericResponseView view;
+    GetGenericResponse(reader, &view);
+    if (!reader.Finished()) {
+        return std::nullopt;
+    }
+    return view;
+}
+
+std::optional<InsertValueResponseView> wire::ViewInsertValueResponse(const MessageView &_message) {
+    if (_message.Flags_ & EFlags::CompactDiff) {
+        return std::nullopt;
+    }
+    Reader reader(_message.Body_, _message.BodySize_);
+    InsertValueResponseView view;
+    GetGenericResponse(reader, &view);
+    view.CellId_ = reader.GetU64();
+    if (!reader.Finished()) {
+        return std::nullopt;
+    }
+    return view;
+}
+
+std::optional<StateView> wire::ViewState(const MessageView &_message) {
+    if (_message.Flags_ & (EFlags::CompactDiff | EFlags::ColumnarState)) {
+        return std::nullopt;
+    }
+    Reader reader(_message.Body_, _message.BodySize_);
+    StateView view;
+    GetGenericResponse(reader, &view);
+    view.Epoch_ = reader.GetU64();
+    view.Cells_ = reader.GetArray<model::Cell>();
+    if (!reader.Finished()) {
+        return std::nullopt;
+    }
+    return view;
+}
+
+uint32_t wire::Encode(const MessageRecord &_message, Buffer *_buffer) {
+    size_t begin = _buffer->size();
+    Writer writer{_buffer};
+    writer.PutU32(0);
+    writer.PutU8(Version);
+    writer.PutU8(GetFlags(_message.Type_));
+    writer.PutU16(0);
+    writer.PutU32(_message.Type_);
+    writer.PutU32(_message.Sender_);
+
+    switch (_message.Type_) {
+    case (uint32_t)EMessageType::String:
+        if (auto str = std::get_if<std::string>(&_message.Record_)) {
+            writer.PutBytes(*str);
+        }
+        break;
+    case (uint32_t)EAPIEventsType::LoadStateRequest:
+        PutRecord<LoadStateRequest>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::UpdateValueRequest:
+        PutRecord<UpdateValueRequest>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::InsertValueRequest:
+        PutRecord<InsertValueRequest>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::DeleteValueRequest:
+        PutRecord<DeleteValueRequest>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::SyncRequest:
+        PutRecord<SyncRequest>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::ResumeRequest:
+        PutRecord<ResumeRequest>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::OpenArrayRequest:
+        PutRecord<OpenArrayRequest>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::SubscribeRequest:
+        PutRecord<SubscribeRequest>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::PushAckRequest:
+        PutRecord<PushAckRequest>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::State:
+        PutRecord<State>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::UpdateValueResponse:
+        PutRecord<UpdateValueResponse>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::InsertValueResponse:
+        PutRecord<InsertValueResponse>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::DeleteValueResponse:
+        PutRecord<DeleteValueResponse>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::SyncResponse:
+        PutRecord<SyncResponse>(writer, _message);
+        break;
+    case (uint32_t)EAPIEventsType::PushResponse:
+        PutRecord<PushResponse>(writer, _message);
+        break;
+    }
+
+    uint32_t size = _buffer->size() - begin;
+    StoreU32(_buffer->data() + begin, size - LengthSize);
+    return size;
+}
+
+std::unique_ptr<MessageRecord> wire::Decode(const MessageView &_message) {
+    if (_message.Version_ != Version) {
+        log::WriteNetwork("wire::Decode{unsupported version ", (uint32_t)_message.Version_, '}');
+        return nullptr;
+    }
+    if (_message.Type_ == (uint32_t)EAPIEventsType::State) {
+        return DecodeState(_message);
+    }
+    if (_message.Flags_ & EFlags::CompactDiff) {
+        return DecodeCompactResponse(_message);
+    }
+    Reader reader(_message.Body_, _message.BodySize_);
+    std::unique_ptr<MessageRecord> msg;
+
+    switch (_message.Type_) {
+    case (uint32_t)EMessageType::Ping:
+    case (uint32_t)EMessageType::Pong:
+    case (uint32_t)EMessageType::Poison:
+    case (uint32_t)EMessageType::Connect:
+        msg = std::make_unique<MessageRecord>();
+        msg->Type_ = _message.Type_;
+        msg->Sender_ = _message.Sender_;
+        msg->Size_ = _message.FullSize();
+        break;
+    case (uint32_t)EMessageType::String:
+        msg = MakeMessage(std::string(reader.GetBytes()), _message);
+        break;
+    case (uint32_t)EAPIEventsType::LoadStateRequest:
+        msg = MakeMessage(LoadStateRequest(reader.GetU64()), _message);
+        break;
+    case (uint32_t)EAPIEventsType::UpdateValueRequest: {
+        model::IterationId iteration = reader.GetU64();
+        model::CellId cellId = reader.GetU64();
+        msg = MakeMessage(UpdateValueRequest(cellId, reader.GetU32(), iteration), _message);
+        break;
+    }
+    case (uint32_t)EAPIEventsType::InsertValueRequest: {
+        model::IterationId iteration = reader.GetU64();
+        model::CellId cellId = reader.GetU64();
+        msg = MakeMessage(InsertValueRequest(cellId, reader.GetU32(), iteration), _message);
+        break;
+    }
+    case (uint32_t)EAPIEventsType::DeleteValueRequest: {
+        model::IterationId iteration = reader.GetU64();
+        msg = MakeMessage(DeleteValueRequest(reader.GetU64(), iteration), _message);
+        break;
+    }
+    case (uint32_t)EAPIEventsType::SyncRequest:
+        msg = MakeMessage(SyncRequest(reader.GetU64()), _message);
+        break;
+    case (uint32_t)EAPIEventsType::ResumeRequest: {
+        model::IterationId iteration = reader.GetU64();
+        msg = MakeMessage(ResumeRequest(iteration, reader.GetU64()), _message);
+        break;
+    }
+    case (uint32_t)EAPIEventsType::OpenArrayRequest:
+        msg = MakeMessage(OpenArrayRequest(reader.GetU64()), _message);
+        break;
+    case (uint32_t)EAPIEventsType::SubscribeRequest: {
+        model::IterationId iteration = reader.GetU64();
+        msg = MakeMessage(SubscribeRequest(iteration, reader.GetU32()), _message);
+        break;
+    }
+    case (uint32_t)EAPIEventsType::PushAckRequest:
+        msg = MakeMessage(PushAckRequest(reader.GetU64()), _message);
+        break;
+    case (uint32_t)EAPIEventsType::InsertValueResponse: {
+        auto view = ViewInsertValueResponse(_message);
+        if (!view) {
+            return nullptr;
+        }
+        InsertValueResponse response(view->CellId_);
+        FillGenericResponse(*view, &response);
+        return MakeMessage(std::move(response), _message);
+    }
+    case (uint32_t)EAPIEventsType::UpdateValueResponse:
+    case (uint32_t)EAPIEventsType::DeleteValueResponse:
+    case (uint32_t)EAPIEventsType::SyncResponse:
+    case (uint32_t)EAPIEventsType::PushResponse: {
+        auto view = ViewGenericResponse(_message);
+        if (!view) {
+            return nullptr;
+        }
+        if (_message.Type_ == (uint32_t)EAPIEventsType::UpdateValueResponse) {
+            UpdateValueResponse response;
+            FillGenericResponse(*view, &response);
+            return MakeMessage(std::move(response), _message);
+        } else if (_message.Type_ == (uint32_t)EAPIEventsType::DeleteValueResponse) {
+            DeleteValueResponse response;
+            FillGenericResponse(*view, &response);
+            return MakeMessage(std::move(response), _message);
+        } else if (_message.Type_ == (uint32_t)EAPIEventsType::PushResponse) {
+            PushResponse response;
+            FillGenericResponse(*view, &response);
+            return MakeMessage(std::move(response), _message);
+        }
+        SyncResponse response;
+        FillGenericResponse(*view, &response);
+        return MakeMessage(std::move(response), _message);
+    }
+    default:
+        return nullptr;
+    }
+
+    if (!reader.Finished()) {
+        return nullptr;
+    }
+    return msg;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "api.hpp"
+#include "wire.hpp"
+
+#include <memory>
+#include <optional>
+
+
+namespace home_task::wire {
+
+struct MessageView {
+    uint32_t Type_ = 0;
+    model::ClientId Sender_ = 0;
+    uint8_t Version_ = Version;
+    uint8_t Flags_ = EFlags::Plain;
+    const uint8_t *Body_ = nullptr;
+    uint32_t BodySize_ = 0;
+
+    // Bytes taken by the whole message including the header.
+    uint32_t FullSize() const {
+        return HeaderSize + BodySize_;
+    }
+};
+
+struct GenericResponseView {
+    model::IterationId Iteration_ = 0;
+    ArrayView<model::UpdateValue> Updates_;
+    ArrayView<model::InsertValue> Insertions_;
+    ArrayView<model::DeleteValue> Deletions_;
+};
+
+struct StateView : GenericResponseView {
+    model::EpochId Epoch_ = 0;
+    ArrayView<model::Cell> Cells_;
+};
+
+struct InsertValueResponseView : GenericResponseView {
+    model::CellId CellId_ = 0;
+};
+
+// Parses the header at the beginning of the buffer.
+// Returns std::nullopt while the buffer doesn't hold the whole message yet
+// and for a length shorter than the header, the latter sets _malformed.
+std::optional<MessageView> ParseMessage(const uint8_t *_data, uint64_t _size, bool *_malformed = nullptr);
+
+// Views point into the message body, the buffer must outlive them.
+std::optional<GenericResponseView> ViewGenericResponse(const MessageView &_message);
+std::optional<InsertValueResponseView> ViewInsertValueResponse(const MessageView &_message);
+std::optional<StateView> ViewState(const MessageView &_message);
+
+// Appends the encoded message to the buffer and returns the number of written bytes.
+uint32_t Encode(const network_mock::MessageRecord &_message, Buffer *_buffer);
+
+// Builds an owning message from the view, returns nullptr for malformed or unknown messages.
+std::unique_ptr<network_mock::MessageRecord> Decode(const MessageView &_message);
+
+}
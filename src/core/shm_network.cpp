@@ -0,0 +1,585 @@
+#include "shm_network.hpp"
+#include "api.hpp"
+#include "serialization.hpp"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+using namespace home_task::shm_network;
+using namespace home_task::network_mock;
+using namespace home_task;
+
+
+namespace home_task::shm_network {
+
+constexpr uint64_t SegmentMagic = 0x4d48534b53415448ull;
+constexpr uint64_t CacheLine = 64;
+
+struct SegmentHeader {
+    uint64_t Magic_;
+    uint32_t ClientCount_;
+    uint32_t BlobThreshold_;
+    uint64_t RingSize_;
+    uint64_t BlobSize_;
+    std::atomic<uint32_t> Ready_;
+};
+
+struct alignas(CacheLine) Doorbell {
+    std::atomic<uint32_t> Seq_;
+    std::atomic<uint32_t> Waiting_;
+};
+
+// head and tail on their own cache lines, the reader and the writer don't share them
+struct RingControl {
+    alignas(CacheLine) std::atomic<uint64_t> Head_;
+    alignas(CacheLine) std::atomic<uint64_t> Tail_;
+    alignas(CacheLine) std::atomic<uint32_t> SpaceSeq_;
+    std::atomic<uint32_t> WriterWaiting_;
+};
+
+}
+
+namespace {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+        "atomics in shared memory have to be lock-free");
+
+enum ERecordKind : uint32_t {
+    Message = 1,
+    Blob = 2,
+    Padding = 3,
+};
+
+struct RecordHeader {
+    uint32_t Kind_;
+    uint32_t Size_;
+};
+
+struct BlobHeader {
+    std::atomic<uint32_t> Refs_;
+    uint32_t Size_;
+};
+
+constexpr uint32_t BlobRefSize = sizeof(uint64_t) + sizeof(uint32_t);
+constexpr uint32_t SpinCount = 512;
+constexpr uint32_t OpenAttempts = 100;
+// how long a send waits for readers to free the blob region before the message is dropped
+constexpr auto BlobWait = std::chrono::seconds(1);
+
+uint64_t AlignUp(uint64_t _value, uint64_t _alignment) {
+    return (_value + _alignment - 1) / _alignment * _alignment;
+}
+
+void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// not FUTEX_PRIVATE_FLAG, the word is shared between processes
+void FutexWait(std::atomic<uint32_t> *_word, uint32_t _expected) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(_word), FUTEX_WAIT, _expected, nullptr, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t> *_word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(_word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+std::string SegmentName(const std::string &_name) {
+    return _name.starts_with('/') ? _name : '/' + _name;
+}
+
+std::unique_ptr<MessageRecord> DecodeBytes(const uint8_t *_data, uint32_t _size) {
+    auto view = wire::ParseMessage(_data, _size);
+    if (!view || view->FullSize() != _size) {
+        return nullptr;
+    }
+    return wire::Decode(*view);
+}
+
+}
+
+
+ShmNetworkClient::ShmNetworkClient(model::ClientId _id, const std::string &_name)
+    : Id_(_id)
+    , Name_(SegmentName(_name))
+{}
+
+ShmNetworkClient::~ShmNetworkClient() {
+    if (Segment_) {
+        munmap(Segment_, SegmentSize_);
+    }
+    if (Owner_) {
+        shm_unlink(Name_.c_str());
+    }
+    log::WriteDestructor("~ShmNetworkClient");
+}
+
+bool ShmNetworkClient::Map(int _fd, uint64_t _size) {
+    void *segment = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    close(_fd);
+    if (segment == MAP_FAILED) {
+        log::Write("ShmNetworkClient{mmap failed: ", std::strerror(errno), '}');
+        return false;
+    }
+    Segment_ = static_cast<uint8_t*>(segment);
+    SegmentSize_ = _size;
+    Header_ = reinterpret_cast<SegmentHeader*>(Segment_);
+    return true;
+}
+
+void ShmNetworkClient::Layout() {
+    uint32_t clientCount = Header_->ClientCount_;
+    uint64_t offset = AlignUp(sizeof(SegmentHeader), CacheLine);
+    Doorbells_ = reinterpret_cast<Doorbell*>(Segment_ + offset);
+    offset += sizeof(Doorbell) * (clientCount + 1);
+    auto *controls = reinterpret_cast<RingControl*>(Segment_ + offset);
+    offset += sizeof(RingControl) * 2 * clientCount;
+    offset = AlignUp(offset, CacheLine);
+    for (uint32_t idx = 0; idx < 2 * clientCount; ++idx) {
+        auto ring = std::make_unique<Ring>();
+        ring->Control_ = controls + idx;
+        ring->Data_ = Segment_ + offset;
+        offset += Header_->RingSize_;
+        Rings_.push_back(std::move(ring));
+    }
+    Blobs_ = Segment_ + offset;
+
+    if (Id_ == magic_numbers::ServerId) {
+        for (model::ClientId client = 1; client <= clientCount; ++client) {
+            Inputs_.push_back(GetRing(client, true));
+        }
+    } else {
+        Inputs_.push_back(GetRing(Id_, false));
+    }
+}
+
+std::unique_ptr<ShmNetworkClient> ShmNetworkClient::Create(const std::string &_name, const ShmSettings &_settings) {
+    if (!_settings.ClientCount_ || !std::has_single_bit(_settings.RingSize_) || _settings.RingSize_ < 4096) {
+        log::Write("ShmNetworkClient::Create{bad settings}");
+        return nullptr;
+    }
+    std::unique_ptr<ShmNetworkClient> client(new ShmNetworkClient(magic_numbers::ServerId, _name));
+    uint64_t size = AlignUp(sizeof(SegmentHeader), CacheLine)
+        + sizeof(Doorbell) * (_settings.ClientCount_ + 1)
+        + sizeof(RingControl) * 2 * _settings.ClientCount_;
+    size = AlignUp(size, CacheLine) + 2 * _settings.ClientCount_ * _settings.RingSize_ + _settings.BlobSize_;
+
+    shm_unlink(client->Name_.c_str());
+    int fd = shm_open(client->Name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        log::Write("ShmNetworkClient::Create{shm_open failed: ", std::strerror(errno), '}');
+        return nullptr;
+    }
+    client->Owner_ = true;
+    if (ftruncate(fd, size) == -1) {
+        log::Write("ShmNetworkClient::Create{ftruncate failed: ", std::strerror(errno), '}');
+        close(fd);
+        return nullptr;
+    }
+    if (!client->Map(fd, size)) {
+        return nullptr;
+    }
+    // the fresh segment is zeroed, so every atomic starts from 0
+    client->Header_->Magic_ = SegmentMagic;
+    client->Header_->ClientCount_ = _settings.ClientCount_;
+    client->Header_->BlobThreshold_ = _settings.BlobThreshold_;
+    client->Header_->RingSize_ = _settings.RingSize_;
+    client->Header_->BlobSize_ = _settings.BlobSize_;
+    client->Layout();
+    client->Header_->Ready_.store(1, std::memory_order_release);
+    return client;
+}
+
+std::unique_ptr<ShmNetworkClient> ShmNetworkClient::Open(const std::string &_name, model::ClientId _id) {
+    std::unique_ptr<ShmNetworkClient> client(new ShmNetworkClient(_id, _name));
+    using namespace std::chrono_literals;
+    // the server may still be starting
+    for (uint32_t attempt = 0; attempt < OpenAttempts; ++attempt) {
+        int fd = shm_open(client->Name_.c_str(), O_RDWR, 0600);
+        struct stat info{};
+        if (fd != -1 && fstat(fd, &info) == 0 && static_cast<uint64_t>(info.st_size) >= sizeof(SegmentHeader)) {
+            if (!client->Map(fd, info.st_size)) {
+                return nullptr;
+            }
+            break;
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+        std::this_thread::sleep_for(100ms);
+    }
+    for (uint32_t attempt = 0; client->Header_ && attempt < OpenAttempts; ++attempt) {
+        if (client->Header_->Ready_.load(std::memory_order_acquire)) {
+            break;
+        }
+        std::this_thread::sleep_for(100ms);
+    }
+    if (!client->Header_ || !client->Header_->Ready_.load(std::memory_order_acquire)
+            || client->Header_->Magic_ != SegmentMagic)
+    {
+        log::Write("ShmNetworkClient::Open{segment ", client->Name_, " isn't ready}");
+        return nullptr;
+    }
+    if (_id == magic_numbers::ServerId || _id > client->Header_->ClientCount_) {
+        log::Write("ShmNetworkClient::Open{id ", _id, " is out of [1, ", client->Header_->ClientCount_, "]}");
+        return nullptr;
+    }
+    client->Layout();
+    return client;
+}
+
+ShmNetworkClient::Ring* ShmNetworkClient::GetRing(model::ClientId _client, bool _toServer) const {
+    if (_client == magic_numbers::ServerId || _client > Header_->ClientCount_) {
+        return nullptr;
+    }
+    return Rings_[2 * (_client - 1) + (_toServer ? 0 : 1)].get();
+}
+
+void ShmNetworkClient::RingDoorbell(model::ClientId _receiver) {
+    Doorbell &doorbell = Doorbells_[_receiver];
+    // pairs with the Waiting_ store of the receiver: either it sees the record or we see it parking
+    if (doorbell.Waiting_.load()) {
+        doorbell.Seq_.fetch_add(1);
+        FutexWake(&doorbell.Seq_);
+    }
+}
+
+bool ShmNetworkClient::WriteRecord(Ring *_ring, uint32_t _kind, const uint8_t *_data, uint32_t _size) {
+    const uint64_t capacity = Header_->RingSize_;
+    const uint64_t need = sizeof(RecordHeader) + AlignUp(_size, sizeof(RecordHeader));
+    if (need > capacity / 2) {
+        return false;
+    }
+    std::lock_guard lock(_ring->WriteMutex_);
+    RingControl &control = *_ring->Control_;
+    uint64_t tail = control.Tail_.load(std::memory_order_relaxed);
+    uint64_t position = tail & (capacity - 1);
+    uint64_t contiguous = capacity - position;
+    // a record never wraps, the end of the ring is skipped with a padding record
+    uint64_t total = need <= contiguous ? need : contiguous + need;
+
+    for (uint32_t spin = 0;; ++spin) {
+        if (capacity - (tail - control.Head_.load(std::memory_order_acquire)) >= total) {
+            break;
+        }
+        if (spin < SpinCount) {
+            CpuRelax();
+            continue;
+        }
+        uint32_t seq = control.SpaceSeq_.load();
+        control.WriterWaiting_.store(1);
+        if (capacity - (tail - control.Head_.load()) < total) {
+            FutexWait(&control.SpaceSeq_, seq);
+        }
+        control.WriterWaiting_.store(0);
+    }
+
+    if (need > contiguous) {
+        auto *padding = reinterpret_cast<RecordHeader*>(_ring->Data_ + position);
+        padding->Kind_ = ERecordKind::Padding;
+        padding->Size_ = contiguous - sizeof(RecordHeader);
+        tail += contiguous;
+        position = 0;
+    }
+    auto *header = reinterpret_cast<RecordHeader*>(_ring->Data_ + position);
+    header->Kind_ = _kind;
+    header->Size_ = _size;
+    std::memcpy(_ring->Data_ + position + sizeof(RecordHeader), _data, _size);
+    control.Tail_.store(tail + need);
+    return true;
+}
+
+std::unique_ptr<MessageRecord> ShmNetworkClient::ReadRecord(Ring *_ring) {
+    const uint64_t capacity = Header_->RingSize_;
+    RingControl &control = *_ring->Control_;
+    const uint64_t start = control.Head_.load(std::memory_order_relaxed);
+    uint64_t head = start;
+    uint64_t tail = control.Tail_.load(std::memory_order_acquire);
+    std::unique_ptr<MessageRecord> msg;
+    while (!msg && head != tail) {
+        auto *header = reinterpret_cast<const RecordHeader*>(_ring->Data_ + (head & (capacity - 1)));
+        const uint8_t *payload = reinterpret_cast<const uint8_t*>(header + 1);
+        if (header->Kind_ == ERecordKind::Message) {
+            msg = DecodeBytes(payload, header->Size_);
+        } else if (header->Kind_ == ERecordKind::Blob) {
+            uint64_t offset = wire::LoadU64(payload);
+            uint32_t size = wire::LoadU32(payload + sizeof(uint64_t));
+            auto *blob = reinterpret_cast<BlobHeader*>(Blobs_ + offset);
+            msg = DecodeBytes(Blobs_ + offset + sizeof(BlobHeader), size);
+            blob->Refs_.fetch_sub(1, std::memory_order_release);
+        }
+        if (!msg && header->Kind_ != ERecordKind::Padding) {
+            log::Write("ShmNetworkClient::ReadRecord{malformed record kind ", header->Kind_, '}');
+        }
+        head += sizeof(RecordHeader) + AlignUp(header->Size_, sizeof(RecordHeader));
+    }
+    if (head == start) {
+        return nullptr;
+    }
+    control.Head_.store(head);
+    // pairs with the WriterWaiting_ store of a writer waiting for space
+    if (control.WriterWaiting_.load()) {
+        control.SpaceSeq_.fetch_add(1);
+        FutexWake(&control.SpaceSeq_);
+    }
+    if (msg) {
+        ReceivedMessages_++;
+    }
+    return msg;
+}
+
+void ShmNetworkClient::ReclaimBlobs() {
+    for (auto it = BlobBlocks_.begin(); it != BlobBlocks_.end();) {
+        auto *blob = reinterpret_cast<BlobHeader*>(Blobs_ + it->first);
+        if (blob->Refs_.load(std::memory_order_acquire)) {
+            ++it;
+        } else {
+            it = BlobBlocks_.erase(it);
+        }
+    }
+}
+
+// A block goes to the first gap that fits. A blob that stays referenced, e.g. by a client
+// that exited without reading it, pins only its own block and the rest of the region is reused.
+std::optional<uint64_t> ShmNetworkClient::AllocateBlob(uint64_t _size) {
+    ReclaimBlobs();
+    uint64_t size = AlignUp(_size, CacheLine);
+    uint64_t end = 0;
+    for (auto &[offset, blockSize] : BlobBlocks_) {
+        if (offset - end >= size) {
+            break;
+        }
+        end = offset + blockSize;
+    }
+    if (Header_->BlobSize_ - end < size) {
+        return std::nullopt;
+    }
+    BlobBlocks_.emplace(end, size);
+    return end;
+}
+
+bool ShmNetworkClient::SendBlob(Ring *_ring, const MessageRecord &_msg, const wire::Buffer &_encoded) {
+    std::unique_lock lock(BlobMutex_);
+    uint64_t size = sizeof(BlobHeader) + _encoded.size();
+    if (size > Header_->BlobSize_) {
+        return false;
+    }
+    std::optional<uint64_t> offset = AllocateBlob(size);
+    if (!offset && CachedState_) {
+        // the cache pins its block, a full region drops it before waiting for readers
+        reinterpret_cast<BlobHeader*>(Blobs_ + CachedState_->Offset_)->Refs_.fetch_sub(1);
+        CachedState_.reset();
+        offset = AllocateBlob(size);
+    }
+    auto deadline = std::chrono::steady_clock::now() + BlobWait;
+    while (!offset) {
+        // the region is full of blobs not read yet
+        if (std::chrono::steady_clock::now() >= deadline) {
+            log::Write("ShmNetworkClient::SendBlob{the blob region is full of unread blobs, ", size, " bytes aren't sent}");
+            return false;
+        }
+        lock.unlock();
+        std::this_thread::yield();
+        lock.lock();
+        offset = AllocateBlob(size);
+    }
+
+    // only a bare snapshot is the same for every client
+    const api::State *state = nullptr;
+    if (_msg.Type_ == static_cast<uint32_t>(api::EAPIEventsType::State)) {
+        state = std::get_if<api::State>(&_msg.Record_);
+        if (state && (state->Updates_.size() || state->Insertions_.size() || state->Deletions_.size())) {
+            state = nullptr;
+        }
+    }
+    auto *blob = new (Blobs_ + *offset) BlobHeader;
+    blob->Size_ = _encoded.size();
+    // the cache keeps its own reference until the next state replaces it
+    blob->Refs_.store(state ? 2 : 1, std::memory_order_relaxed);
+    std::memcpy(Blobs_ + *offset + sizeof(BlobHeader), _encoded.data(), _encoded.size());
+    WrittenBlobs_++;
+    if (state) {
+        if (CachedState_) {
+            reinterpret_cast<BlobHeader*>(Blobs_ + CachedState_->Offset_)->Refs_.fetch_sub(1);
+        }
+        CachedState_ = CachedState{
+            .Epoch_ = state->Epoch_,
+            .Iteration_ = state->Iteration_,
+            .CellCount_ = state->Cells_.size(),
+            .Offset_ = *offset,
+            .Size_ = static_cast<uint32_t>(_encoded.size()),
+        };
+    }
+
+    uint8_t ref[BlobRefSize];
+    wire::StoreU64(ref, *offset);
+    wire::StoreU32(ref + sizeof(uint64_t), _encoded.size());
+    return WriteRecord(_ring, ERecordKind::Blob, ref, BlobRefSize);
+}
+
+void ShmNetworkClient::Send(model::ClientId _receiver, std::unique_ptr<MessageRecord> &&_msg) {
+    _msg->Sender_ = Id_;
+    if (_receiver == Id_) {
+        {
+            std::lock_guard lock(LocalMutex_);
+            Local_.push_back(std::move(_msg));
+            HasLocal_.store(true);
+        }
+        RingDoorbell(Id_);
+        return;
+    }
+    Ring *ring = Id_ == magic_numbers::ServerId ? GetRing(_receiver, false) : GetRing(Id_, true);
+    if (!ring || (Id_ != magic_numbers::ServerId && _receiver != magic_numbers::ServerId)) {
+        log::Write("ShmNetworkClient::Send{unknown receiver ", _receiver, '}');
+        return;
+    }
+    log::WriteNetwork("ShmNetworkClient::Send ", Id_, "->", _receiver);
+    SentMessages_++;
+
+    // a state the server already wrote for the same iteration is only referenced
+    if (Owner_ && _msg->Type_ == static_cast<uint32_t>(api::EAPIEventsType::State)) {
+        const auto *state = std::get_if<api::State>(&_msg->Record_);
+        std::unique_lock lock(BlobMutex_);
+        if (state && CachedState_ && CachedState_->Epoch_ == state->Epoch_ && CachedState_->Iteration_ == state->Iteration_
+                && CachedState_->CellCount_ == state->Cells_.size()
+                && state->Updates_.empty() && state->Insertions_.empty() && state->Deletions_.empty())
+        {
+            reinterpret_cast<BlobHeader*>(Blobs_ + CachedState_->Offset_)->Refs_.fetch_add(1);
+            uint8_t ref[BlobRefSize];
+            wire::StoreU64(ref, CachedState_->Offset_);
+            wire::StoreU32(ref + sizeof(uint64_t), CachedState_->Size_);
+            WriteRecord(ring, ERecordKind::Blob, ref, BlobRefSize);
+            SharedBlobs_++;
+            lock.unlock();
+            RingDoorbell(_receiver);
+            return;
+        }
+    }
+
+    bool written;
+    {
+        std::lock_guard lock(ScratchMutex_);
+        Scratch_.clear();
+        wire::Encode(*_msg, &Scratch_);
+        bool blob = Owner_ && Scratch_.size() >= Header_->BlobThreshold_;
+        written = blob
+            ? SendBlob(ring, *_msg, Scratch_)
+            : WriteRecord(ring, ERecordKind::Message, Scratch_.data(), Scratch_.size());
+        if (!written && Owner_ && !blob) {
+            written = SendBlob(ring, *_msg, Scratch_);
+        }
+    }
+    if (!written) {
+        log::Write("ShmNetworkClient::Send{message of ", _msg->Size_, " bytes doesn't fit}");
+        return;
+    }
+    RingDoorbell(_receiver);
+}
+
+std::unique_ptr<MessageRecord> ShmNetworkClient::Pop() {
+    if (HasLocal_.load()) {
+        std::lock_guard lock(LocalMutex_);
+        if (Local_.size()) {
+            auto msg = std::move(Local_.front());
+            Local_.pop_front();
+            HasLocal_.store(!Local_.empty());
+            return msg;
+        }
+    }
+    // round robin, a chatty client doesn't starve the others
+    for (uint32_t idx = 0; idx < Inputs_.size(); ++idx) {
+        Ring *ring = Inputs_[NextInput_];
+        NextInput_ = (NextInput_ + 1) % Inputs_.size();
+        if (auto msg = ReadRecord(ring)) {
+            return msg;
+        }
+    }
+    return nullptr;
+}
+
+bool ShmNetworkClient::Empty() const {
+    if (HasLocal_.load()) {
+        return false;
+    }
+    for (Ring *ring : Inputs_) {
+        if (ring->Control_->Head_.load(std::memory_order_relaxed) != ring->Control_->Tail_.load()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::optional<std::unique_ptr<MessageRecord>> ShmNetworkClient::Receive() {
+    auto msg = Pop();
+    if (!msg) {
+        return std::nullopt;
+    }
+    return msg;
+}
+
+std::unique_ptr<MessageRecord> ShmNetworkClient::ReceiveWithWaiting() {
+    auto msg = Pop();
+    while (!msg) {
+        WaitMessage();
+        msg = Pop();
+    }
+    return msg;
+}
+
+uint32_t ShmNetworkClient::ReceiveAll(std::vector<std::unique_ptr<MessageRecord>> *_messages) {
+    uint32_t count = 0;
+    while (auto msg = Pop()) {
+        _messages->push_back(std::move(msg));
+        count++;
+    }
+    return count;
+}
+
+uint32_t ShmNetworkClient::ReceiveAllWithWaiting(std::vector<std::unique_ptr<MessageRecord>> *_messages) {
+    uint32_t count = ReceiveAll(_messages);
+    while (!count) {
+        WaitMessage();
+        count = ReceiveAll(_messages);
+    }
+    return count;
+}
+
+void ShmNetworkClient::WaitMessage() {
+    for (uint32_t spin = 0; spin < SpinCount; ++spin) {
+        if (!Empty()) {
+            return;
+        }
+        CpuRelax();
+    }
+    Doorbell &doorbell = Doorbells_[Id_];
+    uint32_t seq = doorbell.Seq_.load();
+    doorbell.Waiting_.store(1);
+    if (Empty()) {
+        FutexWait(&doorbell.Seq_, seq);
+    }
+    doorbell.Waiting_.store(0);
+}
+
+std::string ShmNetworkClient::PrintStat() const {
+    std::ostringstream sout;
+    sout << "Shm Id# " << Id_
+        << " SentMessages# " << SentMessages_.load()
+        << " ReceivedMessages# " << ReceivedMessages_.load()
+        << " WrittenBlobs# " << WrittenBlobs_.load()
+        << " SharedBlobs# " << SharedBlobs_.load() << std::endl;
+    return sout.str();
+}
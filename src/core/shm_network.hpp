@@ -0,0 +1,124 @@
+#pragma once
+
+#include "network_mock.hpp"
+#include "wire.hpp"
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace home_task::shm_network {
+
+struct ShmSettings {
+    uint32_t ClientCount_ = 1;
+    // bytes of every ring, a power of two
+    uint64_t RingSize_ = 1 << 20;
+    uint64_t BlobSize_ = 64 << 20;
+    // messages of the server from this size are written to the blob region
+    uint32_t BlobThreshold_ = 64 << 10;
+};
+
+struct SegmentHeader;
+struct Doorbell;
+struct RingControl;
+
+// INetworkClient for processes of the same host over a POSIX shared memory segment.
+// The segment holds a pair of single-producer single-consumer rings for every client
+// (client -> server and server -> client) and a blob region written only by the server.
+// Ring records are encoded wire messages, so the reader decodes right from the segment.
+// Large messages of the server go to the blob region and the ring gets only a reference,
+// a State for the same iteration is written once and referenced by every client asking for it.
+// A receiver without messages parks on the futex of its doorbell, writers wake it only
+// when it announced parking.
+class ShmNetworkClient : public network_mock::INetworkClient {
+    struct Ring {
+        RingControl *Control_ = nullptr;
+        uint8_t *Data_ = nullptr;
+        // only one thread of the process may write the ring at a time
+        std::mutex WriteMutex_;
+    };
+
+    struct CachedState {
+        model::EpochId Epoch_ = 0;
+        model::IterationId Iteration_ = 0;
+        uint64_t CellCount_ = 0;
+        uint64_t Offset_ = 0;
+        uint32_t Size_ = 0;
+    };
+
+    model::ClientId Id_;
+    std::string Name_;
+    bool Owner_ = false;
+    uint8_t *Segment_ = nullptr;
+    uint64_t SegmentSize_ = 0;
+    SegmentHeader *Header_ = nullptr;
+    Doorbell *Doorbells_ = nullptr;
+    std::vector<std::unique_ptr<Ring>> Rings_;
+    uint8_t *Blobs_ = nullptr;
+
+    // rings this client reads, the server reads every client ring
+    std::vector<Ring*> Inputs_;
+    uint32_t NextInput_ = 0;
+
+    // blob allocator, only the server writes blobs
+    std::mutex BlobMutex_;
+    // sizes of the blocks in use by their offsets
+    std::map<uint64_t, uint64_t> BlobBlocks_;
+    std::optional<CachedState> CachedState_;
+
+    std::mutex LocalMutex_;
+    std::deque<std::unique_ptr<network_mock::MessageRecord>> Local_;
+    std::atomic<bool> HasLocal_ = false;
+
+    wire::Buffer Scratch_;
+    std::mutex ScratchMutex_;
+
+    std::atomic<uint64_t> SentMessages_ = 0;
+    std::atomic<uint64_t> ReceivedMessages_ = 0;
+    std::atomic<uint64_t> SharedBlobs_ = 0;
+    std::atomic<uint64_t> WrittenBlobs_ = 0;
+
+    ShmNetworkClient(model::ClientId _id, const std::string &_name);
+
+    bool Map(int _fd, uint64_t _size);
+    void Layout();
+    Ring* GetRing(model::ClientId _client, bool _toServer) const;
+    void RingDoorbell(model::ClientId _receiver);
+    bool WriteRecord(Ring *_ring, uint32_t _kind, const uint8_t *_data, uint32_t _size);
+    std::unique_ptr<network_mock::MessageRecord> ReadRecord(Ring *_ring);
+    std::optional<uint64_t> AllocateBlob(uint64_t _size);
+    void ReclaimBlobs();
+    bool SendBlob(Ring *_ring, const network_mock::MessageRecord &_msg, const wire::Buffer &_encoded);
+    std::unique_ptr<network_mock::MessageRecord> Pop();
+    bool Empty() const;
+
+public:
+    // the server side, creates and owns the segment
+    static std::unique_ptr<ShmNetworkClient> Create(const std::string &_name, const ShmSettings &_settings);
+    // a client side, waits for the server to create the segment
+    static std::unique_ptr<ShmNetworkClient> Open(const std::string &_name, model::ClientId _id);
+
+    ~ShmNetworkClient();
+
+    // _receiver equal to the own id puts the message to the own mailbox, e.g. Poison
+    void Send(model::ClientId _receiver, std::unique_ptr<network_mock::MessageRecord> &&_msg) override;
+
+    std::optional<std::unique_ptr<network_mock::MessageRecord>> Receive() override;
+
+    std::unique_ptr<network_mock::MessageRecord> ReceiveWithWaiting() override;
+
+    uint32_t ReceiveAll(std::vector<std::unique_ptr<network_mock::MessageRecord>> *_messages) override;
+
+    uint32_t ReceiveAllWithWaiting(std::vector<std::unique_ptr<network_mock::MessageRecord>> *_messages) override;
+
+    void WaitMessage() override;
+
+    std::string PrintStat() const;
+};
+
+}
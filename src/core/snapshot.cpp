@@ -0,0 +1,87 @@
+#include "snapshot.hpp"
+#include "api.hpp"
+#include "log.hpp"
+#include "serialization.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+using namespace home_task;
+
+
+namespace home_task::snapshot {
+
+bool Save(const std::string &_path, api::State &&_state) {
+    auto message = api::MakeResponseMessage(std::move(_state));
+    wire::Buffer buffer;
+    wire::Encode(*message, &buffer);
+
+    std::string tmpPath = _path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        log::Write("snapshot::Save{open failed: ", std::strerror(errno), '}');
+        return false;
+    }
+    for (uint64_t written = 0; written < buffer.size();) {
+        ssize_t size = write(fd, buffer.data() + written, buffer.size() - written);
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log::Write("snapshot::Save{write failed: ", std::strerror(errno), '}');
+            close(fd);
+            return false;
+        }
+        written += size;
+    }
+    if (fsync(fd) < 0) {
+        log::Write("snapshot::Save{fsync failed: ", std::strerror(errno), '}');
+        close(fd);
+        return false;
+    }
+    close(fd);
+    if (rename(tmpPath.c_str(), _path.c_str()) < 0) {
+        log::Write("snapshot::Save{rename failed: ", std::strerror(errno), '}');
+        return false;
+    }
+    return true;
+}
+
+std::optional<api::State> Load(const std::string &_path) {
+    int fd = open(_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || !info.st_size) {
+        close(fd);
+        return std::nullopt;
+    }
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        log::Write("snapshot::Load{mmap failed: ", std::strerror(errno), '}');
+        return std::nullopt;
+    }
+    std::optional<api::State> state;
+    auto view = wire::ParseMessage(static_cast<const uint8_t*>(data), info.st_size);
+    if (view && view->FullSize() == static_cast<uint64_t>(info.st_size) && view->Type_ == static_cast<uint32_t>(api::State::Type_)) {
+        if (auto message = wire::Decode(*view)) {
+            if (auto *record = std::get_if<api::State>(&message->Record_)) {
+                state = std::move(*record);
+            }
+        }
+    }
+    munmap(data, info.st_size);
+    if (!state) {
+        log::Write("snapshot::Load{broken snapshot ", _path, '}');
+    }
+    return state;
+}
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "records.hpp"
+
+#include <optional>
+#include <string>
+
+
+namespace home_task::snapshot {
+
+// A client snapshot is the State message in the wire format, the file is replaced atomically:
+// it is written next to the old one, synced and renamed over it.
+bool Save(const std::string &_path, api::State &&_state);
+
+// Maps the file and decodes the State, std::nullopt when there is no file or it is broken.
+std::optional<api::State> Load(const std::string &_path);
+
+}
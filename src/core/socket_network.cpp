@@ -0,0 +1,502 @@
+#include "socket_network.hpp"
+#include "serialization.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string_view>
+
+using namespace home_task::socket_network;
+using namespace home_task::network_mock;
+using namespace home_task;
+
+
+namespace {
+
+constexpr uint32_t MaxEvents = 64;
+constexpr uint32_t MaxIoVecs = 64;
+constexpr uint32_t ConnectAttempts = 50;
+
+struct SocketAddressStorage {
+    sockaddr_storage Storage_{};
+    socklen_t Length_ = 0;
+    int Domain_ = AF_INET;
+
+    const sockaddr* Get() const {
+        return reinterpret_cast<const sockaddr*>(&Storage_);
+    }
+};
+
+std::optional<SocketAddressStorage> MakeAddress(const SocketAddress &_address) {
+    SocketAddressStorage result;
+    if (_address.Family_ == ESocketFamily::Unix) {
+        auto *addr = reinterpret_cast<sockaddr_un*>(&result.Storage_);
+        if (_address.Host_.size() >= sizeof(addr->sun_path)) {
+            return std::nullopt;
+        }
+        addr->sun_family = AF_UNIX;
+        std::memcpy(addr->sun_path, _address.Host_.c_str(), _address.Host_.size() + 1);
+        result.Length_ = sizeof(sockaddr_un);
+        result.Domain_ = AF_UNIX;
+        return result;
+    }
+    auto *addr = reinterpret_cast<sockaddr_in*>(&result.Storage_);
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(_address.Port_);
+    if (inet_pton(AF_INET, _address.Host_.c_str(), &addr->sin_addr) != 1) {
+        return std::nullopt;
+    }
+    result.Length_ = sizeof(sockaddr_in);
+    result.Domain_ = AF_INET;
+    return result;
+}
+
+void SetupSocket(int _fd, int _domain) {
+    int flags = fcntl(_fd, F_GETFL, 0);
+    fcntl(_fd, F_SETFL, flags | O_NONBLOCK);
+    if (_domain == AF_INET) {
+        // messages are batched by the client itself, Nagle would only add latency
+        int one = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+}
+
+void LogError(const char *_what) {
+    log::Write("SocketNetworkClient{", _what, " failed: ", std::strerror(errno), '}');
+}
+
+}
+
+
+std::optional<SocketAddress> SocketAddress::Parse(const std::string &_address) {
+    SocketAddress result;
+    constexpr std::string_view tcpPrefix = "tcp://";
+    constexpr std::string_view unixPrefix = "unix://";
+    if (_address.starts_with(unixPrefix)) {
+        result.Family_ = ESocketFamily::Unix;
+        result.Host_ = _address.substr(unixPrefix.size());
+        return result.Host_.empty() ? std::nullopt : std::optional(result);
+    }
+    std::string hostPort = _address.starts_with(tcpPrefix) ? _address.substr(tcpPrefix.size()) : _address;
+    auto colon = hostPort.rfind(':');
+    if (colon == std::string::npos) {
+        return std::nullopt;
+    }
+    result.Family_ = ESocketFamily::Tcp;
+    result.Host_ = hostPort.substr(0, colon);
+    int port = std::atoi(hostPort.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) {
+        return std::nullopt;
+    }
+    result.Port_ = port;
+    return result;
+}
+
+SocketNetworkClient::SocketNetworkClient(model::ClientId _id)
+    : Id_(_id)
+    , Inbox_(std::make_shared<NetworkMock>(1))
+{
+    Epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    WakeUp_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = WakeUp_;
+    epoll_ctl(Epoll_, EPOLL_CTL_ADD, WakeUp_, &event);
+}
+
+SocketNetworkClient::~SocketNetworkClient() {
+    Stopped_.store(true);
+    uint64_t one = 1;
+    [[maybe_unused]] auto written = write(WakeUp_, &one, sizeof(one));
+    if (Thread_.joinable()) {
+        Thread_.join();
+    }
+    for (auto &[fd, connection] : Connections_) {
+        close(fd);
+    }
+    if (Listener_ != -1) {
+        close(Listener_);
+    }
+    close(WakeUp_);
+    close(Epoll_);
+    log::WriteDestructor("~SocketNetworkClient");
+}
+
+std::unique_ptr<SocketNetworkClient> SocketNetworkClient::Listen(const SocketAddress &_address, model::ClientId _id) {
+    auto address = MakeAddress(_address);
+    if (!address) {
+        log::Write("SocketNetworkClient::Listen{bad address ", _address.Host_, '}');
+        return nullptr;
+    }
+    std::unique_ptr<SocketNetworkClient> client(new SocketNetworkClient(_id));
+    client->Listener_ = socket(address->Domain_, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (client->Listener_ == -1) {
+        LogError("socket");
+        return nullptr;
+    }
+    if (address->Domain_ == AF_UNIX) {
+        unlink(_address.Host_.c_str());
+    } else {
+        int one = 1;
+        setsockopt(client->Listener_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (bind(client->Listener_, address->Get(), address->Length_) == -1) {
+        LogError("bind");
+        return nullptr;
+    }
+    if (listen(client->Listener_, SOMAXCONN) == -1) {
+        LogError("listen");
+        return nullptr;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = client->Listener_;
+    epoll_ctl(client->Epoll_, EPOLL_CTL_ADD, client->Listener_, &event);
+    client->Thread_ = std::thread(&SocketNetworkClient::Loop, client.get());
+    return client;
+}
+
+std::unique_ptr<SocketNetworkClient> SocketNetworkClient::Connect(const SocketAddress &_address, model::ClientId _id) {
+    auto address = MakeAddress(_address);
+    if (!address) {
+        log::Write("SocketNetworkClient::Connect{bad address ", _address.Host_, '}');
+        return nullptr;
+    }
+    std::unique_ptr<SocketNetworkClient> client(new SocketNetworkClient(_id));
+    // the server may still be starting, so the connection is retried for a while
+    int fd = -1;
+    for (uint32_t attempt = 0; attempt < ConnectAttempts; ++attempt) {
+        fd = socket(address->Domain_, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            LogError("socket");
+            return nullptr;
+        }
+        if (connect(fd, address->Get(), address->Length_) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+        using namespace std::chrono_literals;
+        std::this_thread::sleep_for(100ms);
+    }
+    if (fd == -1) {
+        LogError("connect");
+        return nullptr;
+    }
+    SetupSocket(fd, address->Domain_);
+    client->Upstream_ = client->AddConnection(fd);
+    client->Thread_ = std::thread(&SocketNetworkClient::Loop, client.get());
+    return client;
+}
+
+std::shared_ptr<SocketNetworkClient::Connection> SocketNetworkClient::AddConnection(int _fd) {
+    auto connection = std::make_shared<Connection>();
+    connection->Fd_ = _fd;
+    {
+        std::lock_guard lock(Mutex_);
+        Connections_[_fd] = connection;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = _fd;
+    epoll_ctl(Epoll_, EPOLL_CTL_ADD, _fd, &event);
+    return connection;
+}
+
+void SocketNetworkClient::Accept() {
+    for (;;) {
+        int fd = accept4(Listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LogError("accept");
+            }
+            return;
+        }
+        sockaddr_storage local{};
+        socklen_t length = sizeof(local);
+        getsockname(fd, reinterpret_cast<sockaddr*>(&local), &length);
+        SetupSocket(fd, local.ss_family);
+        AddConnection(fd);
+        log::WriteNetwork("SocketNetworkClient::Accept{fd ", fd, '}');
+    }
+}
+
+void SocketNetworkClient::Read(const std::shared_ptr<Connection> &_connection) {
+    Connection &connection = *_connection;
+    // connections are closed only by this thread, the flag can be read without the lock
+    if (connection.Closed_) {
+        return;
+    }
+    for (;;) {
+        uint64_t size = connection.Input_.size();
+        connection.Input_.resize(size + ReadSize);
+        ssize_t count = read(connection.Fd_, connection.Input_.data() + size, ReadSize);
+        connection.Input_.resize(size + std::max<ssize_t>(count, 0));
+        if (count == 0) {
+            Close(_connection);
+            return;
+        }
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LogError("read");
+                Close(_connection);
+            }
+            return;
+        }
+        ReceivedBytes_ += count;
+
+        const uint8_t *data = connection.Input_.data();
+        uint64_t end = connection.Input_.size();
+        while (end - connection.InputOffset_ >= wire::LengthSize) {
+            bool malformed = false;
+            auto view = wire::ParseMessage(data + connection.InputOffset_, end - connection.InputOffset_, &malformed);
+            if (malformed) {
+                log::Write("SocketNetworkClient::Read{malformed message from fd ", connection.Fd_, '}');
+                Close(_connection);
+                return;
+            }
+            if (!view) {
+                break;
+            }
+            connection.InputOffset_ += view->FullSize();
+            auto msg = wire::Decode(*view);
+            if (!msg) {
+                log::Write("SocketNetworkClient::Read{undecodable message type ", view->Type_, '}');
+                continue;
+            }
+            if (!connection.Peer_ && !Upstream_) {
+                connection.Peer_ = msg->Sender_;
+                std::lock_guard lock(Mutex_);
+                Peers_[msg->Sender_] = _connection;
+            }
+            ReceivedMessages_++;
+            Inbox_->Send(0, msg->Sender_, std::move(msg));
+        }
+        if (connection.InputOffset_ == end) {
+            connection.Input_.clear();
+            connection.InputOffset_ = 0;
+        } else if (connection.InputOffset_ > end / 2) {
+            connection.Input_.erase(connection.Input_.begin(), connection.Input_.begin() + connection.InputOffset_);
+            connection.InputOffset_ = 0;
+        }
+    }
+}
+
+void SocketNetworkClient::Flush(const std::shared_ptr<Connection> &_connection) {
+    Connection &connection = *_connection;
+    std::unique_lock lock(connection.Mutex_);
+    connection.FlushScheduled_ = false;
+    if (connection.Closed_) {
+        return;
+    }
+    iovec vecs[MaxIoVecs];
+    while (connection.Output_.size()) {
+        uint32_t vecCount = 0;
+        for (auto it = connection.Output_.begin(); it != connection.Output_.end() && vecCount < MaxIoVecs; ++it) {
+            uint64_t offset = vecCount ? 0 : connection.OutputOffset_;
+            vecs[vecCount].iov_base = it->data() + offset;
+            vecs[vecCount].iov_len = it->size() - offset;
+            vecCount++;
+        }
+        ssize_t count = writev(connection.Fd_, vecs, vecCount);
+        WriteCalls_++;
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            LogError("writev");
+            lock.unlock();
+            Close(_connection);
+            return;
+        }
+        SentBytes_ += count;
+        uint64_t left = count;
+        while (left) {
+            uint64_t chunk = connection.Output_.front().size() - connection.OutputOffset_;
+            if (left < chunk) {
+                connection.OutputOffset_ += left;
+                break;
+            }
+            left -= chunk;
+            connection.Output_.pop_front();
+            connection.OutputOffset_ = 0;
+        }
+    }
+    // the rest is written when the socket becomes writable again
+    bool waitWritable = !connection.Output_.empty();
+    if (waitWritable != connection.WaitWritable_) {
+        connection.WaitWritable_ = waitWritable;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | (waitWritable ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        event.data.fd = connection.Fd_;
+        epoll_ctl(Epoll_, EPOLL_CTL_MOD, connection.Fd_, &event);
+    }
+}
+
+void SocketNetworkClient::Close(const std::shared_ptr<Connection> &_connection) {
+    {
+        std::lock_guard lock(_connection->Mutex_);
+        if (_connection->Closed_) {
+            return;
+        }
+        _connection->Closed_ = true;
+        _connection->Output_.clear();
+    }
+    log::Write("SocketNetworkClient{connection closed, peer ", _connection->Peer_.value_or(0), '}');
+    epoll_ctl(Epoll_, EPOLL_CTL_DEL, _connection->Fd_, nullptr);
+    close(_connection->Fd_);
+    std::lock_guard lock(Mutex_);
+    Connections_.erase(_connection->Fd_);
+    if (_connection->Peer_) {
+        auto it = Peers_.find(*_connection->Peer_);
+        if (it != Peers_.end() && it->second == _connection) {
+            Peers_.erase(it);
+        }
+    }
+}
+
+void SocketNetworkClient::Loop() {
+    epoll_event events[MaxEvents];
+    std::vector<std::shared_ptr<Connection>> pending;
+    while (!Stopped_.load()) {
+        int count = epoll_wait(Epoll_, events, MaxEvents, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LogError("epoll_wait");
+            return;
+        }
+        for (int idx = 0; idx < count; ++idx) {
+            int fd = events[idx].data.fd;
+            if (fd == WakeUp_) {
+                uint64_t value;
+                [[maybe_unused]] auto readCount = read(WakeUp_, &value, sizeof(value));
+                {
+                    std::lock_guard lock(Mutex_);
+                    pending.swap(PendingFlush_);
+                }
+                for (auto &connection : pending) {
+                    Flush(connection);
+                }
+                pending.clear();
+                continue;
+            }
+            if (fd == Listener_) {
+                Accept();
+                continue;
+            }
+            std::shared_ptr<Connection> connection;
+            {
+                std::lock_guard lock(Mutex_);
+                auto it = Connections_.find(fd);
+                if (it == Connections_.end()) {
+                    continue;
+                }
+                connection = it->second;
+            }
+            if (events[idx].events & EPOLLOUT) {
+                Flush(connection);
+            }
+            if (events[idx].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                Read(connection);
+            }
+        }
+    }
+}
+
+void SocketNetworkClient::Send(model::ClientId _receiver, std::unique_ptr<MessageRecord> &&_msg) {
+    _msg->Sender_ = Id_;
+    if (_receiver == Id_) {
+        Inbox_->Send(0, Id_, std::move(_msg));
+        return;
+    }
+    std::shared_ptr<Connection> connection = Upstream_;
+    if (!connection) {
+        std::lock_guard lock(Mutex_);
+        auto it = Peers_.find(_receiver);
+        if (it != Peers_.end()) {
+            connection = it->second;
+        }
+    }
+    if (!connection) {
+        log::Write("SocketNetworkClient::Send{unknown receiver ", _receiver, '}');
+        return;
+    }
+    log::WriteNetwork("SocketNetworkClient::Send ", Id_, "->", _receiver);
+    {
+        std::lock_guard lock(connection->Mutex_);
+        if (connection->Closed_) {
+            return;
+        }
+        if (connection->Output_.empty() || connection->Output_.back().size() >= OutputChunkSize) {
+            connection->Output_.emplace_back().reserve(std::max<uint64_t>(OutputChunkSize, _msg->Size_));
+        }
+        wire::Encode(*_msg, &connection->Output_.back());
+        SentMessages_++;
+        if (connection->FlushScheduled_) {
+            return;
+        }
+        connection->FlushScheduled_ = true;
+    }
+    bool wakeUp;
+    {
+        std::lock_guard lock(Mutex_);
+        wakeUp = PendingFlush_.empty();
+        PendingFlush_.push_back(std::move(connection));
+    }
+    if (wakeUp) {
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = write(WakeUp_, &one, sizeof(one));
+    }
+}
+
+std::optional<std::unique_ptr<MessageRecord>> SocketNetworkClient::Receive() {
+    return Inbox_->Receive(0);
+}
+
+std::unique_ptr<MessageRecord> SocketNetworkClient::ReceiveWithWaiting() {
+    return Inbox_->ReceiveWithWaiting(0);
+}
+
+uint32_t SocketNetworkClient::ReceiveAll(std::vector<std::unique_ptr<MessageRecord>> *_messages) {
+    return Inbox_->ReceiveAll(0, _messages);
+}
+
+uint32_t SocketNetworkClient::ReceiveAllWithWaiting(std::vector<std::unique_ptr<MessageRecord>> *_messages) {
+    return Inbox_->ReceiveAllWithWaiting(0, _messages);
+}
+
+void SocketNetworkClient::WaitMessage() {
+    Inbox_->WaitMessage(0);
+}
+
+std::string SocketNetworkClient::PrintStat() const {
+    std::ostringstream sout;
+    sout << "Socket Id# " << Id_
+        << " SentMessages# " << SentMessages_.load()
+        << " ReceivedMessages# " << ReceivedMessages_.load()
+        << " SentBytes# " << SentBytes_.load()
+        << " ReceivedBytes# " << ReceivedBytes_.load()
+        << " WriteCalls# " << WriteCalls_.load() << std::endl;
+    return sout.str();
+}
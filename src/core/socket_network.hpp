@@ -0,0 +1,114 @@
+#pragma once
+
+#include "network_mock.hpp"
+#include "wire.hpp"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace home_task::socket_network {
+
+enum class ESocketFamily : uint32_t {
+    Tcp,
+    Unix,
+};
+
+struct SocketAddress {
+    ESocketFamily Family_ = ESocketFamily::Tcp;
+    // host for tcp, path for unix
+    std::string Host_ = "127.0.0.1";
+    uint16_t Port_ = 0;
+
+    // tcp://127.0.0.1:7000 or unix:///tmp/home_task.sock
+    static std::optional<SocketAddress> Parse(const std::string &_address);
+};
+
+// INetworkClient over non-blocking stream sockets.
+// One thread runs an epoll loop for every connection of the client. Received bytes are
+// cut into wire messages and pushed to a local mailbox, so receiving works as with NetworkMock.
+// Send only encodes the message into the output of the connection and wakes the loop once,
+// every message appended until the loop gets to the connection leaves with the same writev.
+// A listening client learns the ids of its peers from the senders of their messages,
+// a connected client sends everything to the server it connected to.
+class SocketNetworkClient : public network_mock::INetworkClient {
+    // small messages are appended to the last chunk of the output until it reaches this size
+    static constexpr uint64_t OutputChunkSize = 64 << 10;
+    static constexpr uint64_t ReadSize = 64 << 10;
+
+    struct Connection {
+        int Fd_ = -1;
+        std::optional<model::ClientId> Peer_;
+
+        std::mutex Mutex_;
+        std::deque<wire::Buffer> Output_;
+        uint64_t OutputOffset_ = 0;
+        bool FlushScheduled_ = false;
+        bool WaitWritable_ = false;
+        bool Closed_ = false;
+
+        wire::Buffer Input_;
+        uint64_t InputOffset_ = 0;
+    };
+
+    model::ClientId Id_;
+    int Epoll_ = -1;
+    int WakeUp_ = -1;
+    int Listener_ = -1;
+
+    std::mutex Mutex_;
+    std::unordered_map<int, std::shared_ptr<Connection>> Connections_;
+    std::unordered_map<model::ClientId, std::shared_ptr<Connection>> Peers_;
+    std::vector<std::shared_ptr<Connection>> PendingFlush_;
+
+    // the server of a connected client
+    std::shared_ptr<Connection> Upstream_;
+
+    std::shared_ptr<network_mock::NetworkMock> Inbox_;
+    std::atomic<bool> Stopped_ = false;
+    std::thread Thread_;
+
+    std::atomic<uint64_t> SentMessages_ = 0;
+    std::atomic<uint64_t> ReceivedMessages_ = 0;
+    std::atomic<uint64_t> SentBytes_ = 0;
+    std::atomic<uint64_t> ReceivedBytes_ = 0;
+    std::atomic<uint64_t> WriteCalls_ = 0;
+
+    SocketNetworkClient(model::ClientId _id);
+
+    std::shared_ptr<Connection> AddConnection(int _fd);
+    void Accept();
+    void Read(const std::shared_ptr<Connection> &_connection);
+    void Flush(const std::shared_ptr<Connection> &_connection);
+    void Close(const std::shared_ptr<Connection> &_connection);
+    void Loop();
+
+public:
+    static std::unique_ptr<SocketNetworkClient> Listen(const SocketAddress &_address, model::ClientId _id);
+    static std::unique_ptr<SocketNetworkClient> Connect(const SocketAddress &_address, model::ClientId _id);
+
+    ~SocketNetworkClient();
+
+    // _receiver equal to the own id puts the message to the own mailbox, e.g. Poison
+    void Send(model::ClientId _receiver, std::unique_ptr<network_mock::MessageRecord> &&_msg) override;
+
+    std::optional<std::unique_ptr<network_mock::MessageRecord>> Receive() override;
+
+    std::unique_ptr<network_mock::MessageRecord> ReceiveWithWaiting() override;
+
+    uint32_t ReceiveAll(std::vector<std::unique_ptr<network_mock::MessageRecord>> *_messages) override;
+
+    uint32_t ReceiveAllWithWaiting(std::vector<std::unique_ptr<network_mock::MessageRecord>> *_messages) override;
+
+    void WaitMessage() override;
+
+    std::string PrintStat() const;
+};
+
+}
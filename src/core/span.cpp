@@ -0,0 +1,177 @@
+#include "span.hpp"
+
+#include "log.hpp"
+#include "records.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace home_task::log;
+using namespace home_task;
+
+namespace {
+
+// spans a thread keeps before handing them to the collector
+constexpr size_t LocalSpanCount = 1024;
+
+// Spans handed over by the threads, written to SpanFile at exit.
+// It's never destroyed: threads may still write spans while the process exits.
+class SpanCollector {
+public:
+    static SpanCollector& Instance() {
+        static SpanCollector *collector = [] {
+            auto *created = new SpanCollector();
+            std::atexit([] { Instance().Write(); });
+            return created;
+        }();
+        return *collector;
+    }
+
+    void Add(std::vector<SpanRecord> &_spans) {
+        std::lock_guard<std::mutex> guard(Mutex_);
+        uint64_t room = magic_numbers::SpanLimit - std::min<uint64_t>(Spans_.size(), magic_numbers::SpanLimit);
+        uint64_t taken = std::min<uint64_t>(room, _spans.size());
+        Spans_.insert(Spans_.end(), _spans.begin(), _spans.begin() + taken);
+        Dropped_ += _spans.size() - taken;
+        _spans.clear();
+    }
+
+    void Write();
+
+private:
+    std::mutex Mutex_;
+    std::vector<SpanRecord> Spans_;
+    uint64_t Dropped_ = 0;
+};
+
+struct LocalSpans {
+    std::vector<SpanRecord> Spans_;
+
+    ~LocalSpans() {
+        if (!Spans_.empty()) {
+            SpanCollector::Instance().Add(Spans_);
+        }
+    }
+};
+
+thread_local LocalSpans Local;
+// a random phase, so short lived threads are sampled at the same rate as the others
+thread_local uint32_t SampleCounter = std::random_device{}() % magic_numbers::SpanSampleRate;
+std::atomic<uint64_t> LastTraceId = 0;
+
+const char* TypeName(uint32_t _type) {
+    switch (_type) {
+    case static_cast<uint32_t>(network_mock::EMessageType::Ping): return "Ping";
+    case static_cast<uint32_t>(network_mock::EMessageType::Pong): return "Pong";
+    case static_cast<uint32_t>(network_mock::EMessageType::String): return "String";
+    case static_cast<uint32_t>(network_mock::EMessageType::Poison): return "Poison";
+    case static_cast<uint32_t>(network_mock::EMessageType::Connect): return "Connect";
+    case static_cast<uint32_t>(api::EAPIEventsType::LoadStateRequest): return "LoadStateRequest";
+    case static_cast<uint32_t>(api::EAPIEventsType::UpdateValueRequest): return "UpdateValueRequest";
+    case static_cast<uint32_t>(api::EAPIEventsType::InsertValueRequest): return "InsertValueRequest";
+    case static_cast<uint32_t>(api::EAPIEventsType::DeleteValueRequest): return "DeleteValueRequest";
+    case static_cast<uint32_t>(api::EAPIEventsType::SyncRequest): return "SyncRequest";
+    case static_cast<uint32_t>(api::EAPIEventsType::ResumeRequest): return "ResumeRequest";
+    case static_cast<uint32_t>(api::EAPIEventsType::OpenArrayRequest): return "OpenArrayRequest";
+    case static_cast<uint32_t>(api::EAPIEventsType::SubscribeRequest): return "SubscribeRequest";
+    case static_cast<uint32_t>(api::EAPIEventsType::PushAckRequest): return "PushAckRequest";
+    case static_cast<uint32_t>(api::EAPIEventsType::State): return "State";
+    case static_cast<uint32_t>(api::EAPIEventsType::UpdateValueResponse): return "UpdateValueResponse";
+    case static_cast<uint32_t>(api::EAPIEventsType::InsertValueResponse): return "InsertValueResponse";
+    case static_cast<uint32_t>(api::EAPIEventsType::DeleteValueResponse): return "DeleteValueResponse";
+    case static_cast<uint32_t>(api::EAPIEventsType::SyncResponse): return "SyncResponse";
+    case static_cast<uint32_t>(api::EAPIEventsType::PushResponse): return "PushResponse";
+    }
+    return "Unknown";
+}
+
+// Messages are async events with the trace as id, so every sampled message gets its own row in the viewer,
+// the work of actors goes to the row of the actor.
+void SpanCollector::Write() {
+    std::lock_guard<std::mutex> guard(Mutex_);
+    if (Spans_.empty()) {
+        return;
+    }
+    std::sort(Spans_.begin(), Spans_.end(), [] (const SpanRecord &_left, const SpanRecord &_right) {
+        return _left.Start_ < _right.Start_;
+    });
+    uint64_t base = Spans_.front().Start_;
+    auto micros = [&] (uint64_t _time) {
+        return (_time - base) / 1000.0;
+    };
+
+    std::ofstream out(magic_numbers::SpanFile);
+    if (!out) {
+        ForceWrite("can't write spans to ", magic_numbers::SpanFile);
+        return;
+    }
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    const char *separator = "\n";
+    std::set<uint32_t> actors;
+    for (auto &span : Spans_) {
+        actors.insert(span.Actor_);
+    }
+    for (uint32_t actor : actors) {
+        out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << actor
+            << ",\"args\":{\"name\":\"";
+        if (actor == magic_numbers::ServerId) {
+            out << "server";
+        } else {
+            out << "actor " << actor;
+        }
+        out << "\"}}";
+        separator = ",\n";
+    }
+    for (auto &span : Spans_) {
+        out << separator;
+        if (span.TraceId_) {
+            out << "{\"name\":\"" << span.Name_ << "\",\"cat\":\"message\",\"ph\":\"b\",\"id\":" << span.TraceId_
+                << ",\"ts\":" << micros(span.Start_) << ",\"pid\":1,\"tid\":" << span.Actor_
+                << ",\"args\":{\"type\":\"" << TypeName(span.Type_) << "\",\"sender\":" << span.Sender_
+                << ",\"actor\":" << span.Actor_ << ",\"iteration\":" << span.Iteration_ << "}},\n"
+                << "{\"name\":\"" << span.Name_ << "\",\"cat\":\"message\",\"ph\":\"e\",\"id\":" << span.TraceId_
+                << ",\"ts\":" << micros(span.End_) << ",\"pid\":1,\"tid\":" << span.Actor_ << '}';
+        } else {
+            out << "{\"name\":\"" << span.Name_ << "\",\"cat\":\"actor\",\"ph\":\"X\""
+                << ",\"ts\":" << micros(span.Start_) << ",\"dur\":" << micros(span.End_) - micros(span.Start_)
+                << ",\"pid\":1,\"tid\":" << span.Actor_ << '}';
+        }
+    }
+    out << "\n]}\n";
+    ForceWrite("Spans# ", Spans_.size(), " Dropped# ", Dropped_, " File# ", magic_numbers::SpanFile);
+}
+
+}
+
+bool home_task::log::SampleSpan() {
+    return ++SampleCounter % magic_numbers::SpanSampleRate == 0;
+}
+
+uint64_t home_task::log::NewTraceId() {
+    return ++LastTraceId;
+}
+
+void home_task::log::WriteSpan(const SpanRecord &_span) {
+    if (Local.Spans_.empty()) {
+        // created before the exit of the first thread that writes, so the file is written at exit
+        SpanCollector::Instance();
+        Local.Spans_.reserve(LocalSpanCount);
+    }
+    Local.Spans_.push_back(_span);
+    if (Local.Spans_.size() == LocalSpanCount) {
+        SpanCollector::Instance().Add(Local.Spans_);
+    }
+}
+
+SpanScope*& SpanScope::Current() {
+    thread_local SpanScope *current = nullptr;
+    return current;
+}
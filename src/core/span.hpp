@@ -0,0 +1,120 @@
+#pragma once
+
+#include "magic_numbers.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+
+namespace home_task::log {
+
+// A stage in the life of a sampled message or a piece of work of an actor, timed by the steady clock in ns.
+// Spans are kept in memory and written to SpanFile in the Chrome trace-event format at exit.
+struct SpanRecord {
+    // a literal
+    const char *Name_;
+    // 0 for the work of an actor that doesn't belong to a message
+    uint64_t TraceId_;
+    uint64_t Start_;
+    uint64_t End_;
+    uint32_t Actor_;
+    uint32_t Sender_;
+    uint32_t Type_;
+    uint64_t Iteration_;
+};
+
+inline uint64_t SpanClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// One call of SpanSampleRate on the thread says yes.
+bool SampleSpan();
+
+uint64_t NewTraceId();
+
+void WriteSpan(const SpanRecord &_span);
+
+// Times its scope as a span. The innermost recording scope of the thread is the current one:
+// messages sent inside a scope of a sampled message carry its trace, nested scopes belong to the same actor.
+// A scope of a message that isn't sampled costs nothing but a check.
+class SpanScope {
+public:
+    // A stage of the message with _traceId, recorded when it's not 0.
+    SpanScope(const char *_name, uint32_t _actor, uint64_t _traceId, uint32_t _sender, uint32_t _type) {
+        if constexpr (magic_numbers::WithSpans) {
+            if (_traceId) {
+                Begin(_name, _actor, _traceId, _sender, _type);
+            }
+        }
+    }
+
+    // Work of an actor, sampled as messages are.
+    SpanScope(const char *_name, uint32_t _actor) {
+        if constexpr (magic_numbers::WithSpans) {
+            if (SampleSpan()) {
+                Begin(_name, _actor, 0, 0, 0);
+            }
+        }
+    }
+
+    // A part of the current scope, recorded when the current one is.
+    explicit SpanScope(const char *_name) {
+        if constexpr (magic_numbers::WithSpans) {
+            SpanScope *parent = Current();
+            if (parent) {
+                Begin(_name, parent->Span_.Actor_, parent->Span_.TraceId_, parent->Span_.Sender_, parent->Span_.Type_);
+            }
+        }
+    }
+
+    SpanScope(const SpanScope&) = delete;
+    SpanScope& operator=(const SpanScope&) = delete;
+
+    ~SpanScope() {
+        if constexpr (magic_numbers::WithSpans) {
+            if (Recording_) {
+                Span_.End_ = SpanClock();
+                WriteSpan(Span_);
+                Current() = Parent_;
+            }
+        }
+    }
+
+    void SetIteration(uint64_t _iteration) {
+        Span_.Iteration_ = _iteration;
+    }
+
+    // The trace of the current scope of the thread, 0 when there is none.
+    static uint64_t CurrentTraceId() {
+        if constexpr (magic_numbers::WithSpans) {
+            SpanScope *current = Current();
+            return current ? current->Span_.TraceId_ : 0;
+        }
+        return 0;
+    }
+
+private:
+    static SpanScope*& Current();
+
+    void Begin(const char *_name, uint32_t _actor, uint64_t _traceId, uint32_t _sender, uint32_t _type) {
+        Span_ = SpanRecord{
+            .Name_ = _name,
+            .TraceId_ = _traceId,
+            .Start_ = SpanClock(),
+            .End_ = 0,
+            .Actor_ = _actor,
+            .Sender_ = _sender,
+            .Type_ = _type,
+            .Iteration_ = 0,
+        };
+        Recording_ = true;
+        Parent_ = std::exchange(Current(), this);
+    }
+
+    SpanRecord Span_{};
+    SpanScope *Parent_ = nullptr;
+    bool Recording_ = false;
+};
+
+}
@@ -0,0 +1,209 @@
+#include "trace.hpp"
+
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace home_task::log;
+
+namespace {
+
+// Drains the rings of all threads, orders the records by time and prints them to std::cerr.
+// It's never destroyed: threads may log while the process exits, at exit it's only stopped and drained.
+class Tracer {
+public:
+    static Tracer& Instance() {
+        static Tracer *tracer = [] {
+            auto *created = new Tracer();
+            std::atexit([] { Instance().Stop(); });
+            return created;
+        }();
+        return *tracer;
+    }
+
+    TraceRing* Register() {
+        auto *ring = new TraceRing();
+        std::lock_guard<std::mutex> guard(Mutex_);
+        Rings_.push_back(ring);
+        return ring;
+    }
+
+    void Flush() {
+        std::unique_lock<std::mutex> lock(Mutex_);
+        uint64_t target = ++FlushRequested_;
+        Wakeup_.notify_one();
+        Flushed_.wait(lock, [&] { return FlushDone_ >= target || Stopped_; });
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> guard(Mutex_);
+            if (Stopped_) {
+                return;
+            }
+            Stopped_ = true;
+        }
+        Wakeup_.notify_one();
+        Thread_.join();
+        Drain();
+    }
+
+private:
+    Tracer() {
+        Thread_ = std::thread(&Tracer::Work, this);
+    }
+
+    // Returns false when there was nothing to print.
+    bool Drain() {
+        std::vector<TraceRing*> rings;
+        {
+            std::lock_guard<std::mutex> guard(Mutex_);
+            rings = Rings_;
+        }
+        Batch_.clear();
+        uint64_t dropped = 0;
+        std::vector<TraceRing*> finished;
+        for (TraceRing *ring : rings) {
+            // the orphan flag is read before the head, so nothing written before it is missed
+            bool orphaned = ring->Orphaned_.load(std::memory_order_acquire);
+            uint64_t tail = ring->Tail_.load(std::memory_order_relaxed);
+            uint64_t head = ring->Head_.load(std::memory_order_acquire);
+            for (; tail != head; ++tail) {
+                Batch_.push_back(ring->Records_[tail & (TraceRing::Size - 1)]);
+            }
+            ring->Tail_.store(tail, std::memory_order_release);
+            dropped += ring->Dropped_.exchange(0, std::memory_order_relaxed);
+            if (orphaned) {
+                finished.push_back(ring);
+            }
+        }
+        if (!finished.empty()) {
+            std::lock_guard<std::mutex> guard(Mutex_);
+            std::erase_if(Rings_, [&] (TraceRing *_ring) {
+                return std::find(finished.begin(), finished.end(), _ring) != finished.end();
+            });
+        }
+        for (TraceRing *ring : finished) {
+            delete ring;
+        }
+        if (Batch_.empty() && !dropped) {
+            return false;
+        }
+
+        std::sort(Batch_.begin(), Batch_.end(), [] (const TraceRecord &_left, const TraceRecord &_right) {
+            return _left.Time_ < _right.Time_;
+        });
+        std::ostringstream sout;
+        for (auto &record : Batch_) {
+            record.Format(sout);
+            sout << '\n';
+        }
+        if (dropped) {
+            sout << "log: dropped " << dropped << " records, the rings were full\n";
+        }
+        std::cerr << sout.str();
+        return true;
+    }
+
+    void Work() {
+        std::unique_lock<std::mutex> lock(Mutex_);
+        while (!Stopped_) {
+            uint64_t requested = FlushRequested_;
+            lock.unlock();
+            bool printed = Drain();
+            lock.lock();
+            if (requested != FlushDone_) {
+                FlushDone_ = requested;
+                Flushed_.notify_all();
+            }
+            if (!printed) {
+                Wakeup_.wait_for(lock, home_task::magic_numbers::TracePollInterval, [&] {
+                    return Stopped_ || FlushRequested_ != FlushDone_;
+                });
+            }
+        }
+    }
+
+    std::mutex Mutex_;
+    std::condition_variable Wakeup_;
+    std::condition_variable Flushed_;
+    std::vector<TraceRing*> Rings_;
+    uint64_t FlushRequested_ = 0;
+    uint64_t FlushDone_ = 0;
+    bool Stopped_ = false;
+    // only the tracer thread and Stop after it's joined use it
+    std::vector<TraceRecord> Batch_;
+    std::thread Thread_;
+};
+
+// set by the first registered ring, there is nothing to flush before it
+std::atomic<bool> Started = false;
+
+struct RingHolder {
+    TraceRing *Ring_ = nullptr;
+
+    ~RingHolder() {
+        if (Ring_) {
+            Ring_->Orphaned_.store(true, std::memory_order_release);
+        }
+    }
+};
+
+}
+
+void TraceRecord::Format(std::ostream &_out) const {
+    for (uint32_t idx = 0; idx < Used_; ++idx) {
+        uint64_t value = Slots_[idx];
+        switch (static_cast<EKind>((Kinds_ >> (idx * KindBits)) & ((1 << KindBits) - 1))) {
+        case None:
+            break;
+        case Literal:
+            _out << reinterpret_cast<const char*>(value);
+            break;
+        case Signed:
+            _out << static_cast<int64_t>(value);
+            break;
+        case Unsigned:
+            _out << value;
+            break;
+        case Double: {
+            double number;
+            std::memcpy(&number, &value, sizeof(number));
+            _out << number;
+            break;
+        }
+        case Char:
+            _out << static_cast<char>(value);
+            break;
+        case Bool:
+            _out << static_cast<bool>(value);
+            break;
+        case Inline:
+            _out << std::string_view(reinterpret_cast<const char*>(Slots_ + idx + 1), value);
+            idx += (value + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+            break;
+        }
+    }
+    if (Truncated_) {
+        _out << "...";
+    }
+}
+
+TraceRing& home_task::log::GetThreadRing() {
+    thread_local RingHolder holder;
+    if (!holder.Ring_) {
+        holder.Ring_ = Tracer::Instance().Register();
+        Started.store(true, std::memory_order_release);
+    }
+    return *holder.Ring_;
+}
+
+void home_task::log::FlushTrace() {
+    if (!Started.load(std::memory_order_acquire)) {
+        return;
+    }
+    Tracer::Instance().Flush();
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "magic_numbers.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace home_task::log {
+
+// A string that lives as long as the program: the constructor is consteval, so only a literal
+// or another constant of static storage makes one. The first argument of every log line is a Literal.
+struct Literal {
+    const char *Str_;
+
+    template <size_t _Size>
+    consteval Literal(const char (&_str)[_Size])
+        : Str_(_str)
+    {}
+};
+
+inline std::ostream& operator<<(std::ostream &_out, Literal _literal) {
+    return _out << _literal.Str_;
+}
+
+// Binary record of one log line: the arguments are stored as they are, formatting is left to the tracer thread.
+// Literals are kept by pointer, other strings, char arrays too, are copied into the slots and may be truncated.
+struct TraceRecord {
+    enum EKind : uint8_t {
+        None,
+        Literal,
+        Signed,
+        Unsigned,
+        Double,
+        Char,
+        Bool,
+        // the slot keeps the length, the bytes follow in the next slots
+        Inline,
+    };
+
+    static constexpr uint32_t SlotCount = 13;
+    static constexpr uint32_t KindBits = 4;
+
+    uint64_t Time_ = 0;
+    // KindBits per slot
+    uint64_t Kinds_ = 0;
+    uint32_t Used_ = 0;
+    uint32_t Truncated_ = 0;
+    uint64_t Slots_[SlotCount];
+
+    bool Add(EKind _kind, uint64_t _value) {
+        if (Used_ == SlotCount) {
+            Truncated_ = 1;
+            return false;
+        }
+        Kinds_ |= static_cast<uint64_t>(_kind) << (Used_ * KindBits);
+        Slots_[Used_++] = _value;
+        return true;
+    }
+
+    void AddString(std::string_view _str) {
+        if (Used_ == SlotCount) {
+            Truncated_ = 1;
+            return;
+        }
+        uint64_t room = (SlotCount - Used_ - 1) * sizeof(uint64_t);
+        uint64_t size = std::min<uint64_t>(_str.size(), room);
+        Truncated_ |= size < _str.size();
+        Add(Inline, size);
+        std::memcpy(Slots_ + Used_, _str.data(), size);
+        Used_ += (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    }
+
+    template <typename _Arg>
+    void Put(_Arg &&_arg) {
+        using TDecay = std::decay_t<_Arg>;
+        if constexpr (std::is_invocable_v<_Arg>) {
+            // lazy arguments are computed only for enabled categories
+            Put(_arg());
+        } else if constexpr (std::is_same_v<TDecay, log::Literal>) {
+            Add(Literal, reinterpret_cast<uint64_t>(_arg.Str_));
+        } else if constexpr (std::is_same_v<TDecay, bool>) {
+            Add(Bool, _arg);
+        } else if constexpr (std::is_same_v<TDecay, char>) {
+            Add(Char, static_cast<uint8_t>(_arg));
+        } else if constexpr (std::is_enum_v<TDecay>) {
+            Put(static_cast<std::underlying_type_t<TDecay>>(_arg));
+        } else if constexpr (std::is_integral_v<TDecay> && std::is_signed_v<TDecay>) {
+            Add(Signed, static_cast<uint64_t>(static_cast<int64_t>(_arg)));
+        } else if constexpr (std::is_integral_v<TDecay>) {
+            Add(Unsigned, static_cast<uint64_t>(_arg));
+        } else if constexpr (std::is_floating_point_v<TDecay>) {
+            double value = _arg;
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            Add(Double, bits);
+        } else if constexpr (std::is_convertible_v<const _Arg&, std::string_view>) {
+            AddString(std::string_view(_arg));
+        } else {
+            std::ostringstream sout;
+            sout << _arg;
+            AddString(sout.str());
+        }
+    }
+
+    void Format(std::ostream &_out) const;
+};
+
+static_assert(sizeof(TraceRecord) == 128);
+static_assert(TraceRecord::SlotCount * TraceRecord::KindBits <= 64);
+
+// Ring of one thread: the thread writes, the tracer thread reads. A full ring drops records, the writer never waits.
+struct TraceRing {
+    static constexpr uint64_t Size = magic_numbers::TraceRingRecords;
+    static_assert((Size & (Size - 1)) == 0);
+
+    std::unique_ptr<TraceRecord[]> Records_ = std::make_unique<TraceRecord[]>(Size);
+    alignas(64) std::atomic<uint64_t> Head_ = 0;
+    alignas(64) std::atomic<uint64_t> Tail_ = 0;
+    std::atomic<uint64_t> Dropped_ = 0;
+    // the thread is gone, the ring is freed after it's drained
+    std::atomic<bool> Orphaned_ = false;
+
+    TraceRecord* Reserve() {
+        uint64_t head = Head_.load(std::memory_order_relaxed);
+        if (head - Tail_.load(std::memory_order_acquire) == Size) {
+            Dropped_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &Records_[head & (Size - 1)];
+    }
+
+    void Commit() {
+        Head_.store(Head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+// The ring of the calling thread, registered in the tracer on the first record.
+TraceRing& GetThreadRing();
+
+template <typename ... _Args>
+void Trace(_Args&&... _args) {
+    TraceRing &ring = GetThreadRing();
+    TraceRecord *record = ring.Reserve();
+    if (!record) {
+        return;
+    }
+    record->Time_ = std::chrono::steady_clock::now().time_since_epoch().count();
+    record->Kinds_ = 0;
+    record->Used_ = 0;
+    record->Truncated_ = 0;
+    (record->Put(std::forward<_Args>(_args)), ...);
+    ring.Commit();
+}
+
+// Waits until the tracer thread prints every record written before the call,
+// doesn't start the tracer when nothing was written yet.
+void FlushTrace();
+
+}
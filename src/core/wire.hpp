@@ -0,0 +1,301 @@
+#pragma once
+
+#include "model.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+namespace home_task::wire {
+
+// Every message on the wire starts with a fixed header:
+//   Length_  u32  bytes after the length field (header tail + body)
+//   Version_ u8
+//   Flags_   u8   body encoding, see EFlags
+//   Reserved u16
+//   Type_    u32
+//   Sender_  u32
+// All integers are little-endian, records are packed without padding.
+// 2: State and ResumeRequest carry the epoch of the array
+constexpr uint8_t Version = 2;
+constexpr uint32_t LengthSize = sizeof(uint32_t);
+constexpr uint32_t HeaderSize = 16;
+
+enum EFlags : uint8_t {
+    Plain = 0,
+    CompactDiff = 1,
+    ColumnarState = 2,
+};
+
+using Buffer = std::vector<uint8_t>;
+
+
+inline void StoreU16(uint8_t *_dst, uint16_t _value) {
+    _dst[0] = static_cast<uint8_t>(_value);
+    _dst[1] = static_cast<uint8_t>(_value >> 8);
+}
+
+inline void StoreU32(uint8_t *_dst, uint32_t _value) {
+    for (uint32_t idx = 0; idx < sizeof(_value); ++idx) {
+        _dst[idx] = static_cast<uint8_t>(_value >> (8 * idx));
+    }
+}
+
+inline void StoreU64(uint8_t *_dst, uint64_t _value) {
+    for (uint32_t idx = 0; idx < sizeof(_value); ++idx) {
+        _dst[idx] = static_cast<uint8_t>(_value >> (8 * idx));
+    }
+}
+
+inline uint16_t LoadU16(const uint8_t *_src) {
+    return static_cast<uint16_t>(_src[0] | (_src[1] << 8));
+}
+
+inline uint32_t LoadU32(const uint8_t *_src) {
+    uint32_t value = 0;
+    for (uint32_t idx = 0; idx < sizeof(value); ++idx) {
+        value |= static_cast<uint32_t>(_src[idx]) << (8 * idx);
+    }
+    return value;
+}
+
+inline uint64_t LoadU64(const uint8_t *_src) {
+    uint64_t value = 0;
+    for (uint32_t idx = 0; idx < sizeof(value); ++idx) {
+        value |= static_cast<uint64_t>(_src[idx]) << (8 * idx);
+    }
+    return value;
+}
+
+
+template <typename _Record>
+struct Codec;
+
+template <>
+struct Codec<model::Cell> {
+    static constexpr uint32_t Size = sizeof(model::CellId) + sizeof(model::Value);
+
+    static void Store(uint8_t *_dst, const model::Cell &_cell) {
+        StoreU64(_dst, _cell.CellId_);
+        StoreU32(_dst + sizeof(model::CellId), _cell.Value_);
+    }
+
+    static model::Cell Load(const uint8_t *_src) {
+        return model::Cell(LoadU64(_src), LoadU32(_src + sizeof(model::CellId)));
+    }
+};
+
+template <>
+struct Codec<model::UpdateValue> {
+    static constexpr uint32_t Size = Codec<model::Cell>::Size;
+
+    static void Store(uint8_t *_dst, const model::UpdateValue &_update) {
+        Codec<model::Cell>::Store(_dst, _update.Cell_);
+    }
+
+    static model::UpdateValue Load(const uint8_t *_src) {
+        return model::UpdateValue{.Cell_ = Codec<model::Cell>::Load(_src)};
+    }
+};
+
+template <>
+struct Codec<model::InsertValue> {
+    static constexpr uint32_t Size = sizeof(model::CellId) + Codec<model::Cell>::Size;
+
+    static void Store(uint8_t *_dst, const model::InsertValue &_insert) {
+        StoreU64(_dst, _insert.NearCellId_);
+        Codec<model::Cell>::Store(_dst + sizeof(model::CellId), _insert.Cell_);
+    }
+
+    static model::InsertValue Load(const uint8_t *_src) {
+        return model::InsertValue{
+                .NearCellId_ = LoadU64(_src),
+                .Cell_ = Codec<model::Cell>::Load(_src + sizeof(model::CellId))};
+    }
+};
+
+template <>
+struct Codec<model::DeleteValue> {
+    static constexpr uint32_t Size = sizeof(model::CellId);
+
+    static void Store(uint8_t *_dst, const model::DeleteValue &_delete) {
+        StoreU64(_dst, _delete.CellId_);
+    }
+
+    static model::DeleteValue Load(const uint8_t *_src) {
+        return model::DeleteValue{.CellId_ = LoadU64(_src)};
+    }
+};
+
+// Size of a length-prefixed array of records.
+template <typename _Record>
+constexpr uint32_t ArraySize(uint64_t _count) {
+    return sizeof(uint32_t) + Codec<_Record>::Size * _count;
+}
+
+
+// Read-only view over a length-prefixed array of records, decodes elements on access.
+template <typename _Record>
+struct ArrayView {
+    const uint8_t *Data_ = nullptr;
+    uint32_t Count_ = 0;
+
+    struct Iterator {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = _Record;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = _Record;
+
+        const uint8_t *Current_;
+
+        _Record operator*() const {
+            return Codec<_Record>::Load(Current_);
+        }
+
+        Iterator& operator++() {
+            Current_ += Codec<_Record>::Size;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator prev = *this;
+            Current_ += Codec<_Record>::Size;
+            return prev;
+        }
+
+        bool operator==(const Iterator &_rhs) const {
+            return Current_ == _rhs.Current_;
+        }
+    };
+
+    uint32_t size() const {
+        return Count_;
+    }
+
+    bool empty() const {
+        return !Count_;
+    }
+
+    _Record operator[](uint32_t _idx) const {
+        return Codec<_Record>::Load(Data_ + Codec<_Record>::Size * _idx);
+    }
+
+    Iterator begin() const {
+        return Iterator{Data_};
+    }
+
+    Iterator end() const {
+        return Iterator{Data_ + Codec<_Record>::Size * Count_};
+    }
+};
+
+
+struct Writer {
+    Buffer *Buffer_;
+
+    uint8_t* Grow(uint32_t _size) {
+        size_t offset = Buffer_->size();
+        Buffer_->resize(offset + _size);
+        return Buffer_->data() + offset;
+    }
+
+    void PutU8(uint8_t _value) {
+        Buffer_->push_back(_value);
+    }
+
+    void PutU16(uint16_t _value) {
+        StoreU16(Grow(sizeof(_value)), _value);
+    }
+
+    void PutU32(uint32_t _value) {
+        StoreU32(Grow(sizeof(_value)), _value);
+    }
+
+    void PutU64(uint64_t _value) {
+        StoreU64(Grow(sizeof(_value)), _value);
+    }
+
+    void PutBytes(std::string_view _bytes) {
+        PutU32(_bytes.size());
+        std::memcpy(Grow(_bytes.size()), _bytes.data(), _bytes.size());
+    }
+
+    template <typename _Container>
+    void PutArray(const _Container &_records) {
+        using record = typename _Container::value_type;
+        PutU32(_records.size());
+        uint8_t *dst = Grow(Codec<record>::Size * _records.size());
+        for (auto &el : _records) {
+            Codec<record>::Store(dst, el);
+            dst += Codec<record>::Size;
+        }
+    }
+};
+
+
+// Bounds-checked cursor over a received buffer, Ok_ drops to false on the first overrun.
+struct Reader {
+    const uint8_t *Current_;
+    const uint8_t *End_;
+    bool Ok_ = true;
+
+    Reader(const uint8_t *_data, uint64_t _size)
+        : Current_(_data)
+        , End_(_data + _size)
+    {}
+
+    const uint8_t* Take(uint64_t _size) {
+        if (!Ok_ || static_cast<uint64_t>(End_ - Current_) < _size) {
+            Ok_ = false;
+            return nullptr;
+        }
+        return std::exchange(Current_, Current_ + _size);
+    }
+
+    uint8_t GetU8() {
+        auto src = Take(sizeof(uint8_t));
+        return src ? *src : 0;
+    }
+
+    uint16_t GetU16() {
+        auto src = Take(sizeof(uint16_t));
+        return src ? LoadU16(src) : 0;
+    }
+
+    uint32_t GetU32() {
+        auto src = Take(sizeof(uint32_t));
+        return src ? LoadU32(src) : 0;
+    }
+
+    uint64_t GetU64() {
+        auto src = Take(sizeof(uint64_t));
+        return src ? LoadU64(src) : 0;
+    }
+
+    std::string_view GetBytes() {
+        uint32_t size = GetU32();
+        auto src = Take(size);
+        return src ? std::string_view(reinterpret_cast<const char*>(src), size) : std::string_view();
+    }
+
+    template <typename _Record>
+    ArrayView<_Record> GetArray() {
+        uint32_t count = GetU32();
+        auto src = Take(static_cast<uint64_t>(Codec<_Record>::Size) * count);
+        if (!src) {
+            return {};
+        }
+        return ArrayView<_Record>{.Data_ = src, .Count_ = count};
+    }
+
+    bool Finished() const {
+        return Ok_ && Current_ == End_;
+    }
+};
+
+}
@@ -0,0 +1,294 @@
+#include "client_server_template.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace home_task;
+
+namespace {
+
+// The engines are instantiated here, a run picks them by name.
+struct Engine {
+    const char *Name_;
+    exe::TestResult (*Run_)(const exe::TestSettings &_settings);
+};
+
+template <typename _ServerState, typename _ClientState>
+exe::TestResult RunEngine(const exe::TestSettings &_settings) {
+    return exe::RunTest<_ServerState, _ClientState>(_settings, false);
+}
+
+// A point runs in a child process, so the peak memory is of the point alone and not what the allocator
+// and ASan kept after the previous points. The child passes the result back through a pipe,
+// a child that exits on an error fails only its point.
+// The parent doesn't log while sweeping: the tracer thread it would start isn't there in the next children.
+std::optional<exe::TestResult> RunIsolated(const Engine &_engine, const exe::TestSettings &_settings) {
+    static_assert(std::is_trivially_copyable_v<exe::TestResult>);
+    int fds[2];
+    if (pipe(fds)) {
+        log::ForceWrite("can't create a pipe for the point");
+        std::exit(1);
+    }
+    // buffers of the parent aren't written twice by the child
+    std::cout.flush();
+    pid_t child = fork();
+    if (child < 0) {
+        log::ForceWrite("can't fork for the point");
+        std::exit(1);
+    }
+    exe::TestResult result;
+    auto *bytes = reinterpret_cast<char*>(&result);
+    if (!child) {
+        close(fds[0]);
+        result = _engine.Run_(_settings);
+        for (size_t done = 0; done < sizeof(result);) {
+            ssize_t written = write(fds[1], bytes + done, sizeof(result) - done);
+            if (written <= 0) {
+                std::exit(1);
+            }
+            done += written;
+        }
+        std::exit(0);
+    }
+    close(fds[1]);
+    size_t done = 0;
+    while (done < sizeof(result)) {
+        ssize_t received = read(fds[0], bytes + done, sizeof(result) - done);
+        if (received <= 0) {
+            break;
+        }
+        done += received;
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (done != sizeof(result) || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        return std::nullopt;
+    }
+    return result;
+}
+
+constexpr Engine Engines[] = {
+    {"nop", &RunEngine<logic::ServerStateNop, logic::ClientStateNop>},
+    {"small", &RunEngine<logic::ServerState, logic::FastSmallClientState>},
+    {"fast", &RunEngine<logic::ServerState, logic::FastClientState>},
+    {"btree", &RunEngine<logic::ServerState, logic::BTreeClientState>},
+    {"slow", &RunEngine<logic::ServerState, logic::ClientState>},
+};
+
+struct Point {
+    std::string Engine_;
+    uint32_t ClientCount_;
+    uint64_t CellCount_;
+    exe::TestResult Result_;
+};
+
+std::vector<std::string> Split(const std::string &_list) {
+    std::vector<std::string> items;
+    std::istringstream sin(_list);
+    for (std::string item; std::getline(sin, item, ',');) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+template <typename _Number>
+std::vector<_Number> SplitNumbers(const std::string &_list) {
+    std::vector<_Number> numbers;
+    for (auto &item : Split(_list)) {
+        numbers.push_back(std::strtoull(item.c_str(), nullptr, 10));
+    }
+    return numbers;
+}
+
+const Engine& FindEngine(const std::string &_name) {
+    for (auto &engine : Engines) {
+        if (_name == engine.Name_) {
+            return engine;
+        }
+    }
+    std::ostringstream names;
+    for (auto &engine : Engines) {
+        names << ' ' << engine.Name_;
+    }
+    log::ForceWrite("unknown engine ", _name, ", there are:", names.str());
+    std::exit(1);
+}
+
+// Latencies are in seconds, the quantiles are upper bounds of histogram buckets.
+struct Column {
+    const char *Name_;
+    std::function<void(std::ostream&, const Point&)> Write_;
+};
+
+const std::vector<Column>& Columns() {
+    static const std::vector<Column> columns = {
+        {"engine", [] (std::ostream &_out, const Point &_point) { _out << _point.Engine_; }},
+        {"clients", [] (std::ostream &_out, const Point &_point) { _out << _point.ClientCount_; }},
+        {"cells", [] (std::ostream &_out, const Point &_point) { _out << _point.CellCount_; }},
+        {"iterations", [] (std::ostream &_out, const Point &_point) { _out << _point.Result_.Iterations_; }},
+        {"iterations_per_second", [] (std::ostream &_out, const Point &_point) { _out << _point.Result_.IterationsPerSecond_; }},
+        {"work_time", [] (std::ostream &_out, const Point &_point) { _out << _point.Result_.WorkTime_.count(); }},
+        {"sent_bytes", [] (std::ostream &_out, const Point &_point) { _out << _point.Result_.SentBytes_; }},
+        {"received_bytes", [] (std::ostream &_out, const Point &_point) { _out << _point.Result_.ReceivedBytes_; }},
+        {"latency_mean", [] (std::ostream &_out, const Point &_point) { _out << _point.Result_.Latency_.Mean().count(); }},
+        {"latency_p50", [] (std::ostream &_out, const Point &_point) { _out << _point.Result_.Latency_.Quantile(0.5).count(); }},
+        {"latency_p99", [] (std::ostream &_out, const Point &_point) { _out << _point.Result_.Latency_.Quantile(0.99).count(); }},
+        {"latency_max", [] (std::ostream &_out, const Point &_point) { _out << _point.Result_.Latency_.Max_.count(); }},
+        {"peak_resident_bytes", [] (std::ostream &_out, const Point &_point) { _out << _point.Result_.PeakResidentBytes_; }},
+    };
+    return columns;
+}
+
+// Rows are written as soon as their points finish. A JSON report is closed after every row
+// and the next row overwrites the closing bracket, so a report of a stopped sweep is still valid.
+class Report {
+public:
+    Report(const std::string &_path)
+        : Out_(_path)
+        , Csv_(_path.ends_with(".csv"))
+    {
+        Out_ << std::setprecision(9);
+        if (Csv_) {
+            const char *separator = "";
+            for (auto &column : Columns()) {
+                Out_ << std::exchange(separator, ",") << column.Name_;
+            }
+            Out_ << '\n';
+        } else {
+            Out_ << '[';
+        }
+        Close();
+    }
+
+    explicit operator bool() const {
+        return static_cast<bool>(Out_);
+    }
+
+    void Add(const Point &_point) {
+        if (Csv_) {
+            const char *separator = "";
+            for (auto &column : Columns()) {
+                Out_ << std::exchange(separator, ",");
+                column.Write_(Out_, _point);
+            }
+            Out_ << '\n';
+        } else {
+            Out_ << (Rows_ ? ",\n" : "\n") << "  {";
+            const char *separator = "";
+            for (auto &column : Columns()) {
+                Out_ << std::exchange(separator, ", ") << '"' << column.Name_ << "\": ";
+                // the engine is the only string
+                bool quoted = &column == &Columns().front();
+                if (quoted) {
+                    Out_ << '"';
+                }
+                column.Write_(Out_, _point);
+                if (quoted) {
+                    Out_ << '"';
+                }
+            }
+            Out_ << '}';
+        }
+        Rows_++;
+        Close();
+    }
+
+private:
+    void Close() {
+        if (Csv_) {
+            Out_.flush();
+            return;
+        }
+        auto end = Out_.tellp();
+        Out_ << "\n]\n";
+        Out_.flush();
+        Out_.seekp(end);
+    }
+
+    std::ofstream Out_;
+    bool Csv_;
+    uint64_t Rows_ = 0;
+};
+
+}
+
+// client_server_bench [engines] [clients] [cells] [seconds] [iterations] [think time in ms] [report]
+// Lists are comma separated, every engine runs with every client count and every array size.
+// With iterations every client stops after so many iterations, otherwise a point takes the seconds.
+// The report is CSV for a .csv file and JSON otherwise.
+int main(int argc, char **argv) {
+    auto clientCounts = SplitNumbers<uint32_t>(argc > 2 ? argv[2] : "10,100");
+    auto cellCounts = SplitNumbers<uint64_t>(argc > 3 ? argv[3] : "10000,100000");
+    uint64_t seconds = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 10;
+    uint64_t iterations = argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 0;
+    auto thinkTime = std::chrono::milliseconds(argc > 6 ? std::strtoull(argv[6], nullptr, 10) : 0);
+    std::string reportPath = argc > 7 ? argv[7] : "bench.json";
+
+    // every name is checked before the first point
+    std::vector<const Engine*> engines;
+    for (auto &name : Split(argc > 1 ? argv[1] : "nop,small")) {
+        engines.push_back(&FindEngine(name));
+    }
+    Report report(reportPath);
+    if (!report) {
+        log::ForceWrite("can't write the report to ", reportPath);
+        return 1;
+    }
+
+    uint64_t failed = 0;
+    for (const Engine *engine : engines) {
+        for (uint32_t clientCount : clientCounts) {
+            for (uint64_t cellCount : cellCounts) {
+                exe::TestSettings settings{
+                    .ClientCount_ = clientCount,
+                    .CellCount_ = cellCount,
+                    .Duration_ = std::chrono::seconds(seconds),
+                    .Iterations_ = iterations,
+                    .ThinkTime_ = thinkTime,
+                    .WithLatency_ = true,
+                };
+                std::cout << std::fixed << std::setprecision(6)
+                    << "Engine# " << engine->Name_
+                    << " Clients# " << clientCount
+                    << " Cells# " << cellCount;
+                auto result = RunIsolated(*engine, settings);
+                if (!result) {
+                    failed++;
+                    std::cout << " Failed" << std::endl;
+                    continue;
+                }
+                Point point{
+                    .Engine_ = engine->Name_,
+                    .ClientCount_ = clientCount,
+                    .CellCount_ = cellCount,
+                    .Result_ = *result,
+                };
+                report.Add(point);
+                std::cout
+                    << " Iterations# " << point.Result_.Iterations_
+                    << " IterationsPerSecond# " << point.Result_.IterationsPerSecond_
+                    << " LatencyP50# " << point.Result_.Latency_.Quantile(0.5).count() << 's'
+                    << " LatencyP99# " << point.Result_.Latency_.Quantile(0.99).count() << 's'
+                    << " PeakResident# " << point.Result_.PeakResidentBytes_ / 1e6 << "MB" << std::endl;
+            }
+        }
+    }
+    std::cout << "Report# " << reportPath << " Failed# " << failed << std::endl;
+    return failed ? 1 : 0;
+}
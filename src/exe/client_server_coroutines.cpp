@@ -0,0 +1,18 @@
+#include "client_server_template.hpp"
+
+#include <string>
+
+
+using namespace home_task;
+
+// client_server_coroutines [full]
+// Without arguments the states are Nop, so only the actors and the network are measured,
+// with full clients keep real arrays and the single server becomes the bottleneck.
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "full") {
+        exe::Test<logic::ServerState, logic::FastSmallClientState, 10'000, 1'000, 0, 0, 4>();
+    } else {
+        exe::Test<logic::ServerStateNop, logic::ClientStateNop, 100'000, 1'000, 0, 0, 4>();
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <actors/event_simulation.hpp>
+#include <logic/server_state.hpp>
+#include <logic/client_state.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace home_task;
+
+template <typename _ServerState, typename _ClientState>
+void Simulate(const network_mock::SimulationSettings &_settings, uint32_t _clientCount, uint64_t _cellCount, uint64_t _seconds) {
+    std::vector<model::Cell> initCells;
+    {
+        std::mt19937 gen(_settings.Seed_);
+        std::uniform_int_distribution<uint32_t> valueDistrib(0);
+        initCells.reserve(_cellCount);
+        for (uint64_t idx = 0; idx < _cellCount; ++idx) {
+            initCells.emplace_back(idx + 1, valueDistrib(gen));
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    actors::BasicEventSimulation<_ServerState, _ClientState> simulation(_settings, _clientCount, initCells, std::chrono::seconds(_seconds));
+    simulation.Run();
+    std::chrono::duration<double> wallTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << simulation.PrintStat();
+    // stdout is the same for the same arguments, the wall time goes aside
+    std::cerr << "WallTime# " << wallTime.count() << 's' << std::endl;
+}
+
+// client_server_events [seed] [clients] [cells] [seconds] [latency in us] [nop]
+// Every message takes the latency plus an exponential tail with the same mean.
+int main(int argc, char **argv) {
+    network_mock::SimulationSettings settings;
+    settings.Seed_ = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1;
+    uint32_t clientCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+    uint64_t cellCount = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 100'000;
+    uint64_t seconds = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 100;
+    auto latency = std::chrono::microseconds(argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 1000);
+    settings.Default_ = network_mock::LinkSettings{
+        .Distribution_ = network_mock::ELatencyDistribution::Exponential,
+        .Latency_ = latency,
+        .Jitter_ = latency,
+    };
+
+    if (argc > 6 && std::string(argv[6]) == "nop") {
+        Simulate<logic::ServerStateNop, logic::ClientStateNop>(settings, clientCount, cellCount, seconds);
+    } else {
+        Simulate<logic::ServerState, logic::FastSmallClientState>(settings, clientCount, cellCount, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <core/network_mock.hpp>
+#include <actors/multi_server.hpp>
+#include <actors/client.hpp>
+#include <logic/client_state.hpp>
+
+#include <iostream>
+#include <random>
+#include <thread>
+
+using namespace home_task;
+
+// client_server_multi [arrays] [cells per array] [clients] [workers] [seconds]
+int main(int argc, char **argv) {
+    uint32_t arrayCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    uint64_t cellCount = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000;
+    uint32_t clientCount = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100;
+    uint32_t workerCount = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+    uint64_t seconds = argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 100;
+
+    uint32_t mainThreadId = clientCount + 1;
+    auto network = std::make_shared<network_mock::NetworkMock>(clientCount + 2);
+    network_mock::NetworkClient networkClient(network, mainThreadId);
+
+    auto serverRunner = std::make_unique<actors::MultiServerRunner>(
+            network_mock::NetworkClient(network, magic_numbers::ServerId),
+            workerCount);
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<uint32_t> valueDistrib(0);
+        std::vector<model::Cell> initCells;
+        initCells.reserve(cellCount);
+        for (uint32_t arrayId = 0; arrayId < arrayCount; ++arrayId) {
+            initCells.clear();
+            for (uint64_t idx = 0; idx < cellCount; ++idx) {
+                initCells.emplace_back(idx + 1, valueDistrib(gen));
+            }
+            serverRunner->AddArray(arrayId, initCells);
+        }
+    }
+
+    std::vector<std::unique_ptr<actors::BasicClientRunner<logic::FastSmallClientState>>> clientsRunners;
+    clientsRunners.reserve(clientCount);
+    for (uint32_t idx = 0; idx < clientCount; ++idx) {
+        clientsRunners.emplace_back(std::make_unique<actors::BasicClientRunner<logic::FastSmallClientState>>(
+                network_mock::NetworkClient(network, idx + 1),
+                std::make_unique<logic::FastSmallClientState>(),
+                idx + 1));
+        clientsRunners.back()->SetArray(idx % arrayCount);
+    }
+
+    std::thread serverThread(&actors::MultiServerRunner::Run, serverRunner.get());
+    std::vector<std::thread> clientsThreads;
+    clientsThreads.reserve(clientCount);
+    for (auto &runner : clientsRunners) {
+        clientsThreads.emplace_back(&actors::BasicClientRunner<logic::FastSmallClientState>::Run, runner.get());
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+    networkClient.Send(magic_numbers::ServerId, network_mock::MakePoisonMessage());
+    for (uint32_t idx = 0; idx < clientCount; ++idx) {
+        networkClient.Send(idx + 1, network_mock::MakePoisonMessage());
+    }
+    serverThread.join();
+    for (auto &thr : clientsThreads) {
+        thr.join();
+    }
+
+    for (auto &runner : clientsRunners) {
+        std::cout << runner->PrintStat();
+    }
+    std::cout << serverRunner->PrintStat();
+    return 0;
+}
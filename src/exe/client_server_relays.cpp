@@ -0,0 +1,9 @@
+#include "client_server_template.hpp"
+
+
+using namespace home_task;
+
+int main() {
+    exe::Test<logic::ServerState, logic::FastSmallClientState, 20, 1'000'000, 0, 4>();
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <core/network_mock.hpp>
+#include <actors/server.hpp>
+#include <actors/client.hpp>
+#include <logic/server_state.hpp>
+#include <logic/client_state.hpp>
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+using namespace home_task;
+
+using Runner = actors::BasicClientRunner<logic::FastSmallClientState>;
+
+void PrintGroup(const char *_name, const std::vector<std::unique_ptr<Runner>> &_runners) {
+    uint64_t iterations = 0;
+    uint64_t sentBytes = 0;
+    uint64_t receivedBytes = 0;
+    uint64_t pushes = 0;
+    for (auto &runner : _runners) {
+        iterations += runner->IteratoinCount_;
+        sentBytes += runner->SentBytes_;
+        receivedBytes += runner->ReceivedBytes_;
+        pushes += runner->Pushes_;
+    }
+    if (_runners.empty()) {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << _name << " Clients# " << _runners.size()
+        << " Iterations# " << iterations
+        << " Pushes# " << pushes
+        << " SentBytes# " << _runners[0]->PrettyMemory(sentBytes)
+        << " ReceivedBytes# " << _runners[0]->PrettyMemory(receivedBytes) << std::endl;
+}
+
+// client_server_subscribe [writers] [readers] [window] [interval in ms] [seconds] [cells]
+// Readers poll with SyncRequest every 200ms with window 0 and subscribe to pushes otherwise,
+// acknowledging them not more often than the interval.
+int main(int argc, char **argv) {
+    uint32_t writerCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20;
+    uint32_t readerCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 80;
+    uint32_t window = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1;
+    auto interval = std::chrono::milliseconds(argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 200);
+    uint64_t seconds = argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 100;
+    uint64_t cellCount = argc > 6 ? std::strtoull(argv[6], nullptr, 10) : 100'000;
+
+    uint32_t clientCount = writerCount + readerCount;
+    uint32_t mainThreadId = clientCount + 1;
+    auto network = std::make_shared<network_mock::NetworkMock>(clientCount + 2);
+    network_mock::NetworkClient networkClient(network, mainThreadId);
+
+    std::vector<model::Cell> initCells;
+    {
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<uint32_t> valueDistrib(0);
+        initCells.reserve(cellCount);
+        for (uint64_t idx = 0; idx < cellCount; ++idx) {
+            initCells.emplace_back(idx + 1, valueDistrib(gen));
+        }
+    }
+    auto serverRunner = std::make_unique<actors::BasicServerRunner<logic::ServerState>>(
+            network_mock::NetworkClient(network, magic_numbers::ServerId),
+            std::make_unique<logic::ServerState>(initCells));
+
+    std::vector<std::unique_ptr<Runner>> writers;
+    std::vector<std::unique_ptr<Runner>> readers;
+    for (uint32_t idx = 0; idx < clientCount; ++idx) {
+        auto runner = std::make_unique<Runner>(
+                network_mock::NetworkClient(network, idx + 1),
+                std::make_unique<logic::FastSmallClientState>(),
+                idx + 1);
+        if (idx < writerCount) {
+            writers.push_back(std::move(runner));
+        } else {
+            runner->SetReader(window, interval);
+            readers.push_back(std::move(runner));
+        }
+    }
+
+    std::thread serverThread(&actors::BasicServerRunner<logic::ServerState>::Run, serverRunner.get());
+    std::vector<std::thread> clientsThreads;
+    clientsThreads.reserve(clientCount);
+    for (auto *group : {&writers, &readers}) {
+        for (auto &runner : *group) {
+            clientsThreads.emplace_back(&Runner::Run, runner.get());
+        }
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+    networkClient.Send(magic_numbers::ServerId, network_mock::MakePoisonMessage());
+    for (uint32_t idx = 0; idx < clientCount; ++idx) {
+        networkClient.Send(idx + 1, network_mock::MakePoisonMessage());
+    }
+    serverThread.join();
+    for (auto &thr : clientsThreads) {
+        thr.join();
+    }
+
+    PrintGroup("Writers", writers);
+    PrintGroup("Readers", readers);
+    return 0;
+}
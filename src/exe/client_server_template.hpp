@@ -4,24 +4,86 @@
 #include <actors/server.hpp>
 #include <logic/server_state.hpp>
 #include <actors/client.hpp>
+#include <actors/coroutine.hpp>
+#include <actors/relay.hpp>
 #include <logic/client_state.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <optional>
 #include <string>
 #include <thread>
 
 
 namespace home_task::exe {
 
-template <typename _ServerStateType, typename _ClientStateType, uint32_t _ClientCount, uint64_t _CellCount>
-void Test() {
-    constexpr uint32_t clientCount = _ClientCount;
-    constexpr uint32_t mainThreadId = clientCount + 1;
-    auto network = std::make_shared<network_mock::NetworkMock>(clientCount + 2);
+// A run of the server with clients. With replicas every client reads from one of them,
+// replicas take the mailboxes after the main thread. With relays every client talks to one of them
+// and relays talk to the server or to the replicas, relays take the mailboxes after the replicas.
+struct TestSettings {
+    uint32_t ClientCount_;
+    uint64_t CellCount_;
+    uint32_t ReplicaCount_ = 0;
+    uint32_t RelayCount_ = 0;
+    // clients are coroutines on a scheduler with this many threads instead of a thread per client
+    uint32_t CoroutineThreads_ = 0;
+    std::chrono::milliseconds Duration_ = std::chrono::seconds(100);
+    // every client stops after this many iterations instead of waiting for Duration_
+    uint64_t Iterations_ = 0;
+    std::chrono::milliseconds ThinkTime_ = std::chrono::milliseconds(200);
+    bool WithLatency_ = false;
+    std::optional<network_mock::SimulationSettings> Simulation_ = std::nullopt;
+};
+
+// Sums over the clients, the first LoadState of a client isn't counted unless CalculateFirstLoadState.
+struct TestResult {
+    uint64_t Iterations_ = 0;
+    // all the iterations over the longest work time, a client that stopped at once doesn't inflate it
+    double IterationsPerSecond_ = 0;
+    uint64_t SentBytes_ = 0;
+    uint64_t ReceivedBytes_ = 0;
+    // the longest of the clients
+    std::chrono::duration<double> WorkTime_{0};
+    actors::LatencyHistogram Latency_;
+    // peak resident memory of the process (VmHWM), it's the memory of the run only in a process of its own,
+    // client_server_bench runs every point in a child
+    uint64_t PeakResidentBytes_ = 0;
+};
+
+inline uint64_t PeakResidentBytes() {
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.starts_with("VmHWM:")) {
+            return std::strtoull(line.c_str() + sizeof("VmHWM:") - 1, nullptr, 10) * 1024;
+        }
+    }
+    return 0;
+}
+
+// With _print the stats of every client go to stdout.
+template <typename _ServerStateType, typename _ClientStateType>
+TestResult RunTest(const TestSettings &_settings, bool _print) {
+    const uint32_t clientCount = _settings.ClientCount_;
+    const uint32_t mainThreadId = clientCount + 1;
+    const uint32_t replicaCount = _settings.ReplicaCount_;
+    const uint32_t relayCount = _settings.RelayCount_;
+    auto replicaId = [&] (uint32_t _idx) -> model::ClientId {
+        return mainThreadId + 1 + _idx;
+    };
+    auto relayId = [&] (uint32_t _idx) -> model::ClientId {
+        return mainThreadId + 1 + replicaCount + _idx;
+    };
+    const uint32_t mailBoxCount = clientCount + 2 + replicaCount + relayCount;
+    auto network = _settings.Simulation_
+        ? std::make_shared<network_mock::NetworkMock>(mailBoxCount, *_settings.Simulation_)
+        : std::make_shared<network_mock::NetworkMock>(mailBoxCount);
 
     network_mock::NetworkClient networkClient(network, mainThreadId);
 
-    constexpr uint64_t cellCount = _CellCount;
+    const uint64_t cellCount = _settings.CellCount_;
     std::vector<model::Cell> initCells;
     {
         std::random_device rd;
@@ -34,45 +96,161 @@ void Test() {
     }
 
     auto serverState = std::make_unique<_ServerStateType>(initCells);
-    std::unique_ptr<actors::ServerRunner> serverRunner = std::make_unique<actors::ServerRunner>(
+    auto serverRunner = std::make_unique<actors::BasicServerRunner<_ServerStateType>>(
             network_mock::NetworkClient(network, magic_numbers::ServerId),
             std::move(serverState));
 
-    std::vector<std::unique_ptr<actors::ClientRunner>> clientsRunners;
+    std::vector<std::unique_ptr<actors::BasicServerRunner<_ServerStateType>>> replicaRunners;
+    for (uint32_t idx = 0; idx < replicaCount; ++idx) {
+        auto &replicaRunner = replicaRunners.emplace_back(std::make_unique<actors::BasicServerRunner<_ServerStateType>>(
+                network_mock::NetworkClient(network, replicaId(idx)),
+                std::make_unique<_ServerStateType>(initCells)));
+        replicaRunner->EnableReplica(magic_numbers::ServerId, serverRunner->Epoch_);
+        serverRunner->AddReplica(replicaId(idx));
+    }
+
+    std::vector<std::unique_ptr<actors::RelayRunner>> relayRunners;
+    for (uint32_t idx = 0; idx < relayCount; ++idx) {
+        model::ClientId upstreamId = replicaCount ? replicaId(idx % replicaCount) : magic_numbers::ServerId;
+        relayRunners.emplace_back(std::make_unique<actors::RelayRunner>(
+                network_mock::NetworkClient(network, relayId(idx)),
+                relayId(idx),
+                upstreamId));
+    }
+
+    std::vector<std::unique_ptr<actors::BasicClientRunner<_ClientStateType>>> clientsRunners;
     clientsRunners.reserve(clientCount);
     for (uint32_t idx = 0; idx < clientCount; ++idx) {
         auto clientState = std::make_unique<_ClientStateType>();
-        clientsRunners.emplace_back(std::make_unique<actors::ClientRunner>(
+        clientsRunners.emplace_back(std::make_unique<actors::BasicClientRunner<_ClientStateType>>(
                 network_mock::NetworkClient(network, idx + 1),
                 std::move(clientState),
                 idx + 1));
+        clientsRunners.back()->SetThinkTime(_settings.ThinkTime_);
+        clientsRunners.back()->SetIterationLimit(_settings.Iterations_);
+        if (_settings.WithLatency_) {
+            clientsRunners.back()->EnableLatency();
+        }
+        if (relayCount) {
+            clientsRunners.back()->SetServer(relayId(idx % relayCount));
+        } else if (replicaCount) {
+            clientsRunners.back()->SetServer(replicaId(idx % replicaCount));
+        }
     }
 
-    std::thread serverThread(&actors::ServerRunner::Run, serverRunner.get());
+    std::thread serverThread(&actors::BasicServerRunner<_ServerStateType>::Run, serverRunner.get());
+    std::vector<std::thread> replicaThreads;
+    for (auto &replicaRunner : replicaRunners) {
+        replicaThreads.emplace_back(&actors::BasicServerRunner<_ServerStateType>::Run, replicaRunner.get());
+    }
+    std::vector<std::thread> relayThreads;
+    for (auto &relayRunner : relayRunners) {
+        relayThreads.emplace_back(&actors::RelayRunner::Run, relayRunner.get());
+    }
+    std::optional<actors::CoroutineScheduler> scheduler;
     std::vector<std::thread> clientsThreads;
-    clientsThreads.reserve(clientCount);
-    for (uint32_t idx = 0; idx < clientCount; ++idx) {
-        clientsThreads.emplace_back(&actors::ClientRunner::Run, clientsRunners[idx].get());
+    if (_settings.CoroutineThreads_) {
+        scheduler.emplace(_settings.CoroutineThreads_);
+        for (uint32_t idx = 0; idx < clientCount; ++idx) {
+            scheduler->Spawn(clientsRunners[idx]->RunAsync(*scheduler));
+        }
+    } else {
+        clientsThreads.reserve(clientCount);
+        for (uint32_t idx = 0; idx < clientCount; ++idx) {
+            clientsThreads.emplace_back(&actors::BasicClientRunner<_ClientStateType>::Run, clientsRunners[idx].get());
+        }
     }
 
-    log::Write("Main thread goes to sleep for 100s");
-    using namespace std::chrono_literals;
-    std::this_thread::sleep_for(100s);
-    log::Write("Main thread woke up");
+    if (_settings.Iterations_) {
+        // the clients stop by themselves, poisons for them stay in the mailboxes
+        for (auto &thr : clientsThreads) {
+            thr.join();
+        }
+        clientsThreads.clear();
+        if (scheduler) {
+            scheduler->Join();
+        }
+    } else {
+        log::Write("Main thread goes to sleep for ", std::chrono::duration<double>(_settings.Duration_).count(), 's');
+        std::this_thread::sleep_for(_settings.Duration_);
+        log::Write("Main thread woke up");
+    }
 
     networkClient.Send(magic_numbers::ServerId, network_mock::MakePoisonMessage());
+    for (uint32_t idx = 0; idx < replicaCount; ++idx) {
+        networkClient.Send(replicaId(idx), network_mock::MakePoisonMessage());
+    }
+    for (uint32_t idx = 0; idx < relayCount; ++idx) {
+        networkClient.Send(relayId(idx), network_mock::MakePoisonMessage());
+    }
     for (uint32_t idx = 0; idx < clientCount; ++idx) {
         networkClient.Send(idx + 1, network_mock::MakePoisonMessage());
     }
 
     serverThread.join();
+    for (auto &thr : replicaThreads) {
+        thr.join();
+    }
+    for (auto &thr : relayThreads) {
+        thr.join();
+    }
     for (auto &thr : clientsThreads) {
         thr.join();
     }
+    if (scheduler) {
+        scheduler->Join();
+    }
 
+    TestResult result;
+    result.PeakResidentBytes_ = PeakResidentBytes();
     for (auto &runner : clientsRunners) {
-        std::cout << runner->PrintStat();
+        uint64_t iterations = runner->IteratoinCount_;
+        // the work time starts after the first LoadState
+        if (!magic_numbers::CalculateFirstLoadState && iterations) {
+            iterations--;
+        }
+        result.Iterations_ += iterations;
+        result.SentBytes_ += runner->SentBytes_;
+        result.ReceivedBytes_ += runner->ReceivedBytes_;
+        result.WorkTime_ = std::max(result.WorkTime_, runner->WorkTime_);
+        if (runner->Latency_) {
+            result.Latency_.Merge(*runner->Latency_);
+        }
     }
+    if (result.WorkTime_.count() > 0) {
+        result.IterationsPerSecond_ = result.Iterations_ / result.WorkTime_.count();
+    }
+
+    if (_print) {
+        for (auto &runner : clientsRunners) {
+            std::cout << runner->PrintStat();
+        }
+        for (auto &runner : relayRunners) {
+            std::cout << runner->PrintStat();
+        }
+        if (auto simulation = network->GetSimulation()) {
+            std::cout << simulation->PrintStat();
+        }
+        if (scheduler) {
+            std::cout << "Resumed# " << scheduler->GetResumed() << std::endl;
+        }
+    }
+    return result;
+}
+
+// The engines and the sizes are template parameters to keep the old executables as they were,
+// see client_server_bench for choosing them at runtime.
+template <typename _ServerStateType, typename _ClientStateType, uint32_t _ClientCount, uint64_t _CellCount,
+        uint32_t _ReplicaCount = 0, uint32_t _RelayCount = 0, uint32_t _CoroutineThreads = 0>
+void Test(const std::optional<network_mock::SimulationSettings> &_simulation = std::nullopt) {
+    RunTest<_ServerStateType, _ClientStateType>(TestSettings{
+        .ClientCount_ = _ClientCount,
+        .CellCount_ = _CellCount,
+        .ReplicaCount_ = _ReplicaCount,
+        .RelayCount_ = _RelayCount,
+        .CoroutineThreads_ = _CoroutineThreads,
+        .Simulation_ = _simulation,
+    }, true);
 }
 
 }
@@ -0,0 +1,18 @@
+#include "client_server_template.hpp"
+
+
+using namespace home_task;
+
+int main() {
+    using namespace std::chrono_literals;
+    network_mock::SimulationSettings simulation;
+    simulation.Default_ = network_mock::LinkSettings{
+        .Distribution_ = network_mock::ELatencyDistribution::Normal,
+        .Latency_ = 20ms,
+        .Jitter_ = 5ms,
+        .BytesPerSecond_ = 10 << 20,
+        .ReorderProbability_ = 0.01,
+    };
+    exe::Test<logic::ServerState, logic::FastSmallClientState, 20, 100'000>(simulation);
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <logic/client_state.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace home_task;
+
+namespace {
+
+uint64_t ResidentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0;
+    uint64_t resident = 0;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+double Seconds(std::chrono::steady_clock::time_point _start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+}
+
+template <typename _State>
+void Bench(const std::string &_name, const std::vector<model::Cell> &_cells, uint32_t _operations) {
+    std::mt19937 gen(42);
+    uint64_t checksum = 0;
+    std::vector<model::CellId> live;
+    live.reserve(_cells.size() + _operations);
+    for (auto &cell : _cells) {
+        live.push_back(cell.CellId_);
+    }
+    model::CellId nextId = _cells.size() + 1;
+
+    api::State snapshot{std::vector<model::Cell>(_cells)};
+    uint64_t memoryBefore = ResidentBytes();
+    auto state = std::make_unique<_State>();
+    auto start = std::chrono::steady_clock::now();
+    state->HandleState(snapshot);
+    double joinTime = Seconds(start);
+    uint64_t memory = ResidentBytes() - memoryBefore;
+    snapshot.Cells_ = {};
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t idx = 0; idx < _operations; ++idx) {
+        checksum += state->GenerateUpdateValueRequest(gen).CellId_;
+    }
+    double getTime = Seconds(start);
+
+    std::vector<api::InsertValueResponse> insertions;
+    insertions.reserve(_operations);
+    for (uint32_t idx = 0; idx < _operations; ++idx) {
+        auto &response = insertions.emplace_back(nextId);
+        response.Insertions_.push_back(model::InsertValue{.NearCellId_ = live[gen() % live.size()], .Cell_ = model::Cell(nextId, idx)});
+        live.push_back(nextId++);
+    }
+    start = std::chrono::steady_clock::now();
+    for (auto &response : insertions) {
+        state->HandleInsertValueResponse(response);
+    }
+    double insertTime = Seconds(start);
+
+    std::vector<api::DeleteValueResponse> deletions;
+    deletions.reserve(_operations);
+    for (uint32_t idx = 0; idx < _operations && live.size() > 1; ++idx) {
+        uint32_t liveIdx = gen() % live.size();
+        deletions.emplace_back().Deletions_.push_back(model::DeleteValue{.CellId_ = live[liveIdx]});
+        live[liveIdx] = live.back();
+        live.pop_back();
+    }
+    start = std::chrono::steady_clock::now();
+    for (auto &response : deletions) {
+        state->HandleDeleteValueResponse(response);
+    }
+    double deleteTime = Seconds(start);
+
+    auto perOperation = [&] (double _seconds, size_t _count) {
+        return _count ? _seconds * 1e9 / _count : 0.0;
+    };
+    std::cout << std::fixed << std::setprecision(2)
+        << "Engine# " << _name
+        << " Cells# " << _cells.size()
+        << " Operations# " << _operations
+        << " Join# " << joinTime << "s"
+        << " Memory# " << memory / double(1 << 20) << "MB"
+        << " Get# " << perOperation(getTime, _operations) << "ns"
+        << " InsertAfterId# " << perOperation(insertTime, insertions.size()) << "ns"
+        << " Delete# " << perOperation(deleteTime, deletions.size()) << "ns"
+        << " Checksum# " << checksum % 1000
+        << std::endl;
+}
+
+// request generation after the server deleted _deletedPercent of the cells by one diff
+template <typename _State>
+void BenchSampling(const std::string &_name, const std::vector<model::Cell> &_cells, uint32_t _operations, uint32_t _deletedPercent) {
+    std::mt19937 gen(42);
+    uint64_t checksum = 0;
+    auto state = std::make_unique<_State>();
+    state->HandleState(api::State{std::vector<model::Cell>(_cells)});
+
+    api::DeleteValueResponse deletions;
+    for (auto &cell : _cells) {
+        if (gen() % 100 < _deletedPercent) {
+            deletions.Deletions_.push_back(model::DeleteValue{.CellId_ = cell.CellId_});
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    state->HandleDeleteValueResponse(deletions);
+    double deleteTime = Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t idx = 0; idx < _operations; ++idx) {
+        checksum += state->GenerateUpdateValueRequest(gen).CellId_;
+        checksum += state->GenerateInsertValueRequest(gen).NearCellId_;
+        checksum += state->GenerateDeleteValueRequest(gen).CellId_;
+    }
+    double generateTime = Seconds(start);
+
+    std::cout << std::fixed << std::setprecision(2)
+        << "Engine# " << _name
+        << " Cells# " << _cells.size()
+        << " Deleted# " << deletions.Deletions_.size()
+        << " ApplyDeletions# " << deleteTime << "s"
+        << " Generate# " << generateTime * 1e9 / (3 * _operations) << "ns"
+        << " Checksum# " << checksum % 1000
+        << std::endl;
+}
+
+}
+
+// client_state_bench [operations] [cells...]
+// ClientState does a linear search per operation, so it gets a thousandth of the operations,
+// after the engine runs every engine generates requests with 90% of the cells deleted
+int main(int argc, char **argv) {
+    uint32_t operations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100'000;
+    std::vector<uint64_t> sizes;
+    for (int idx = 2; idx < argc; ++idx) {
+        sizes.push_back(std::strtoull(argv[idx], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        sizes = {1'000'000, 10'000'000};
+    }
+
+    for (uint64_t cellCount : sizes) {
+        std::vector<model::Cell> cells;
+        {
+            std::mt19937 gen(cellCount);
+            std::uniform_int_distribution<model::Value> valueDistrib(0);
+            cells.reserve(cellCount);
+            for (uint64_t idx = 0; idx < cellCount; ++idx) {
+                cells.emplace_back(idx + 1, valueDistrib(gen));
+            }
+        }
+        Bench<logic::ClientState>("ClientState", cells, std::max<uint32_t>(operations / 1000, 10));
+        Bench<logic::FastClientState>("FastClientState", cells, operations);
+        Bench<logic::BTreeClientState>("BTreeClientState", cells, operations);
+
+        BenchSampling<logic::ClientState>("ClientState", cells, operations, 90);
+        BenchSampling<logic::FastClientState>("FastClientState", cells, operations, 90);
+        BenchSampling<logic::BTreeClientState>("BTreeClientState", cells, operations, 90);
+        BenchSampling<logic::FastSmallClientState>("FastSmallClientState", cells, operations, 90);
+    }
+    return 0;
+}
@@ -0,0 +1,387 @@
+#include <core/api.hpp>
+#include <core/columnar.hpp>
+#include <core/compact.hpp>
+#include <core/serialization.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace home_task;
+
+namespace {
+
+constexpr model::ClientId TestSender = 7;
+// larger messages are only truncated, corrupting every byte of them takes too long
+constexpr uint64_t MaxCorruptedSize = 2048;
+
+uint64_t Checks = 0;
+
+void Check(bool _ok, const std::string &_what) {
+    Checks++;
+    if (!_ok) {
+        log::ForceWrite("codec_test failed: ", _what);
+        std::exit(1);
+    }
+}
+
+bool SameDiff(const api::GenericResponse &_lhs, const api::GenericResponse &_rhs) {
+    if (_lhs.Updates_.size() != _rhs.Updates_.size()
+            || _lhs.Insertions_.size() != _rhs.Insertions_.size()
+            || _lhs.Deletions_.size() != _rhs.Deletions_.size()) {
+        return false;
+    }
+    for (uint64_t idx = 0; idx < _lhs.Updates_.size(); ++idx) {
+        if (!(_lhs.Updates_[idx].Cell_ == _rhs.Updates_[idx].Cell_)) {
+            return false;
+        }
+    }
+    for (uint64_t idx = 0; idx < _lhs.Insertions_.size(); ++idx) {
+        auto &lhs = _lhs.Insertions_[idx];
+        auto &rhs = _rhs.Insertions_[idx];
+        if (lhs.NearCellId_ != rhs.NearCellId_ || !(lhs.Cell_ == rhs.Cell_)) {
+            return false;
+        }
+    }
+    for (uint64_t idx = 0; idx < _lhs.Deletions_.size(); ++idx) {
+        if (_lhs.Deletions_[idx].CellId_ != _rhs.Deletions_[idx].CellId_) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The fields the test builds are compared one by one, the rest is covered by encoding the decoded message again.
+bool SameRecord(const network_mock::MessageRecord &_lhs, const network_mock::MessageRecord &_rhs) {
+    if (_lhs.Record_.index() != _rhs.Record_.index()) {
+        return false;
+    }
+    return std::visit([&] <typename _Record> (const _Record &_record) {
+        auto &other = std::get<_Record>(_rhs.Record_);
+        if constexpr (std::is_same_v<_Record, api::State>) {
+            return SameDiff(_record, other) && _record.Iteration_ == other.Iteration_
+                && _record.Epoch_ == other.Epoch_ && _record.Cells_ == other.Cells_;
+        } else if constexpr (std::is_same_v<_Record, api::InsertValueResponse>) {
+            return SameDiff(_record, other) && _record.Iteration_ == other.Iteration_ && _record.CellId_ == other.CellId_;
+        } else if constexpr (std::is_base_of_v<api::GenericResponse, _Record>) {
+            return SameDiff(_record, other) && _record.Iteration_ == other.Iteration_;
+        } else {
+            return true;
+        }
+    }, _lhs.Record_);
+}
+
+// Exactly sized copies, so ASan catches a decoder reading past the message.
+std::unique_ptr<network_mock::MessageRecord> DecodeCopy(const wire::Buffer &_bytes) {
+    wire::Buffer copy(_bytes);
+    auto view = wire::ParseMessage(copy.data(), copy.size());
+    if (!view || view->FullSize() != copy.size()) {
+        return nullptr;
+    }
+    return wire::Decode(*view);
+}
+
+// Every prefix is an incomplete message, and with the length patched to the prefix it's a malformed one.
+void CheckTruncated(const wire::Buffer &_bytes, const std::string &_name) {
+    for (uint64_t size = 0; size < _bytes.size(); ++size) {
+        wire::Buffer prefix(_bytes.begin(), _bytes.begin() + size);
+        Check(!wire::ParseMessage(prefix.data(), prefix.size()), _name + ": prefix of " + std::to_string(size) + " bytes parsed");
+        if (size < wire::HeaderSize) {
+            continue;
+        }
+        wire::StoreU32(prefix.data(), size - wire::LengthSize);
+        Check(!DecodeCopy(prefix), _name + ": truncated body of " + std::to_string(size) + " bytes decoded");
+    }
+}
+
+// Counts, lengths and widths of a valid message changed one byte at a time must be rejected
+// or decoded, never read or written out of bounds.
+void CheckCorrupted(const wire::Buffer &_bytes) {
+    if (_bytes.size() > MaxCorruptedSize) {
+        return;
+    }
+    for (uint64_t idx = wire::HeaderSize; idx < _bytes.size(); ++idx) {
+        for (uint8_t mask : {0x01, 0x80, 0xff}) {
+            wire::Buffer corrupted(_bytes);
+            corrupted[idx] ^= mask;
+            DecodeCopy(corrupted);
+        }
+    }
+}
+
+void RoundTrip(std::unique_ptr<network_mock::MessageRecord> &&_message, const std::string &_name) {
+    _message->Sender_ = TestSender;
+    wire::Buffer bytes;
+    uint32_t written = wire::Encode(*_message, &bytes);
+    Check(written == bytes.size(), _name + ": written size");
+    Check(written == _message->Size_, _name + ": CalculateSize " + std::to_string(_message->Size_)
+        + " != encoded " + std::to_string(written));
+
+    auto decoded = DecodeCopy(bytes);
+    Check(decoded != nullptr, _name + ": not decoded");
+    Check(decoded->Type_ == _message->Type_ && decoded->Sender_ == TestSender, _name + ": header");
+    Check(decoded->Size_ == written, _name + ": decoded size");
+    Check(SameRecord(*_message, *decoded), _name + ": decoded record differs");
+    wire::Buffer again;
+    wire::Encode(*decoded, &again);
+    Check(again == bytes, _name + ": encoding of the decoded record differs");
+
+    CheckTruncated(bytes, _name);
+    CheckCorrupted(bytes);
+}
+
+template <typename _Record, typename ... _Args>
+void RoundTripRequest(const std::string &_name, _Args&& ... _args) {
+    RoundTrip(api::MakeRequestMessage<_Record>(std::forward<_Args>(_args)...), _name);
+}
+
+template <typename _Record>
+void RoundTripResponse(_Record &&_record, const std::string &_name) {
+    RoundTrip(api::MakeResponseMessage(std::move(_record)), _name);
+}
+
+// The same diff in every response type.
+void RoundTripDiff(const api::GenericResponse &_diff, model::IterationId _iteration, const std::string &_name) {
+    auto fill = [&] (api::GenericResponse &_response) {
+        _response.Updates_ = _diff.Updates_;
+        _response.Insertions_ = _diff.Insertions_;
+        _response.Deletions_ = _diff.Deletions_;
+        _response.Iteration_ = _iteration;
+    };
+    api::UpdateValueResponse update;
+    fill(update);
+    RoundTripResponse(std::move(update), _name + " UpdateValueResponse");
+    api::InsertValueResponse insert(_iteration + 1);
+    fill(insert);
+    RoundTripResponse(std::move(insert), _name + " InsertValueResponse");
+    api::DeleteValueResponse del;
+    fill(del);
+    RoundTripResponse(std::move(del), _name + " DeleteValueResponse");
+    api::SyncResponse sync;
+    fill(sync);
+    RoundTripResponse(std::move(sync), _name + " SyncResponse");
+    api::PushResponse push;
+    fill(push);
+    RoundTripResponse(std::move(push), _name + " PushResponse");
+}
+
+void RoundTripState(model::CellVector &&_cells, const api::GenericResponse &_diff, const std::string &_name) {
+    api::State state(std::move(_cells));
+    state.Updates_ = _diff.Updates_;
+    state.Insertions_ = _diff.Insertions_;
+    state.Deletions_ = _diff.Deletions_;
+    state.Iteration_ = 1000;
+    state.Epoch_ = 0x0123456789abcdefull;
+    RoundTripResponse(std::move(state), _name);
+}
+
+std::vector<uint64_t> VarintBoundaries() {
+    std::vector<uint64_t> values = {0, std::numeric_limits<uint64_t>::max()};
+    for (uint32_t bits = 7; bits < 64; bits += 7) {
+        values.push_back((1ull << bits) - 1);
+        values.push_back(1ull << bits);
+    }
+    return values;
+}
+
+void TestVarints() {
+    auto values = VarintBoundaries();
+    for (uint64_t value : values) {
+        wire::Buffer buffer;
+        wire::Writer writer{&buffer};
+        wire::PutVarint(writer, value);
+        Check(buffer.size() == wire::VarintSize(value), "VarintSize of " + std::to_string(value));
+        wire::Reader reader(buffer.data(), buffer.size());
+        Check(wire::GetVarint(reader) == value && reader.Finished(), "varint " + std::to_string(value));
+        wire::Reader truncated(buffer.data(), buffer.size() - 1);
+        wire::GetVarint(truncated);
+        Check(!truncated.Ok_, "truncated varint " + std::to_string(value));
+    }
+
+    // one byte runs for the word path with wide values at every position of the word
+    for (uint64_t wide : values) {
+        for (uint32_t position = 0; position < 20; ++position) {
+            std::vector<uint64_t> sequence(20, 5);
+            sequence[position] = wide;
+            wire::Buffer buffer;
+            wire::Writer writer{&buffer};
+            for (uint64_t value : sequence) {
+                wire::PutVarint(writer, value);
+            }
+            std::vector<uint64_t> decoded(sequence.size());
+            wire::Reader reader(buffer.data(), buffer.size());
+            Check(wire::GetVarints(reader, decoded.data(), decoded.size()) && reader.Finished() && decoded == sequence,
+                "varints with " + std::to_string(wide) + " at " + std::to_string(position));
+            wire::Reader truncated(buffer.data(), buffer.size() - 1);
+            Check(!wire::GetVarints(truncated, decoded.data(), decoded.size()),
+                "truncated varints with " + std::to_string(wide) + " at " + std::to_string(position));
+        }
+    }
+
+    // a varint never takes more than ten bytes
+    wire::Buffer overlong(11, 0x80);
+    overlong.back() = 0x01;
+    wire::Reader reader(overlong.data(), overlong.size());
+    wire::GetVarint(reader);
+    Check(!reader.Ok_, "overlong varint");
+
+    for (uint64_t value : values) {
+        auto delta = static_cast<int64_t>(value);
+        Check(wire::UnZigZag(wire::ZigZag(delta)) == delta, "zigzag " + std::to_string(delta));
+        Check(wire::ApplyDelta(1000, wire::ZigZagDelta(value, 1000)) == value, "delta " + std::to_string(value));
+    }
+}
+
+void TestRequests() {
+    RoundTrip(network_mock::MakePoisonMessage(), "Poison");
+    for (uint64_t value : VarintBoundaries()) {
+        auto name = std::to_string(value);
+        RoundTripRequest<api::LoadStateRequest>("LoadStateRequest " + name, value);
+        RoundTripRequest<api::UpdateValueRequest>("UpdateValueRequest " + name, value, static_cast<model::Value>(value), value);
+        RoundTripRequest<api::InsertValueRequest>("InsertValueRequest " + name, value, static_cast<model::Value>(value), value);
+        RoundTripRequest<api::DeleteValueRequest>("DeleteValueRequest " + name, value, value);
+        RoundTripRequest<api::SyncRequest>("SyncRequest " + name, value);
+        RoundTripRequest<api::ResumeRequest>("ResumeRequest " + name, value, value);
+        RoundTripRequest<api::OpenArrayRequest>("OpenArrayRequest " + name, value);
+        RoundTripRequest<api::SubscribeRequest>("SubscribeRequest " + name, value, static_cast<uint32_t>(value));
+        RoundTripRequest<api::PushAckRequest>("PushAckRequest " + name, value);
+    }
+}
+
+void TestDiffs() {
+    api::GenericResponse empty;
+    RoundTripDiff(empty, 0, "empty");
+    RoundTripDiff(empty, std::numeric_limits<uint64_t>::max(), "empty at the last iteration");
+
+    api::GenericResponse single;
+    single.Insertions_.push_back(model::InsertValue{.NearCellId_ = 10, .Cell_ = model::Cell(11, 1)});
+    RoundTripDiff(single, 1, "single insertion");
+
+    // chains of every length around the bytes of the chain bitmap, each from a cell before or after the chain
+    for (uint64_t length : {2, 7, 8, 9, 16, 17, 1000}) {
+        for (model::CellId near : {5ull, 100000ull}) {
+            api::GenericResponse chain;
+            model::CellId prev = near;
+            for (uint64_t idx = 0; idx < length; ++idx) {
+                model::CellId cellId = 1000 + idx;
+                chain.Insertions_.push_back(model::InsertValue{.NearCellId_ = prev, .Cell_ = model::Cell(cellId, idx)});
+                prev = cellId;
+            }
+            RoundTripDiff(chain, length, "chain of " + std::to_string(length) + " after " + std::to_string(near));
+        }
+    }
+
+    // chains broken every few insertions, with ids going back and forth
+    api::GenericResponse broken;
+    model::CellId prev = 0;
+    for (uint64_t idx = 0; idx < 300; ++idx) {
+        model::CellId cellId = idx % 2 ? 5000 - idx : 5000 + idx;
+        model::CellId near = prev && idx % 7 ? prev : 3 * idx + 1;
+        broken.Insertions_.push_back(model::InsertValue{.NearCellId_ = near, .Cell_ = model::Cell(cellId, ~idx)});
+        prev = cellId;
+    }
+    RoundTripDiff(broken, 77, "broken chains");
+
+    // id deltas on both sides of every varint width
+    api::GenericResponse boundaries;
+    model::CellId base = 1;
+    for (uint64_t value : VarintBoundaries()) {
+        // a zigzag delta takes one more bit than the delta
+        model::CellId cellId = base + (value >> 1);
+        boundaries.Updates_.push_back(model::UpdateValue{.Cell_ = model::Cell(cellId, value)});
+        boundaries.Insertions_.push_back(model::InsertValue{.NearCellId_ = base - (value >> 1), .Cell_ = model::Cell(cellId, value)});
+        boundaries.Deletions_.push_back(model::DeleteValue{.CellId_ = cellId});
+        base = cellId;
+    }
+    RoundTripDiff(boundaries, 1ull << 35, "varint boundaries");
+}
+
+void TestStates() {
+    api::GenericResponse history;
+    history.Updates_.push_back(model::UpdateValue{.Cell_ = model::Cell(3, 30)});
+    history.Deletions_.push_back(model::DeleteValue{.CellId_ = 4});
+
+    RoundTripState({}, {}, "empty state");
+    RoundTripState({}, history, "empty state with history");
+    for (uint64_t count : {1, 127, 128, 129, 255, 256, 257, 1000}) {
+        auto name = std::to_string(count) + " cells";
+        model::CellVector ascending;
+        for (uint64_t idx = 0; idx < count; ++idx) {
+            ascending.emplace_back(idx + 1, idx);
+        }
+        RoundTripState(model::CellVector(ascending), history, name + " in a run");
+
+        // runs of 100 cross the blocks of 128 values, the width changes from block to block
+        model::CellVector runs;
+        for (uint64_t idx = 0; idx < count; ++idx) {
+            uint32_t width = (idx / wire::ValuesBlockSize) % 33;
+            model::Value value = width ? static_cast<model::Value>(std::numeric_limits<model::Value>::max() >> (32 - width)) : 0;
+            runs.emplace_back(idx + 1 + (idx / 100) * 1000, idx % 3 ? value : 0);
+        }
+        RoundTripState(model::CellVector(runs), history, name + " in runs of 100");
+
+        model::CellVector descending;
+        for (uint64_t idx = 0; idx < count; ++idx) {
+            descending.emplace_back(std::numeric_limits<uint64_t>::max() - 2 * idx, std::numeric_limits<model::Value>::max());
+        }
+        RoundTripState(std::move(descending), {}, name + " descending");
+    }
+}
+
+// Random bodies under every type and flag must be rejected or decoded, never read out of bounds.
+void TestGarbage() {
+    std::mt19937_64 gen(42);
+    std::vector<uint32_t> types = {static_cast<uint32_t>(network_mock::EMessageType::String)};
+    for (uint32_t type = (uint32_t)api::EAPIEventsType::LoadStateRequest; type <= (uint32_t)api::EAPIEventsType::PushAckRequest; ++type) {
+        types.push_back(type);
+    }
+    for (uint32_t type = (uint32_t)api::EAPIEventsType::State; type <= (uint32_t)api::EAPIEventsType::PushResponse; ++type) {
+        types.push_back(type);
+    }
+    for (uint32_t type : types) {
+        for (uint8_t flags = 0; flags < 4; ++flags) {
+            for (uint32_t round = 0; round < 200; ++round) {
+                wire::Buffer bytes(wire::HeaderSize + gen() % 64);
+                for (uint64_t idx = wire::HeaderSize; idx < bytes.size(); ++idx) {
+                    bytes[idx] = static_cast<uint8_t>(gen());
+                    // small counts get past the count checks more often
+                    if (round % 2 && idx % 4 == 0) {
+                        bytes[idx] &= 0x0f;
+                    }
+                }
+                wire::StoreU32(bytes.data(), bytes.size() - wire::LengthSize);
+                bytes[4] = wire::Version;
+                bytes[5] = flags;
+                wire::StoreU32(bytes.data() + 8, type);
+                DecodeCopy(bytes);
+            }
+        }
+    }
+    Check(true, "garbage");
+
+    wire::Buffer shortLength(wire::HeaderSize, 0);
+    wire::StoreU32(shortLength.data(), wire::HeaderSize - wire::LengthSize - 1);
+    bool malformed = false;
+    Check(!wire::ParseMessage(shortLength.data(), shortLength.size(), &malformed) && malformed, "length shorter than the header");
+
+    wire::Buffer oldVersion;
+    wire::Encode(*api::MakeRequestMessage<api::SyncRequest>(1), &oldVersion);
+    oldVersion[4] = wire::Version - 1;
+    Check(!DecodeCopy(oldVersion), "another version");
+}
+
+}
+
+// Encodes every message type and decodes it back, see the readme on the wire format.
+int main() {
+    TestVarints();
+    TestRequests();
+    TestDiffs();
+    TestStates();
+    TestGarbage();
+    std::cout << "Checks# " << Checks << std::endl;
+    return 0;
+}
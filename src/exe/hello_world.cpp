@@ -13,7 +13,7 @@ int main() {
         std::cerr << "ERROR: msg wasn't delivered!\n";
         return 1;
     }
-    std::string* s = std::any_cast<std::string>(&receivedMsg.value()->Record_);
+    std::string* s = std::get_if<std::string>(&receivedMsg.value()->Record_);
     if (!s) {
         std::cerr << "ERROR: record wasn't string!\n";
         return 1;
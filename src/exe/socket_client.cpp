@@ -0,0 +1,68 @@
+#include <core/shm_network.hpp>
+#include <core/socket_network.hpp>
+#include <actors/client.hpp>
+#include <logic/client_state.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace home_task;
+
+// socket_client <address> <id> [seconds] [snapshot]
+// address is tcp://host:port, unix://path or shm://name,
+// with a snapshot file the client saves its state there and resumes from it on the next start
+int main(int argc, char **argv) {
+    std::string addressString = argc > 1 ? argv[1] : "tcp://127.0.0.1:7000";
+    model::ClientId id = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1;
+    uint64_t seconds = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 90;
+    std::string snapshotPath = argc > 4 ? argv[4] : "";
+    if (id == magic_numbers::ServerId) {
+        std::cerr << "usage: socket_client tcp://host:port|unix://path|shm://name <id != 0> [seconds] [snapshot]" << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<network_mock::INetworkClient> network;
+    std::function<std::string()> printStat;
+    if (addressString.starts_with("shm://")) {
+        auto shmNetwork = shm_network::ShmNetworkClient::Open(addressString.substr(6), id);
+        if (!shmNetwork) {
+            return 1;
+        }
+        printStat = [shmNetwork = shmNetwork.get()] { return shmNetwork->PrintStat(); };
+        network = std::move(shmNetwork);
+    } else {
+        auto address = socket_network::SocketAddress::Parse(addressString);
+        if (!address) {
+            std::cerr << "bad address, expected tcp://host:port, unix://path or shm://name" << std::endl;
+            return 1;
+        }
+        auto socketNetwork = socket_network::SocketNetworkClient::Connect(*address, id);
+        if (!socketNetwork) {
+            return 1;
+        }
+        printStat = [socketNetwork = socketNetwork.get()] { return socketNetwork->PrintStat(); };
+        network = std::move(socketNetwork);
+    }
+    auto *clientNetwork = network.get();
+
+    auto clientRunner = std::make_unique<actors::BasicClientRunner<logic::FastSmallClientState>>(
+            std::move(network),
+            std::make_unique<logic::FastSmallClientState>(),
+            id);
+    if (!snapshotPath.empty()) {
+        clientRunner->EnableSnapshot(snapshotPath);
+    }
+    std::thread clientThread(&actors::BasicClientRunner<logic::FastSmallClientState>::Run, clientRunner.get());
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    clientNetwork->Send(id, network_mock::MakePoisonMessage());
+    clientThread.join();
+
+    std::cout << clientRunner->PrintStat();
+    std::cout << printStat();
+    return 0;
+}
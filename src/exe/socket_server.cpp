@@ -0,0 +1,73 @@
+#include <core/shm_network.hpp>
+#include <core/socket_network.hpp>
+#include <actors/server.hpp>
+#include <logic/server_state.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace home_task;
+
+// socket_server <address> [seconds] [cells] [clients]
+// address is tcp://host:port, unix://path or shm://name, the shared memory segment
+// is made for the given number of clients with ids from 1
+int main(int argc, char **argv) {
+    std::string addressString = argc > 1 ? argv[1] : "tcp://127.0.0.1:7000";
+    uint64_t seconds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100;
+    uint64_t cellCount = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1000;
+    uint32_t clientCount = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 20;
+
+    std::unique_ptr<network_mock::INetworkClient> network;
+    std::function<std::string()> printStat;
+    if (addressString.starts_with("shm://")) {
+        auto shmNetwork = shm_network::ShmNetworkClient::Create(addressString.substr(6),
+                shm_network::ShmSettings{.ClientCount_ = clientCount});
+        if (!shmNetwork) {
+            return 1;
+        }
+        printStat = [shmNetwork = shmNetwork.get()] { return shmNetwork->PrintStat(); };
+        network = std::move(shmNetwork);
+    } else {
+        auto address = socket_network::SocketAddress::Parse(addressString);
+        if (!address) {
+            std::cerr << "bad address, expected tcp://host:port, unix://path or shm://name" << std::endl;
+            return 1;
+        }
+        auto socketNetwork = socket_network::SocketNetworkClient::Listen(*address, magic_numbers::ServerId);
+        if (!socketNetwork) {
+            return 1;
+        }
+        printStat = [socketNetwork = socketNetwork.get()] { return socketNetwork->PrintStat(); };
+        network = std::move(socketNetwork);
+    }
+    auto *serverNetwork = network.get();
+
+    std::vector<model::Cell> initCells;
+    {
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<uint32_t> valueDistrib(0);
+        initCells.reserve(cellCount);
+        for (uint64_t idx = 0; idx < cellCount; ++idx) {
+            initCells.emplace_back(idx +  1, valueDistrib(gen));
+        }
+    }
+
+    auto serverRunner = std::make_unique<actors::BasicServerRunner<logic::ServerState>>(
+            std::move(network),
+            std::make_unique<logic::ServerState>(initCells));
+    std::thread serverThread(&actors::BasicServerRunner<logic::ServerState>::Run, serverRunner.get());
+
+    log::Write("Server listens for ", seconds, "s");
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    serverNetwork->Send(magic_numbers::ServerId, network_mock::MakePoisonMessage());
+    serverThread.join();
+
+    std::cout << printStat();
+    return 0;
+}
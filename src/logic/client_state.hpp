@@ -1,6 +1,8 @@
 #pragma once
 
 #include <core/api.hpp>
+#include "counted_btree.hpp"
+#include "decard_tree.hpp"
 
 #include <algorithm>
 #include <random>
@@ -35,9 +37,61 @@ struct IClientState {
 
     virtual void HandleState(const api::State &_response) = 0;
 
+    // The cells and the iteration they are at, HandleState of an empty state restores it.
+    virtual api::State MakeSnapshot() const = 0;
+
+};
+
+struct InsertionGroup {
+    // the cell the group goes after, it was in the array before the diff, zero for the beginning of the array
+    model::CellId NearCellId_ = 0;
+    std::vector<model::Cell> Cells_{};
 };
 
-struct ClientStateNop : IClientState {
+// Groups the insertions of a diff by the cells they go after.
+// A cell inserted after another inserted cell goes right after it, and cells inserted later after
+// the same cell go before the earlier ones, so a group is a preorder walk with the latest child first.
+// Cells deleted by the same diff are left out, cells inserted after them keep their place.
+inline std::vector<InsertionGroup> GroupInsertions(const api::GenericResponse &_response) {
+    std::unordered_map<model::CellId, std::vector<const model::InsertValue*>> children;
+    std::unordered_set<model::CellId> inserted;
+    for (auto &insert : _response.Insertions_) {
+        children[insert.NearCellId_].push_back(&insert);
+        inserted.insert(insert.Cell_.CellId_);
+    }
+    std::unordered_set<model::CellId> deleted;
+    for (auto &del : _response.Deletions_) {
+        if (inserted.count(del.CellId_)) {
+            deleted.insert(del.CellId_);
+        }
+    }
+    std::vector<InsertionGroup> groups;
+    std::vector<const model::InsertValue*> stack;
+    for (auto &[nearCellId, inserts] : children) {
+        if (inserted.count(nearCellId)) {
+            continue;
+        }
+        auto &group = groups.emplace_back(InsertionGroup{.NearCellId_ = nearCellId});
+        stack.assign(inserts.begin(), inserts.end());
+        while (!stack.empty()) {
+            const model::InsertValue *insert = stack.back();
+            stack.pop_back();
+            if (!deleted.count(insert->Cell_.CellId_)) {
+                group.Cells_.push_back(insert->Cell_);
+            }
+            auto it = children.find(insert->Cell_.CellId_);
+            if (it != children.end()) {
+                stack.insert(stack.end(), it->second.begin(), it->second.end());
+            }
+        }
+        if (group.Cells_.empty()) {
+            groups.pop_back();
+        }
+    }
+    return groups;
+}
+
+struct ClientStateNop final : IClientState {
     virtual ~ClientStateNop(){}
 
     api::UpdateValueRequest GenerateUpdateValueRequest(std::mt19937 &) override {
@@ -84,11 +138,15 @@ struct ClientStateNop : IClientState {
     void HandleState(const api::State &) override {
         log::WriteClientState("ClientStateNop::HandleState");
     }
+
+    api::State MakeSnapshot() const override {
+        return api::State({});
+    }
 };
 
 
 
-struct ClientState : IClientState {
+struct ClientState final : IClientState {
     std::deque<model::Cell> Cells_;
     model::IterationI Iteration_ = 0;
 
@@ -132,12 +190,52 @@ struct ClientState : IClientState {
         return api::LoadStateRequest(Iteration_);
     }
 
-    void ApplyOperations(const api::GenericResponse &_response) {
-        std::unordered_map<model::CellId, const model::InsertValue*> postponedInserts;
+    // rebuilds the array in one pass, O(n + k) instead of a linear search for every operation
+    void ApplyBatch(const api::GenericResponse &_response) {
+        log::WriteClientState("ClientState::ApplyBatch");
+        std::unordered_map<model::CellId, model::Value> updates;
         for (auto &update : _response.Updates_) {
-            auto it = std::find_if(Cells_.begin(), Cells_.end(), [id=update.Cell_.CellId_] (auto &el) { return el.CellId_ == id;});
-            it->Value_ = update.Cell_.Value_;
+            updates[update.Cell_.CellId_] = update.Cell_.Value_;
         }
+        std::unordered_set<model::CellId> deletions;
+        for (auto &del : _response.Deletions_) {
+            deletions.insert(del.CellId_);
+        }
+        auto groups = GroupInsertions(_response);
+        std::unordered_map<model::CellId, const InsertionGroup*> groupAfter;
+        for (auto &group : groups) {
+            groupAfter[group.NearCellId_] = &group;
+        }
+
+        std::deque<model::Cell> cells;
+        auto put = [&] (const model::Cell &_cell) {
+            auto it = updates.find(_cell.CellId_);
+            cells.push_back(it == updates.end() ? _cell : model::Cell(_cell.CellId_, it->second));
+        };
+        auto putGroup = [&] (model::CellId _nearCellId) {
+            auto it = groupAfter.find(_nearCellId);
+            if (it != groupAfter.end()) {
+                for (auto &cell : it->second->Cells_) {
+                    put(cell);
+                }
+            }
+        };
+        putGroup(0);
+        for (auto &cell : Cells_) {
+            if (!deletions.count(cell.CellId_)) {
+                put(cell);
+            }
+            putGroup(cell.CellId_);
+        }
+        Cells_ = std::move(cells);
+    }
+
+    void ApplyOperations(const api::GenericResponse &_response) {
+        if (_response.Updates_.size() + _response.Insertions_.size() + _response.Deletions_.size() >= magic_numbers::BatchApplySize) {
+            ApplyBatch(_response);
+            return;
+        }
+        std::unordered_map<model::CellId, const model::InsertValue*> postponedInserts;
         for (auto &insert : _response.Insertions_) {
             if (insert.NearCellId_) {
                 auto it = std::find_if(Cells_.begin(), Cells_.end(), [id=insert.NearCellId_] (auto &el) { return el.CellId_ == id;});
@@ -159,9 +257,18 @@ struct ClientState : IClientState {
                 postponedInserts.erase(std::exchange(postponedIt, next));
             }
         }
+        // updates carry the last value of the cell, so they go after insertions of the same diff
+        for (auto &update : _response.Updates_) {
+            auto it = std::find_if(Cells_.begin(), Cells_.end(), [id=update.Cell_.CellId_] (auto &el) { return el.CellId_ == id;});
+            if (it != Cells_.end()) {
+                it->Value_ = update.Cell_.Value_;
+            }
+        }
         for (auto &del : _response.Deletions_) {
             auto it = std::find_if(Cells_.begin(), Cells_.end(), [id=del.CellId_] (auto &el) { return el.CellId_ == id;});
-            Cells_.erase(it);
+            if (it != Cells_.end()) {
+                Cells_.erase(it);
+            }
         }
     }
 
@@ -195,6 +302,7 @@ struct ClientState : IClientState {
             log::WriteClientState("ClientState::HandleState{Init}");
             Cells_.insert(Cells_.begin(), _response.Cells_.cbegin(), _response.Cells_.cend());
             log::WriteClientState("ClientState::HandleState{Cells_.size()=", Cells_.size(),'}');
+            Iteration_ = _response.Iteration_;
             return;
         }
         if (magic_numbers::WithStateChecking) {
@@ -213,7 +321,7 @@ struct ClientState : IClientState {
                         log::ForceWrite("Cells aren't equal by value at ", idx, ' ', cell.Value_, ' ', _response.Cells_[idx].Value_);
                     }
                     for (uint32_t idx2 = 0; idx2 < Cells_.size(); ++idx2) {
-                        log::WriteFullStateLog('<', idx2, "> ", Cells_[idx2].CellId_);
+                        log::WriteFullStateLog("<", idx2, "> ", Cells_[idx2].CellId_);
                     }
                     log::ForceWrite("END LIST");
                     std::exit(1);
@@ -223,458 +331,412 @@ struct ClientState : IClientState {
             Iteration_ = _response.Iteration_;
         }
     }
+
+    api::State MakeSnapshot() const override {
+        api::State state(model::CellVector(Cells_.begin(), Cells_.end()));
+        state.Iteration_ = Iteration_;
+        return state;
+    }
 };
 
-template <typename _Value>
-struct DecardTree {
-    using Pointer = DecardTree*;
-    using ConstPointer = const DecardTree*;
-    using Priority = uint64_t;
+struct FastClientState final : IClientState {
+    using Tree = DecardTree<model::Cell>;
 
-    Pointer Left_ = nullptr;
-    Pointer Right_ = nullptr;
-    Pointer Parent_ = nullptr;
+    Tree Cells_;
+    // node of every cell by its id, ids are given by the server one by one so the index is dense
+    std::vector<Tree::Index> Nodes_;
 
-    uint32_t Size_ = 1;
-    Priority Priority_ = 0;
-    
-    _Value Value_;
+    std::random_device RandomDevice_;
+    std::mt19937 Generator_;
+    std::uniform_int_distribution<Tree::Priority> GeneratePriority_;
 
-    ~DecardTree() {
-        if (Left_) {
-            delete Left_;
-        }
-        if (Right_) {
-            delete Right_;
-        }
+    model::IterationId Iteration_ = 0;
+
+    FastClientState()
+        : Generator_(RandomDevice_())
+    {}
+
+    virtual ~FastClientState(){}
+
+    Tree::Index FindNode(model::CellId _id) const {
+        return _id < Nodes_.size() ? Nodes_[_id] : Tree::Null;
     }
 
-    uint32_t GetLeftSize() const {
-        if (Left_) {
-            return Left_->Size_;
+    void SetNode(model::CellId _id, Tree::Index _node) {
+        if (_id >= Nodes_.size()) {
+            Nodes_.resize(std::max<size_t>(_id + 1, Nodes_.size() * 3 / 2), Tree::Null);
         }
-        return 0;
+        Nodes_[_id] = _node;
     }
 
-    uint32_t GetRightSize() const {
-        if (Right_) {
-            return Right_->Size_;
+    api::UpdateValueRequest GenerateUpdateValueRequest(std::mt19937 &_gen) override {
+        log::WriteClientState("FastClientState::GenerateUpdateValueRequest");
+        if (Cells_.Size() < 1) {
+            log::ForceWrite("FastClientState::GenerateUpdateValueRequest{SMALL SIZE} ", Cells_.Size());
+            std::exit(1);
         }
-        return 0;
+        std::uniform_int_distribution<uint32_t> idxDistrib(0, Cells_.Size()-1);
+        auto &cell = Cells_.Value(GetNode(idxDistrib(_gen)));
+        std::uniform_int_distribution<model::Value> valueDistrib(0);
+        model::Value value = valueDistrib(_gen);
+        log::WriteClientState("FastClientState::GenerateUpdateValueRequest{id=", cell.CellId_, ", value=", value, '}');
+        return api::UpdateValueRequest(cell.CellId_, value, Iteration_);
     }
 
-    void TieLeft() {
-        if (Left_) {
-            Left_->Parent_ = this;
+    api::InsertValueRequest GenerateInsertValueRequest(std::mt19937 &_gen) override {
+        log::WriteClientState("FastClientState::GenerateInsertValueRequest");
+        std::uniform_int_distribution<uint32_t> idxDistrib(0, Cells_.Size());
+        model::CellId cellId = 0;
+        if (uint32_t idx = idxDistrib(_gen)) {
+            cellId = Cells_.Value(GetNode(idx - 1)).CellId_;
         }
+        std::uniform_int_distribution<model::Value> valueDistrib(0);
+        model::Value value = valueDistrib(_gen);
+        log::WriteClientState("FastClientState::GenerateInsertValueRequest{after=", cellId, ", value=", value, '}');
+        return api::InsertValueRequest(cellId, value, Iteration_);
     }
 
-    Pointer UntieLeft() {
-        if (Left_) {
-            Left_->Parent_ = nullptr;
+    Tree::Index GetNode(uint32_t idx)  {
+        auto node = Cells_.Get(idx);
+        if (node == Tree::Null) {
+            log::WriteClientState("FastClientState::GetNode{can't find node} ", idx, '/', Cells_.Size());
+            std::exit(1);
         }
-        return std::exchange(Left_, nullptr);
+        return node;
     }
 
-
-    void TieRight() {
-        if (Right_) {
-            Right_->Parent_ = this;
+    api::DeleteValueRequest GenerateDeleteValueRequest(std::mt19937 &_gen) override {
+        log::WriteClientState("FastClientState::GenerateDeleteValueRequest");
+        if (Cells_.Size() < 1) {
+            log::ForceWrite("FastClientState::GenerateDeleteValueRequest{SMALL SIZE} ", Cells_.Size());
+            std::exit(1);
         }
+        std::uniform_int_distribution<uint32_t> idxDistrib(0, Cells_.Size()-1);
+        model::CellId id = Cells_.Value(GetNode(idxDistrib(_gen))).CellId_;
+        log::WriteClientState("FastClientState::GenerateDeleteValueRequest{id=", id, '}');
+        return api::DeleteValueRequest(id, Iteration_);
     }
 
-    Pointer UntieRight() {
-        if (Right_) {
-            Right_->Parent_ = nullptr;
-        }
-        return std::exchange(Right_, nullptr);
+    api::LoadStateRequest GenerateLoadStateRequest() override {
+        log::WriteClientState("FastClientState::GenerateLoadState");
+        return api::LoadStateRequest(Iteration_);
+    }
+
+    api::SyncRequest GenerateSyncRequest() override {
+        log::WriteClientState("FastClientState::GenerateSyncRequest");
+        return api::SyncRequest(Iteration_);
     }
 
-    void RecalculateSize() {
-        Size_ = 1 + GetLeftSize() + GetRightSize();
+    void InsertCell(uint32_t _idx, const model::Cell &_cell) {
+        auto node = Cells_.Allocate(GeneratePriority_(Generator_), _cell);
+        SetNode(_cell.CellId_, node);
+        Cells_.Insert(_idx, node);
     }
 
-    std::pair<Pointer, Pointer> SplitByIndex(uint32_t _idx) {
-        log::WriteDecardTree("SplitByIndex ", _idx);
-        if (_idx > Size_) {
-            log::WriteDecardTree("SplitByIndex{TooBig} ", _idx, '/', Size_);
-        }
-        if (_idx == Size_) {
-            log::WriteDecardTree("SplitByIndex{Big} ", _idx);
-            Parent_ = nullptr;
-            RecalculateSize();
-            return {this, nullptr};
+    // positions of all groups and deletions are taken from the tree before the diff,
+    // then the tree is changed by one split/merge sweep
+    void ApplyBatch(const api::GenericResponse &_response) {
+        log::WriteClientState("FastClientState::ApplyBatch");
+        std::vector<Tree::Edit> edits;
+        for (auto &group : GroupInsertions(_response)) {
+            uint32_t position = 0;
+            if (group.NearCellId_) {
+                auto near = FindNode(group.NearCellId_);
+                if (near == Tree::Null) {
+                    log::WriteClientState("FastClientState::ApplyBatch{unknown near} ", group.NearCellId_);
+                    continue;
+                }
+                position = Cells_.GetIdx(near) + 1;
+            }
+            auto &edit = edits.emplace_back(Tree::Edit{.Position_ = position});
+            edit.Nodes_.reserve(group.Cells_.size());
+            for (auto &cell : group.Cells_) {
+                edit.Nodes_.push_back(Cells_.Allocate(GeneratePriority_(Generator_), cell));
+            }
         }
-        uint32_t leftSize = GetLeftSize();
-        if (leftSize < _idx) {
-            log::WriteDecardTree("SplitByIndex{Right} ", _idx);
-            if (Right_) {
-                auto [left, right] = UntieRight()->SplitByIndex(_idx - leftSize - 1);
-                Right_ = left;
-                TieRight();
-                Parent_ = nullptr;
-                if (right) right->Parent_ = nullptr;
-                RecalculateSize();
-                if (right) right->RecalculateSize();
-                return {this, right};
-            } else {
-                Parent_ = nullptr;
-                RecalculateSize();
-                return {this, nullptr};
+        for (auto &del : _response.Deletions_) {
+            auto node = FindNode(del.CellId_);
+            if (node != Tree::Null) {
+                edits.push_back(Tree::Edit{.Position_ = Cells_.GetIdx(node), .Erase_ = true});
+                Nodes_[del.CellId_] = Tree::Null;
             }
-        } else {
-            log::WriteDecardTree("SplitByIndex{Left} ", _idx);
-            if (Left_) {
-                auto [left, right] = Left_->SplitByIndex(_idx);
-                Left_ = right;
-                TieLeft();
-                Parent_ = nullptr;
-                if (left) left->Parent_ = nullptr;
-                RecalculateSize();
-                if (left) left->RecalculateSize();
-                return {left, this};
-            } else {
-                Parent_ = nullptr;
-                RecalculateSize();
-                return {nullptr, this};
+        }
+        for (auto &edit : edits) {
+            for (auto node : edit.Nodes_) {
+                SetNode(Cells_.Value(node).CellId_, node);
             }
         }
+        Cells_.ApplyBatch(edits);
+        ApplyUpdates(_response);
     }
 
-    Pointer Insert(uint32_t _idx, Pointer _node) {
-        log::WriteDecardTree("Insert ", _idx);
-        if (!_node) {
-            log::WriteDecardTree("Insert{Without node}");
-        }
-        if (_idx > Size_) {
-            log::WriteDecardTree("Insert{TooBig}");
-        }
-        if (_node->Priority_ > Priority_) {
-            log::WriteDecardTree("Insert{Up} ", _idx, ' ', GetLeftSize());
-            auto [left, right] = SplitByIndex(_idx);
-            _node->Left_ = left;
-            _node->TieLeft();
-            _node->Right_ = right;
-            _node->TieRight();
-            _node->Parent_ = nullptr;
-            _node->RecalculateSize();
-            return _node;
-        } else if (_idx <= GetLeftSize()) {
-            log::WriteDecardTree("Insert{Left} ", _idx, ' ', GetLeftSize());
-            if (Left_) {
-                Left_ = Left_->Insert(_idx, _node);
-            } else {
-                Left_ = _node;
-            }
-            TieLeft();
-        } else {
-            log::WriteDecardTree("Insert{Right} ", _idx, ' ', GetLeftSize());
-            if (Right_) {
-                Right_ = Right_->Insert(_idx - GetLeftSize() - 1, _node);
-            } else {
-                Right_ = _node;
+    void ApplyUpdates(const api::GenericResponse &_response) {
+        for (auto &update : _response.Updates_) {
+            auto node = FindNode(update.Cell_.CellId_);
+            if (node != Tree::Null) {
+                Cells_.Value(node).Value_ = update.Cell_.Value_;
             }
-            TieRight();
         }
-        RecalculateSize();
-        Parent_ = nullptr;
-        return this;
     }
 
-    Pointer Merge(Pointer _tree) {
-        log::WriteDecardTree("Merge");
-        if (!this) {
-            log::WriteDecardTree("Merge{not this}");
-            std::exit(1);
-            return this;
-        }
-        if (!_tree) {
-            log::WriteDecardTree("Merge{not tree}");
-            Parent_ = nullptr;
-            log::WriteDecardTree("Merge{untie parrent}");
-            RecalculateSize();
-            log::WriteDecardTree("Merge{recalculate size}");
-            return this;
-        }
-        if (Priority_ > _tree->Priority_) {
-            log::WriteDecardTree("Merge{upper}");
-            if (Right_) {
-                Right_ = UntieRight()->Merge(_tree);
-            } else {
-                Right_ = _tree;
+    void ApplyOperations(const api::GenericResponse &_response) {
+        if (_response.Updates_.size() + _response.Insertions_.size() + _response.Deletions_.size() >= magic_numbers::BatchApplySize) {
+            ApplyBatch(_response);
+            return;
+        }
+        std::unordered_map<model::CellId, const model::InsertValue*> postponedInserts;
+        for (auto &insert : _response.Insertions_) {
+            uint32_t idx = 0;
+            if (insert.NearCellId_) {
+                auto node = FindNode(insert.NearCellId_);
+                if (node == Tree::Null) {
+                    postponedInserts[insert.NearCellId_] = &insert;
+                    continue;
+                }
+                idx = Cells_.GetIdx(node) + 1;
             }
-            TieRight();
-            Parent_ = nullptr;
-            RecalculateSize();
-            return this;
-        } else {
-            log::WriteDecardTree("Merge{lower}");
-            if (_tree->Left_) {
-                _tree->Left_ = Merge(_tree->UntieLeft());
-            } else {
-                _tree->Left_ = this;
+            InsertCell(idx, insert.Cell_);
+
+            auto postponedIt = postponedInserts.find(insert.Cell_.CellId_);
+            while (postponedIt != postponedInserts.end()) {
+                idx = Cells_.GetIdx(FindNode(postponedIt->first)) + 1;
+                InsertCell(idx, postponedIt->second->Cell_);
+                auto next = postponedInserts.find(postponedIt->second->Cell_.CellId_);
+                postponedInserts.erase(std::exchange(postponedIt, next));
             }
-            _tree->TieLeft();
-            _tree->Parent_ = nullptr;
-            _tree->RecalculateSize();
-            return _tree;
         }
-    }
-
-    uint32_t GetIdx() const {
-        ConstPointer current = this;
-        uint32_t acc = GetLeftSize();
-        while (current->Parent_) {
-            if (current->Parent_->Right_ == current) {
-                acc += current->Parent_->GetLeftSize() + 1;
+        ApplyUpdates(_response);
+        for (auto &del : _response.Deletions_) {
+            auto node = FindNode(del.CellId_);
+            if (node != Tree::Null) {
+                Cells_.Erase(node);
+                Nodes_[del.CellId_] = Tree::Null;
             }
-            current = current->Parent_;
         }
-        return acc;
     }
 
-    Pointer Get(uint32_t _idx) {
-        uint32_t leftSize = GetLeftSize();
-        if (leftSize == _idx) {
-            return this;
-        } else {
-            if (leftSize > _idx) {
-                return Left_->Get(_idx);
-            } else {
-                return Right_->Get(_idx - leftSize - 1);
-            }
+    void HandleUpdateValueResponse(const api::UpdateValueResponse &_response) override {
+        log::WriteClientState("FastClientState::HandleUpdateValueResponse ", _response.Iteration_);
+        ApplyOperations(_response);
+        Iteration_ = _response.Iteration_;
+    }
+
+    void HandleInsertValueResponse(const api::InsertValueResponse &_response) override {
+        log::WriteClientState("FastClientState::HandleInsertValueResponse ", _response.Iteration_);
+        ApplyOperations(_response);
+        Iteration_ = _response.Iteration_;
+    }
+
+    void HandleDeleteValueResponse(const api::DeleteValueResponse &_response) override {
+        log::WriteClientState("FastClientState::HandleDeleteValueResponse ", _response.Iteration_);
+        ApplyOperations(_response);
+        Iteration_ = _response.Iteration_;
+    }
+
+    void HandleSyncResponse(const api::SyncResponse &_response) override {
+        log::WriteClientState("FastClientState::HandleSyncResponse");
+        ApplyOperations(_response);
+        Iteration_ = _response.Iteration_;
+    }
+
+    // range scans: the cursor walks from the cell to the end of the array, Cells_.end() stops it
+    Tree::Cursor CursorAt(uint32_t _idx) const {
+        return Cells_.At(_idx);
+    }
+
+    Tree::Cursor CursorAtId(model::CellId _id) const {
+        return Cells_.AtNode(FindNode(_id));
+    }
+
+    model::CellVector Export() const {
+        model::CellVector cells;
+        Cells_.Export(0, Cells_.Size(), &cells);
+        return cells;
+    }
+
+    void PrintCells() const {
+        uint32_t idx = 0;
+        for (auto &cell : Cells_) {
+            log::WriteFullStateLog("<", idx++, "> ", cell.CellId_);
         }
+        log::ForceWrite("END LIST");
     }
 
-    std::pair<Pointer, Pointer> Erase(uint32_t _idx) {
-        uint32_t leftSize = GetLeftSize();
-        log::WriteDecardTree("Erase ", _idx , '/', Size_, ' ', leftSize);
-        if (leftSize == _idx) {
-            auto res = Left_ ? UntieLeft()->Merge(UntieRight()) : UntieRight();
-            log::WriteDecardTree("Erase{merged}");
-            Parent_ = nullptr;
-            Size_ = 1;
-            log::WriteDecardTree("Erase{merged return}");
-            return {res, this};
-        } else {
-            if (leftSize > _idx) {
-                auto [left, erased] = UntieLeft()->Erase(_idx);
-                Left_ = left;
-                TieLeft();
-                Size_--;
-                return {this, erased};
-            } else {
-                auto [right, erased] = UntieRight()->Erase(_idx - leftSize - 1);
-                Right_ = right;
-                TieRight();
-                Size_--;
-                return {this, erased};
+    void HandleState(const api::State &_response) override {
+        log::WriteClientState("FastClientState::HandleState");
+        if (Cells_.Empty()) {
+            log::WriteClientState("FastClientState::HandleState{Init}");
+            model::CellId maxId = 0;
+            for (auto &cell : _response.Cells_) {
+                maxId = std::max(maxId, cell.CellId_);
             }
+            Nodes_.assign(maxId + 1, Tree::Null);
+            // every cell has its own slot of Nodes_, so building threads don't race
+            Cells_.Build(_response.Cells_.cbegin(), _response.Cells_.cend(), Generator_(), [this] (Tree::Index _node, const model::Cell &_cell) {
+                Nodes_[_cell.CellId_] = _node;
+            });
+            log::WriteClientState("FastClientState::HandleState{Cells_.size()=", Cells_.Size(),'}');
+            Iteration_ = _response.Iteration_;
+            return;
+        }
+        if (magic_numbers::WithStateChecking) {
+            ApplyOperations(_response);
+            if (Cells_.Size() != _response.Cells_.size()) {
+                log::ForceWrite("Sizes aren't equal ", Cells_.Size(), ' ', _response.Cells_.size());
+                PrintCells();
+                std::exit(1);
+            }
+            uint32_t idx = 0;
+            auto cursor = Cells_.begin();
+            for (auto &cell : _response.Cells_) {
+                auto &value = *cursor++;
+                if (value != cell) {
+                    if (value.CellId_ !=  cell.CellId_) {
+                        log::ForceWrite("Cells aren't equal at ", idx, ' ', value.CellId_, ' ', cell.CellId_);
+                        PrintCells();
+                    } else {
+                        log::ForceWrite("Cells equal by id at ", idx, ' ', value.CellId_, ' ', cell.CellId_);
+                        log::ForceWrite("Cells aren't equal by value at ", idx, ' ', value.Value_, ' ', cell.Value_);
+                    }
+                    std::exit(1);
+                }
+                idx++;
+            }
+            Iteration_ = _response.Iteration_;
         }
     }
-};
 
-struct FastClientState : IClientState {
-    DecardTree<model::Cell> Cells_;
-    std::unordered_map<model::CellId, DecardTree<model::Cell>::Pointer> Nodes_;
+    api::State MakeSnapshot() const override {
+        api::State state(Export());
+        state.Iteration_ = Iteration_;
+        return state;
+    }
+};
 
-    std::random_device RandomDevice_;
-    std::mt19937 Generator_;
-    std::uniform_int_distribution<DecardTree<model::Cell>::Priority> GeneratePriority_;
+struct BTreeClientState final : IClientState {
+    CellBTree Cells_;
 
     model::IterationId Iteration_ = 0;
 
-    FastClientState()
-        : Cells_(DecardTree<model::Cell>{.Priority_ = std::numeric_limits<DecardTree<model::Cell>::Priority>::max(), .Value_={0, 0}})
-        , Generator_(RandomDevice_())
-        , GeneratePriority_(0, std::numeric_limits<DecardTree<model::Cell>::Priority>::max() - 1)
-    {}
-
-    virtual ~FastClientState(){}
+    virtual ~BTreeClientState(){}
 
     api::UpdateValueRequest GenerateUpdateValueRequest(std::mt19937 &_gen) override {
-        log::WriteClientState("FastClientState::GenerateUpdateValueRequest");
-        if (Cells_.Size_ < 2) {
-            log::ForceWrite("FastClientState::GenerateUpdateValueRequest{SMALL SIZE} ", Cells_.Size_);
+        if (Cells_.Empty()) {
+            log::ForceWrite("BTreeClientState::GenerateUpdateValueRequest{SMALL SIZE} ", Cells_.Size());
             std::exit(1);
         }
-        std::uniform_int_distribution<uint32_t> idxDistrib(0, Cells_.Size_-2);
-        auto node = GetNode(idxDistrib(_gen));
-        auto &cell = node->Value_;
+        std::uniform_int_distribution<uint32_t> idxDistrib(0, Cells_.Size()-1);
+        model::CellId cellId = Cells_.Get(idxDistrib(_gen)).CellId_;
         std::uniform_int_distribution<model::Value> valueDistrib(0);
         model::Value value = valueDistrib(_gen);
-        log::WriteClientState("FastClientState::GenerateUpdateValueRequest{id=", cell.CellId_, ", value=", value, '}');
-        return api::UpdateValueRequest(cell.CellId_, value, Iteration_);
+        log::WriteClientState("BTreeClientState::GenerateUpdateValueRequest{id=", cellId, ", value=", value, '}');
+        return api::UpdateValueRequest(cellId, value, Iteration_);
     }
 
     api::InsertValueRequest GenerateInsertValueRequest(std::mt19937 &_gen) override {
-        log::WriteClientState("FastClientState::GenerateInsertValueRequest");
-        if (Cells_.Size_ < 1) {
-            log::ForceWrite("FastClientState::GenerateInsertValueRequest{SMALL SIZE} ", Cells_.Size_);
-            std::exit(1);
-        }
-       std::uniform_int_distribution<uint32_t> idxDistrib(0, Cells_.Size_-1);
+        std::uniform_int_distribution<uint32_t> idxDistrib(0, Cells_.Size());
         model::CellId cellId = 0;
         if (uint32_t idx = idxDistrib(_gen)) {
-            auto node = GetNode(idx - 1);
-            cellId = node->Value_.CellId_;
+            cellId = Cells_.Get(idx - 1).CellId_;
         }
         std::uniform_int_distribution<model::Value> valueDistrib(0);
         model::Value value = valueDistrib(_gen);
-        log::WriteClientState("FastClientState::GenerateInsertValueRequest{after=", cellId, ", value=", value, '}');
+        log::WriteClientState("BTreeClientState::GenerateInsertValueRequest{after=", cellId, ", value=", value, '}');
         return api::InsertValueRequest(cellId, value, Iteration_);
     }
 
-    DecardTree<model::Cell>::Pointer GetNode(uint32_t idx)  {
-        log::WriteClientState("FastClientState::GetNode{Cells_.Get start} ", idx, '/',  Cells_.Size_-1);
-        auto node = Cells_.Get(idx);
-        log::WriteClientState("FastClientState::GetNode{Cells_.Get ended}");
-        if (node) {
-            return node;
-        } else {
-            log::WriteClientState("FastClientState::GetNode{can't find node} ", idx, '/', Cells_.Size_-1);
-            std::exit(1);
-            return nullptr;
-        }
-    }
-
     api::DeleteValueRequest GenerateDeleteValueRequest(std::mt19937 &_gen) override {
-        log::WriteClientState("FastClientState::GenerateDeleteValueRequest");
-        if (Cells_.Size_ < 2) {
-            log::ForceWrite("FastClientState::GenerateDeleteValueRequest{SMALL SIZE} ", Cells_.Size_);
+        if (Cells_.Empty()) {
+            log::ForceWrite("BTreeClientState::GenerateDeleteValueRequest{SMALL SIZE} ", Cells_.Size());
             std::exit(1);
         }
-        std::uniform_int_distribution<uint32_t> idxDistrib(0, Cells_.Size_-2);
-        uint32_t idx = idxDistrib(_gen);
-        log::WriteClientState("FastClientState::GenerateDeleteValueRequest{generated idx, find id}");
-        auto node = GetNode(idx);
-        model::CellId id = node->Value_.CellId_;
-        log::WriteClientState("FastClientState::GenerateDeleteValueRequest{id=", id, '}');
+        std::uniform_int_distribution<uint32_t> idxDistrib(0, Cells_.Size()-1);
+        model::CellId id = Cells_.Get(idxDistrib(_gen)).CellId_;
+        log::WriteClientState("BTreeClientState::GenerateDeleteValueRequest{id=", id, '}');
         return api::DeleteValueRequest(id, Iteration_);
     }
 
     api::LoadStateRequest GenerateLoadStateRequest() override {
-        log::WriteClientState("FastClientState::GenerateLoadState");
+        log::WriteClientState("BTreeClientState::GenerateLoadState");
         return api::LoadStateRequest(Iteration_);
     }
 
     api::SyncRequest GenerateSyncRequest() override {
-        log::WriteClientState("FastClientState::GenerateSyncRequest");
+        log::WriteClientState("BTreeClientState::GenerateSyncRequest");
         return api::SyncRequest(Iteration_);
     }
 
+    // the position of a group is found once and its cells are put one after another
     void ApplyOperations(const api::GenericResponse &_response) {
-        std::unordered_map<model::CellId, const model::InsertValue*> postponedInserts;
-        for (auto &update : _response.Updates_) {
-            auto node = Nodes_[update.Cell_.CellId_];
-            node->Value_.Value_ = update.Cell_.Value_;
-        }
-        for (auto &insert : _response.Insertions_) {
+        for (auto &group : GroupInsertions(_response)) {
             uint32_t idx = 0;
-            if (insert.NearCellId_) {
-                auto node = Nodes_[insert.NearCellId_];
-                if (!node) {
-                    postponedInserts[insert.NearCellId_] = &insert;
+            if (group.NearCellId_) {
+                if (!Cells_.Contains(group.NearCellId_)) {
+                    log::WriteClientState("BTreeClientState::ApplyOperations{unknown near} ", group.NearCellId_);
                     continue;
                 }
-                idx = node->GetIdx() + 1;
+                idx = Cells_.GetIdx(group.NearCellId_) + 1;
             }
-
-            std::unique_ptr<DecardTree<model::Cell>> newNode(new DecardTree<model::Cell>{.Priority_=GeneratePriority_(Generator_), .Value_=insert.Cell_});
-            Nodes_[insert.Cell_.CellId_] = newNode.get();
-            Cells_.Insert(idx, newNode.release());
-
-            auto postponedIt = postponedInserts.find(insert.Cell_.CellId_);
-            while (postponedIt != postponedInserts.end()) {
-                auto node = Nodes_[postponedIt->second->NearCellId_];
-                idx = node->GetIdx() + 1;
-
-                std::unique_ptr<DecardTree<model::Cell>> newNode(new DecardTree<model::Cell>{.Priority_=GeneratePriority_(Generator_), .Value_=postponedIt->second->Cell_});
-                Nodes_[postponedIt->second->Cell_.CellId_] = newNode.get();
-
-                auto next = postponedInserts.find(postponedIt->second->Cell_.CellId_);
-                postponedInserts.erase(std::exchange(postponedIt, next));
+            for (auto &cell : group.Cells_) {
+                Cells_.Insert(idx++, cell);
+            }
+        }
+        for (auto &update : _response.Updates_) {
+            if (Cells_.Contains(update.Cell_.CellId_)) {
+                Cells_.SetValue(update.Cell_.CellId_, update.Cell_.Value_);
             }
         }
         for (auto &del : _response.Deletions_) {
-            auto node = Nodes_[del.CellId_];
-            uint32_t idx = node->GetIdx();
-            auto [_, erased] =  Cells_.Erase(idx);
-            delete erased;
+            if (Cells_.Contains(del.CellId_)) {
+                Cells_.Erase(del.CellId_);
+            }
         }
     }
 
     void HandleUpdateValueResponse(const api::UpdateValueResponse &_response) override {
-        log::WriteClientState("FastClientState::HandleUpdateValueResponse ", _response.Iteration_);
+        log::WriteClientState("BTreeClientState::HandleUpdateValueResponse ", _response.Iteration_);
         ApplyOperations(_response);
         Iteration_ = _response.Iteration_;
     }
 
     void HandleInsertValueResponse(const api::InsertValueResponse &_response) override {
-        log::WriteClientState("FastClientState::HandleInsertValueResponse ", _response.Iteration_);
+        log::WriteClientState("BTreeClientState::HandleInsertValueResponse ", _response.Iteration_);
         ApplyOperations(_response);
         Iteration_ = _response.Iteration_;
     }
 
     void HandleDeleteValueResponse(const api::DeleteValueResponse &_response) override {
-        log::WriteClientState("FastClientState::HandleDeleteValueResponse ", _response.Iteration_);
+        log::WriteClientState("BTreeClientState::HandleDeleteValueResponse ", _response.Iteration_);
         ApplyOperations(_response);
         Iteration_ = _response.Iteration_;
     }
 
     void HandleSyncResponse(const api::SyncResponse &_response) override {
-        log::WriteClientState("FastClientState::HandleSyncResponse");
+        log::WriteClientState("BTreeClientState::HandleSyncResponse");
         ApplyOperations(_response);
         Iteration_ = _response.Iteration_;
     }
 
     void HandleState(const api::State &_response) override {
-        log::WriteClientState("FastClientState::HandleState");
-        if (Cells_.Size_ == 1) {
-            log::WriteClientState("FastClientState::HandleState{Init}");
-            for (uint32_t idx = 0; idx < _response.Cells_.size(); ++idx) {
-                log::WriteInit("Init idx=", idx, " id=", _response.Cells_[idx].CellId_);
-                std::unique_ptr<DecardTree<model::Cell>> node(new DecardTree<model::Cell>{
-                        .Priority_=GeneratePriority_(Generator_),
-                        .Value_=_response.Cells_[idx]});
-                auto raw = node.get();
-                Nodes_[_response.Cells_[idx].CellId_] = node.get();
-                Cells_.Insert(idx, node.release());
-                if (magic_numbers::WithStateChecking && idx != raw->GetIdx()) {
-                    log::WriteClientState("FastClientState::HandleState{IncorrectIdx} ", idx , ' ', raw->GetIdx());
-                    return;
-                }
-            }
-            log::WriteClientState("FastClientState::HandleState{Cells_.size()=", Cells_.Size_ - 1,'}');
+        log::WriteClientState("BTreeClientState::HandleState");
+        if (Cells_.Empty()) {
+            log::WriteClientState("BTreeClientState::HandleState{Init}");
+            Cells_.Build(_response.Cells_.cbegin(), _response.Cells_.cend());
+            log::WriteClientState("BTreeClientState::HandleState{Cells_.size()=", Cells_.Size(),'}');
             Iteration_ = _response.Iteration_;
             return;
         }
         if (magic_numbers::WithStateChecking) {
             ApplyOperations(_response);
-            if (Cells_.Size_ - 1 != _response.Cells_.size()) {
-                log::ForceWrite("Sizes aren't equal ", Cells_.Size_ - 1, ' ', _response.Cells_.size());
-                for (uint32_t idx = 0; idx < Cells_.Size_ - 1; ++idx) {
-                    auto &value = Cells_.Get(idx)->Value_;
-                    log::WriteFullStateLog('<', idx, "> ", value.CellId_);
-                }
-                log::ForceWrite("END LIST");
+            if (Cells_.Size() != _response.Cells_.size()) {
+                log::ForceWrite("Sizes aren't equal ", Cells_.Size(), ' ', _response.Cells_.size());
                 std::exit(1);
             }
             uint32_t idx = 0;
             for (auto &cell : _response.Cells_) {
-                auto &value = Cells_.Get(idx)->Value_;
+                auto value = Cells_.Get(idx);
                 if (value != cell) {
-                    if (value.CellId_ !=  cell.CellId_) {
-                        log::ForceWrite("Cells aren't equal at ", idx, ' ', value.CellId_, ' ', cell.CellId_);
-                        for (uint32_t idx = 0; idx < Cells_.Size_ - 1; ++idx) {
-                            auto &value = Cells_.Get(idx)->Value_;
-                            log::WriteFullStateLog('<', idx, "> ", value.CellId_);
-                        }
-                        log::ForceWrite("END LIST");
-                    } else {
-                        log::ForceWrite("Cells equal by id at ", idx, ' ', value.CellId_, ' ', cell.CellId_);
-                        log::ForceWrite("Cells aren't equal by value at ", idx, ' ', value.Value_, ' ', cell.Value_);
-                    }
+                    log::ForceWrite("Cells aren't equal at ", idx, ' ', value.CellId_, '=', value.Value_, ' ', cell.CellId_, '=', cell.Value_);
                     std::exit(1);
                 }
                 idx++;
@@ -682,11 +744,21 @@ struct FastClientState : IClientState {
             Iteration_ = _response.Iteration_;
         }
     }
+
+    api::State MakeSnapshot() const override {
+        model::CellVector cells;
+        Cells_.Export(&cells);
+        api::State state(std::move(cells));
+        state.Iteration_ = Iteration_;
+        return state;
+    }
 };
 
-struct FastSmallClientState : IClientState {
+// Keeps only ids of live cells: a dense array for random picks and the slot of every id in it.
+// A deleted id is replaced by the last one, so a pick is O(1) and memory follows the live cells.
+struct FastSmallClientState final : IClientState {
     std::vector<model::CellId> CellIds_;
-    std::unordered_set<model::CellId> DeletedIds_;
+    std::unordered_map<model::CellId, uint32_t> Slots_;
 
     model::IterationId Iteration_ = 0;
 
@@ -695,13 +767,37 @@ struct FastSmallClientState : IClientState {
 
     virtual ~FastSmallClientState(){}
 
-    api::UpdateValueRequest GenerateUpdateValueRequest(std::mt19937 &_gen) override {
+    model::CellId PickCellId(std::mt19937 &_gen, const char *_request) const {
+        if (CellIds_.empty()) {
+            log::ForceWrite("FastSmallClientState::", _request, "{SMALL SIZE}");
+            std::exit(1);
+        }
         std::uniform_int_distribution<uint32_t> idxDistrib(0, CellIds_.size()-1);
-        uint32_t idx = idxDistrib(_gen);
-        while (DeletedIds_.count(CellIds_[idx])) {
-            idx = idxDistrib(_gen);
+        return CellIds_[idxDistrib(_gen)];
+    }
+
+    void AddCellId(model::CellId _id) {
+        if (Slots_.emplace(_id, CellIds_.size()).second) {
+            CellIds_.push_back(_id);
+        }
+    }
+
+    void RemoveCellId(model::CellId _id) {
+        auto it = Slots_.find(_id);
+        if (it == Slots_.end()) {
+            return;
         }
-        model::CellId cellId = CellIds_[idx];
+        uint32_t slot = it->second;
+        Slots_.erase(it);
+        if (slot + 1 != CellIds_.size()) {
+            CellIds_[slot] = CellIds_.back();
+            Slots_[CellIds_[slot]] = slot;
+        }
+        CellIds_.pop_back();
+    }
+
+    api::UpdateValueRequest GenerateUpdateValueRequest(std::mt19937 &_gen) override {
+        model::CellId cellId = PickCellId(_gen, "GenerateUpdateValueRequest");
         std::uniform_int_distribution<model::Value> valueDistrib(0);
         model::Value value = valueDistrib(_gen);
         log::WriteClientState("FastSmallClientState::GenerateUpdateValueRequest{id=", cellId, ", value=", value, '}');
@@ -709,13 +805,9 @@ struct FastSmallClientState : IClientState {
     }
 
     api::InsertValueRequest GenerateInsertValueRequest(std::mt19937 &_gen) override {
-       std::uniform_int_distribution<uint32_t> idxDistrib(0, CellIds_.size());
+        std::uniform_int_distribution<uint32_t> idxDistrib(0, CellIds_.size());
         model::CellId cellId = 0;
-        uint32_t idx = idxDistrib(_gen);
-        while (idx && DeletedIds_.count(CellIds_[idx - 1])) {
-            idx = idxDistrib(_gen);
-        }
-        if (idx) {
+        if (uint32_t idx = idxDistrib(_gen)) {
             cellId = CellIds_[idx - 1];
         }
         std::uniform_int_distribution<model::Value> valueDistrib(0);
@@ -725,12 +817,7 @@ struct FastSmallClientState : IClientState {
     }
 
     api::DeleteValueRequest GenerateDeleteValueRequest(std::mt19937 &_gen) override {
-        std::uniform_int_distribution<uint32_t> idxDistrib(0, CellIds_.size()-1);
-        uint32_t idx = idxDistrib(_gen);
-        while (DeletedIds_.count(CellIds_[idx])) {
-            idx = idxDistrib(_gen);
-        }
-        model::CellId id = CellIds_[idx];
+        model::CellId id = PickCellId(_gen, "GenerateDeleteValueRequest");
         log::WriteClientState("FastSmallClientState::GenerateDeleteValueRequest{id=", id, '}');
         return api::DeleteValueRequest(id, Iteration_);
     }
@@ -748,10 +835,15 @@ struct FastSmallClientState : IClientState {
     void ApplyOperations(const api::GenericResponse &response) {
         log::WriteClientState("FastSmallClientState::ApplyOperations");
         for (auto &insert : response.Insertions_) {
-            CellIds_.push_back(insert.Cell_.CellId_);
+            AddCellId(insert.Cell_.CellId_);
         }
         for (auto &del : response.Deletions_) {
-            DeletedIds_.insert(del.CellId_);
+            RemoveCellId(del.CellId_);
+        }
+        // memory follows the live cells after mass deletions
+        if (CellIds_.capacity() > 4 * CellIds_.size() + 1024) {
+            CellIds_.shrink_to_fit();
+            Slots_.rehash(0);
         }
     }
 
@@ -783,12 +875,26 @@ struct FastSmallClientState : IClientState {
         log::WriteClientState("FastSmallClientState::HandleState");
         if (CellIds_.empty()) {
             log::WriteClientState("FastSmallClientState::HandleState{Init}");
-            CellIds_.reserve(2 * _response.Cells_.size());
-            for (uint32_t idx = 0; idx < _response.Cells_.size(); ++idx) {
-                CellIds_.push_back(_response.Cells_[idx].CellId_);
+            CellIds_.reserve(_response.Cells_.size());
+            Slots_.reserve(_response.Cells_.size());
+            for (auto &cell : _response.Cells_) {
+                AddCellId(cell.CellId_);
             }
             log::WriteClientState("FastSmallClientState::HandleState{Cells_.size()=", CellIds_.size(),'}');
+            Iteration_ = _response.Iteration_;
+        }
+    }
+
+    // values and order aren't kept, so the snapshot has ids only
+    api::State MakeSnapshot() const override {
+        model::CellVector cells;
+        cells.reserve(CellIds_.size());
+        for (model::CellId id : CellIds_) {
+            cells.emplace_back(id, 0);
         }
+        api::State state(std::move(cells));
+        state.Iteration_ = Iteration_;
+        return state;
     }
 };
 
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <core/log.hpp>
+#include <core/model.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+
+namespace home_task::logic {
+
+// Counted B+tree over the cells of the array (a rope).
+// Inner nodes keep the number of cells under every child, so a position is found by scanning
+// a few wide nodes instead of a dependent load per level of a binary tree.
+// Leaves keep ids and values of their cells in packed arrays and every cell id points to its leaf,
+// the position of a cell is its offset in the leaf plus the counts of the left siblings up to the root.
+// Underfull nodes are merged with a neighbour when both fit into one node.
+struct CellBTree {
+    using Index = uint32_t;
+
+    static constexpr Index Null = std::numeric_limits<Index>::max();
+    static constexpr uint32_t LeafCapacity = 64;
+    static constexpr uint32_t InnerCapacity = 32;
+    // bulk loaded nodes are left partly empty so that first inserts don't split them
+    static constexpr uint32_t BuildLeafFill = LeafCapacity * 3 / 4;
+    static constexpr uint32_t BuildInnerFill = InnerCapacity * 3 / 4;
+
+    struct Leaf {
+        Index Parent_ = Null;
+        uint32_t Count_ = 0;
+        model::CellId CellIds_[LeafCapacity];
+        model::Value Values_[LeafCapacity];
+    };
+
+    struct Inner {
+        Index Parent_ = Null;
+        uint32_t Count_ = 0;
+        Index Children_[InnerCapacity];
+        // cells under every child
+        uint32_t Sizes_[InnerCapacity];
+    };
+
+    std::vector<Leaf> Leaves_;
+    std::vector<Inner> Inners_;
+    std::vector<Index> FreeLeaves_;
+    std::vector<Index> FreeInners_;
+    // leaf of every cell by its id, ids are given by the server one by one so the index is dense
+    std::vector<Index> LeafOf_;
+
+    Index Root_ = Null;
+    // inner levels above the leaves, the root is a leaf when zero
+    uint32_t Height_ = 0;
+    uint32_t Size_ = 0;
+
+    CellBTree() {
+        Clear();
+    }
+
+    uint32_t Size() const {
+        return Size_;
+    }
+
+    bool Empty() const {
+        return Size_ == 0;
+    }
+
+    bool Contains(model::CellId _id) const {
+        return _id < LeafOf_.size() && LeafOf_[_id] != Null;
+    }
+
+    void Clear() {
+        Leaves_.clear();
+        Inners_.clear();
+        FreeLeaves_.clear();
+        FreeInners_.clear();
+        LeafOf_.clear();
+        Height_ = 0;
+        Size_ = 0;
+        Root_ = AllocateLeaf();
+    }
+
+    Index AllocateLeaf() {
+        if (FreeLeaves_.empty()) {
+            Leaves_.emplace_back();
+            return Leaves_.size() - 1;
+        }
+        Index leaf = FreeLeaves_.back();
+        FreeLeaves_.pop_back();
+        Leaves_[leaf].Parent_ = Null;
+        Leaves_[leaf].Count_ = 0;
+        return leaf;
+    }
+
+    Index AllocateInner() {
+        if (FreeInners_.empty()) {
+            Inners_.emplace_back();
+            return Inners_.size() - 1;
+        }
+        Index inner = FreeInners_.back();
+        FreeInners_.pop_back();
+        Inners_[inner].Parent_ = Null;
+        Inners_[inner].Count_ = 0;
+        return inner;
+    }
+
+    void SetLeafOf(model::CellId _id, Index _leaf) {
+        if (_id >= LeafOf_.size()) {
+            LeafOf_.resize(std::max<size_t>(_id + 1, LeafOf_.size() * 3 / 2), Null);
+        }
+        LeafOf_[_id] = _leaf;
+    }
+
+    Index GetParent(Index _node, bool _leaf) const {
+        return _leaf ? Leaves_[_node].Parent_ : Inners_[_node].Parent_;
+    }
+
+    void SetParent(Index _node, bool _leaf, Index _parent) {
+        if (_leaf) {
+            Leaves_[_node].Parent_ = _parent;
+        } else {
+            Inners_[_node].Parent_ = _parent;
+        }
+    }
+
+    uint32_t ChildSlot(Index _parent, Index _child) const {
+        const Inner &inner = Inners_[_parent];
+        uint32_t slot = 0;
+        while (slot < inner.Count_ && inner.Children_[slot] != _child) {
+            ++slot;
+        }
+        return slot;
+    }
+
+    uint32_t FindInLeaf(Index _leaf, model::CellId _id) const {
+        const Leaf &leaf = Leaves_[_leaf];
+        return std::find(leaf.CellIds_, leaf.CellIds_ + leaf.Count_, _id) - leaf.CellIds_;
+    }
+
+    // adds _delta to the counts of the ancestors of the node
+    void AddSize(Index _node, bool _leaf, int32_t _delta) {
+        Index child = _node;
+        Index parent = GetParent(_node, _leaf);
+        while (parent != Null) {
+            Inners_[parent].Sizes_[ChildSlot(parent, child)] += _delta;
+            child = parent;
+            parent = Inners_[parent].Parent_;
+        }
+    }
+
+    // leaf and offset of the cell at _idx, _idx equal to the size gives the end of the last leaf
+    std::pair<Index, uint32_t> Find(uint32_t _idx) const {
+        Index node = Root_;
+        for (uint32_t level = Height_; level > 0; --level) {
+            const Inner &inner = Inners_[node];
+            uint32_t slot = 0;
+            while (slot + 1 < inner.Count_ && _idx >= inner.Sizes_[slot]) {
+                _idx -= inner.Sizes_[slot];
+                ++slot;
+            }
+            node = inner.Children_[slot];
+        }
+        return {node, _idx};
+    }
+
+    model::Cell Get(uint32_t _idx) const {
+        auto [leaf, offset] = Find(_idx);
+        return model::Cell(Leaves_[leaf].CellIds_[offset], Leaves_[leaf].Values_[offset]);
+    }
+
+    uint32_t GetIdx(model::CellId _id) const {
+        Index leaf = LeafOf_[_id];
+        uint32_t acc = FindInLeaf(leaf, _id);
+        Index child = leaf;
+        Index parent = Leaves_[leaf].Parent_;
+        while (parent != Null) {
+            const Inner &inner = Inners_[parent];
+            for (uint32_t slot = 0; inner.Children_[slot] != child; ++slot) {
+                acc += inner.Sizes_[slot];
+            }
+            child = parent;
+            parent = inner.Parent_;
+        }
+        return acc;
+    }
+
+    void SetValue(model::CellId _id, model::Value _value) {
+        Index leaf = LeafOf_[_id];
+        Leaves_[leaf].Values_[FindInLeaf(leaf, _id)] = _value;
+    }
+
+    // puts _child right after _left into the parent of _left, splits full parents up to the root
+    void InsertChild(Index _parent, Index _left, uint32_t _leftSize, Index _child, uint32_t _childSize, bool _leaves) {
+        if (_parent == Null) {
+            Index root = AllocateInner();
+            Inner &inner = Inners_[root];
+            inner.Count_ = 2;
+            inner.Children_[0] = _left;
+            inner.Sizes_[0] = _leftSize;
+            inner.Children_[1] = _child;
+            inner.Sizes_[1] = _childSize;
+            SetParent(_left, _leaves, root);
+            SetParent(_child, _leaves, root);
+            Root_ = root;
+            Height_++;
+            return;
+        }
+        if (Inners_[_parent].Count_ == InnerCapacity) {
+            Index right = SplitInner(_parent, _leaves);
+            if (ChildSlot(_parent, _left) == Inners_[_parent].Count_) {
+                _parent = right;
+            }
+        }
+        Inner &inner = Inners_[_parent];
+        uint32_t slot = ChildSlot(_parent, _left);
+        std::copy_backward(inner.Children_ + slot + 1, inner.Children_ + inner.Count_, inner.Children_ + inner.Count_ + 1);
+        std::copy_backward(inner.Sizes_ + slot + 1, inner.Sizes_ + inner.Count_, inner.Sizes_ + inner.Count_ + 1);
+        inner.Sizes_[slot] = _leftSize;
+        inner.Children_[slot + 1] = _child;
+        inner.Sizes_[slot + 1] = _childSize;
+        inner.Count_++;
+        SetParent(_child, _leaves, _parent);
+    }
+
+    // moves the upper half of children to a new node, _leaves tells whether the children are leaves
+    Index SplitInner(Index _inner, bool _leaves) {
+        Index right = AllocateInner();
+        Inner &left = Inners_[_inner];
+        Inner &moved = Inners_[right];
+        uint32_t half = left.Count_ / 2;
+        moved.Count_ = left.Count_ - half;
+        std::copy(left.Children_ + half, left.Children_ + left.Count_, moved.Children_);
+        std::copy(left.Sizes_ + half, left.Sizes_ + left.Count_, moved.Sizes_);
+        left.Count_ = half;
+        uint32_t leftSize = 0;
+        for (uint32_t slot = 0; slot < left.Count_; ++slot) {
+            leftSize += left.Sizes_[slot];
+        }
+        uint32_t rightSize = 0;
+        for (uint32_t slot = 0; slot < moved.Count_; ++slot) {
+            rightSize += moved.Sizes_[slot];
+            SetParent(moved.Children_[slot], _leaves, right);
+        }
+        InsertChild(left.Parent_, _inner, leftSize, right, rightSize, false);
+        return right;
+    }
+
+    Index SplitLeaf(Index _leaf) {
+        Index right = AllocateLeaf();
+        Leaf &left = Leaves_[_leaf];
+        Leaf &moved = Leaves_[right];
+        uint32_t half = left.Count_ / 2;
+        moved.Count_ = left.Count_ - half;
+        std::copy(left.CellIds_ + half, left.CellIds_ + left.Count_, moved.CellIds_);
+        std::copy(left.Values_ + half, left.Values_ + left.Count_, moved.Values_);
+        left.Count_ = half;
+        for (uint32_t offset = 0; offset < moved.Count_; ++offset) {
+            LeafOf_[moved.CellIds_[offset]] = right;
+        }
+        InsertChild(left.Parent_, _leaf, left.Count_, right, moved.Count_, true);
+        return right;
+    }
+
+    void Insert(uint32_t _idx, const model::Cell &_cell) {
+        log::WriteDecardTree("CellBTree::Insert ", _idx, '/', Size_);
+        auto [leaf, offset] = Find(_idx);
+        if (Leaves_[leaf].Count_ == LeafCapacity) {
+            Index right = SplitLeaf(leaf);
+            if (offset > Leaves_[leaf].Count_) {
+                offset -= Leaves_[leaf].Count_;
+                leaf = right;
+            }
+        }
+        Leaf &target = Leaves_[leaf];
+        std::copy_backward(target.CellIds_ + offset, target.CellIds_ + target.Count_, target.CellIds_ + target.Count_ + 1);
+        std::copy_backward(target.Values_ + offset, target.Values_ + target.Count_, target.Values_ + target.Count_ + 1);
+        target.CellIds_[offset] = _cell.CellId_;
+        target.Values_[offset] = _cell.Value_;
+        target.Count_++;
+        SetLeafOf(_cell.CellId_, leaf);
+        AddSize(leaf, true, 1);
+        Size_++;
+    }
+
+    void Erase(model::CellId _id) {
+        log::WriteDecardTree("CellBTree::Erase ", _id);
+        Index leaf = LeafOf_[_id];
+        Leaf &target = Leaves_[leaf];
+        uint32_t offset = FindInLeaf(leaf, _id);
+        std::copy(target.CellIds_ + offset + 1, target.CellIds_ + target.Count_, target.CellIds_ + offset);
+        std::copy(target.Values_ + offset + 1, target.Values_ + target.Count_, target.Values_ + offset);
+        target.Count_--;
+        LeafOf_[_id] = Null;
+        AddSize(leaf, true, -1);
+        Size_--;
+        if (target.Count_ < LeafCapacity / 4) {
+            MergeLeaf(leaf);
+        }
+    }
+
+    void MergeLeaf(Index _leaf) {
+        Index parent = Leaves_[_leaf].Parent_;
+        if (parent == Null || Inners_[parent].Count_ < 2) {
+            return;
+        }
+        uint32_t slot = ChildSlot(parent, _leaf);
+        if (slot + 1 == Inners_[parent].Count_) {
+            slot--;
+        }
+        Index leftIdx = Inners_[parent].Children_[slot];
+        Index rightIdx = Inners_[parent].Children_[slot + 1];
+        Leaf &left = Leaves_[leftIdx];
+        Leaf &right = Leaves_[rightIdx];
+        if (left.Count_ + right.Count_ > LeafCapacity) {
+            return;
+        }
+        std::copy(right.CellIds_, right.CellIds_ + right.Count_, left.CellIds_ + left.Count_);
+        std::copy(right.Values_, right.Values_ + right.Count_, left.Values_ + left.Count_);
+        for (uint32_t offset = 0; offset < right.Count_; ++offset) {
+            LeafOf_[right.CellIds_[offset]] = leftIdx;
+        }
+        left.Count_ += right.Count_;
+        Inners_[parent].Sizes_[slot] = left.Count_;
+        RemoveChild(parent, slot + 1, true);
+        FreeLeaves_.push_back(rightIdx);
+    }
+
+    void MergeInner(Index _inner) {
+        Index parent = Inners_[_inner].Parent_;
+        if (parent == Null || Inners_[parent].Count_ < 2) {
+            return;
+        }
+        uint32_t slot = ChildSlot(parent, _inner);
+        if (slot + 1 == Inners_[parent].Count_) {
+            slot--;
+        }
+        Index leftIdx = Inners_[parent].Children_[slot];
+        Index rightIdx = Inners_[parent].Children_[slot + 1];
+        Inner &left = Inners_[leftIdx];
+        Inner &right = Inners_[rightIdx];
+        if (left.Count_ + right.Count_ > InnerCapacity) {
+            return;
+        }
+        // children of the merged nodes are leaves when their parent is on the lowest inner level
+        bool leaves = GetInnerLevel(parent) == 2;
+        std::copy(right.Children_, right.Children_ + right.Count_, left.Children_ + left.Count_);
+        std::copy(right.Sizes_, right.Sizes_ + right.Count_, left.Sizes_ + left.Count_);
+        for (uint32_t child = 0; child < right.Count_; ++child) {
+            SetParent(right.Children_[child], leaves, leftIdx);
+        }
+        left.Count_ += right.Count_;
+        Inners_[parent].Sizes_[slot] += Inners_[parent].Sizes_[slot + 1];
+        RemoveChild(parent, slot + 1, false);
+        FreeInners_.push_back(rightIdx);
+    }
+
+    // level of an inner node, its children are leaves on the level 1
+    uint32_t GetInnerLevel(Index _inner) const {
+        uint32_t level = 1;
+        for (Index node = _inner; Inners_[node].Parent_ != Null; node = Inners_[node].Parent_) {
+            ++level;
+        }
+        return Height_ - level + 1;
+    }
+
+    void RemoveChild(Index _parent, uint32_t _slot, bool _leaves) {
+        Inner &inner = Inners_[_parent];
+        std::copy(inner.Children_ + _slot + 1, inner.Children_ + inner.Count_, inner.Children_ + _slot);
+        std::copy(inner.Sizes_ + _slot + 1, inner.Sizes_ + inner.Count_, inner.Sizes_ + _slot);
+        inner.Count_--;
+        if (_parent == Root_) {
+            if (inner.Count_ == 1) {
+                Root_ = inner.Children_[0];
+                SetParent(Root_, _leaves, Null);
+                Height_--;
+                FreeInners_.push_back(_parent);
+            }
+        } else if (inner.Count_ < InnerCapacity / 4) {
+            MergeInner(_parent);
+        }
+    }
+
+    // appends all cells in their order to _out
+    void Export(std::vector<model::Cell> *_out) const {
+        _out->reserve(_out->size() + Size_);
+        ExportNode(Root_, Height_, _out);
+    }
+
+    void ExportNode(Index _node, uint32_t _level, std::vector<model::Cell> *_out) const {
+        if (!_level) {
+            const Leaf &leaf = Leaves_[_node];
+            for (uint32_t offset = 0; offset < leaf.Count_; ++offset) {
+                _out->emplace_back(leaf.CellIds_[offset], leaf.Values_[offset]);
+            }
+            return;
+        }
+        const Inner &inner = Inners_[_node];
+        for (uint32_t slot = 0; slot < inner.Count_; ++slot) {
+            ExportNode(inner.Children_[slot], _level - 1, _out);
+        }
+    }
+
+    // replaces the tree with the cells of [_begin, _end) in their order in O(n)
+    template <typename _Iterator>
+    void Build(_Iterator _begin, _Iterator _end) {
+        Clear();
+        FreeLeaves_.push_back(Root_);
+        std::vector<std::pair<Index, uint32_t>> level;
+        model::CellId maxId = 0;
+        for (auto it = _begin; it != _end; ++it) {
+            maxId = std::max(maxId, it->CellId_);
+        }
+        LeafOf_.assign(maxId + 1, Null);
+        for (auto it = _begin; it != _end;) {
+            Index leaf = AllocateLeaf();
+            Leaf &target = Leaves_[leaf];
+            for (; it != _end && target.Count_ < BuildLeafFill; ++it) {
+                target.CellIds_[target.Count_] = it->CellId_;
+                target.Values_[target.Count_] = it->Value_;
+                target.Count_++;
+                LeafOf_[it->CellId_] = leaf;
+            }
+            Size_ += target.Count_;
+            level.emplace_back(leaf, target.Count_);
+        }
+        if (level.empty()) {
+            Root_ = AllocateLeaf();
+            return;
+        }
+        bool leaves = true;
+        while (level.size() > 1) {
+            std::vector<std::pair<Index, uint32_t>> upper;
+            for (size_t idx = 0; idx < level.size();) {
+                Index node = AllocateInner();
+                Inner &inner = Inners_[node];
+                uint32_t size = 0;
+                // the last node takes the tail if it would be too small alone
+                size_t end = level.size() - idx < BuildInnerFill + InnerCapacity / 4 ? level.size() : idx + BuildInnerFill;
+                end = std::min(end, idx + InnerCapacity);
+                for (; idx < end; ++idx) {
+                    inner.Children_[inner.Count_] = level[idx].first;
+                    inner.Sizes_[inner.Count_] = level[idx].second;
+                    inner.Count_++;
+                    size += level[idx].second;
+                    SetParent(level[idx].first, leaves, node);
+                }
+                upper.emplace_back(node, size);
+            }
+            level = std::move(upper);
+            leaves = false;
+            Height_++;
+        }
+        Root_ = level.front().first;
+    }
+};
+
+}
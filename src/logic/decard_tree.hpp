@@ -0,0 +1,430 @@
+#pragma once
+
+#include <core/log.hpp>
+#include <core/magic_numbers.hpp>
+
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <ranges>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace home_task::logic {
+
+// Implicit treap stored in contiguous arrays.
+// Nodes are addressed by 32-bit indices, removed nodes go to a free list and are reused,
+// links and values live in separate arrays so that descents touch only the links.
+// Destruction is releasing two vectors, so it doesn't depend on the depth of the tree.
+template <typename _Value>
+struct DecardTree {
+    using Index = uint32_t;
+    using Priority = uint32_t;
+
+    static constexpr Index Null = std::numeric_limits<Index>::max();
+
+    struct Link {
+        Index Left_ = Null;
+        Index Right_ = Null;
+        Index Parent_ = Null;
+        uint32_t Size_ = 1;
+        Priority Priority_ = 0;
+    };
+
+    std::vector<Link> Links_;
+    std::vector<_Value> Values_;
+    Index Root_ = Null;
+    // free nodes are chained through Right_
+    Index FreeList_ = Null;
+
+    uint32_t Size() const {
+        return GetSize(Root_);
+    }
+
+    bool Empty() const {
+        return Root_ == Null;
+    }
+
+    void Reserve(uint32_t _count) {
+        Links_.reserve(_count);
+        Values_.reserve(_count);
+    }
+
+    void Clear() {
+        Links_.clear();
+        Values_.clear();
+        Root_ = Null;
+        FreeList_ = Null;
+    }
+
+    _Value& Value(Index _node) {
+        return Values_[_node];
+    }
+
+    const _Value& Value(Index _node) const {
+        return Values_[_node];
+    }
+
+    // the node isn't a part of the tree until Insert
+    Index Allocate(Priority _priority, const _Value &_value) {
+        Index node = FreeList_;
+        if (node != Null) {
+            FreeList_ = Links_[node].Right_;
+            Links_[node] = Link{.Priority_ = _priority};
+            Values_[node] = _value;
+        } else {
+            node = Links_.size();
+            Links_.push_back(Link{.Priority_ = _priority});
+            Values_.push_back(_value);
+        }
+        return node;
+    }
+
+    uint32_t GetSize(Index _node) const {
+        return _node == Null ? 0 : Links_[_node].Size_;
+    }
+
+    uint32_t GetLeftSize(Index _node) const {
+        return GetSize(Links_[_node].Left_);
+    }
+
+    void SetLeft(Index _node, Index _child) {
+        Links_[_node].Left_ = _child;
+        if (_child != Null) {
+            Links_[_child].Parent_ = _node;
+        }
+    }
+
+    void SetRight(Index _node, Index _child) {
+        Links_[_node].Right_ = _child;
+        if (_child != Null) {
+            Links_[_child].Parent_ = _node;
+        }
+    }
+
+    void RecalculateSize(Index _node) {
+        Links_[_node].Size_ = 1 + GetSize(Links_[_node].Left_) + GetSize(Links_[_node].Right_);
+    }
+
+    // first _idx elements of the subtree go to the left part, roots of both parts are detached
+    std::pair<Index, Index> SplitByIndex(Index _node, uint32_t _idx) {
+        if (_node == Null) {
+            return {Null, Null};
+        }
+        log::WriteDecardTree("SplitByIndex ", _idx);
+        Links_[_node].Parent_ = Null;
+        uint32_t leftSize = GetLeftSize(_node);
+        if (leftSize < _idx) {
+            auto [left, right] = SplitByIndex(Links_[_node].Right_, _idx - leftSize - 1);
+            SetRight(_node, left);
+            RecalculateSize(_node);
+            return {_node, right};
+        } else {
+            auto [left, right] = SplitByIndex(Links_[_node].Left_, _idx);
+            SetLeft(_node, right);
+            RecalculateSize(_node);
+            return {left, _node};
+        }
+    }
+
+    Index Merge(Index _left, Index _right) {
+        log::WriteDecardTree("Merge");
+        if (_left == Null || _right == Null) {
+            Index root = _left == Null ? _right : _left;
+            if (root != Null) {
+                Links_[root].Parent_ = Null;
+            }
+            return root;
+        }
+        if (Links_[_left].Priority_ > Links_[_right].Priority_) {
+            SetRight(_left, Merge(Links_[_left].Right_, _right));
+            Links_[_left].Parent_ = Null;
+            RecalculateSize(_left);
+            return _left;
+        } else {
+            SetLeft(_right, Merge(_left, Links_[_right].Left_));
+            Links_[_right].Parent_ = Null;
+            RecalculateSize(_right);
+            return _right;
+        }
+    }
+
+    // puts an allocated node to the position _idx
+    void Insert(uint32_t _idx, Index _node) {
+        log::WriteDecardTree("Insert ", _idx, '/', Size());
+        Index parent = Null;
+        bool toLeft = false;
+        Index current = Root_;
+        while (current != Null && Links_[current].Priority_ >= Links_[_node].Priority_) {
+            Links_[current].Size_++;
+            uint32_t leftSize = GetLeftSize(current);
+            parent = current;
+            toLeft = _idx <= leftSize;
+            if (toLeft) {
+                current = Links_[current].Left_;
+            } else {
+                _idx -= leftSize + 1;
+                current = Links_[current].Right_;
+            }
+        }
+        auto [left, right] = SplitByIndex(current, _idx);
+        SetLeft(_node, left);
+        SetRight(_node, right);
+        RecalculateSize(_node);
+        Replace(parent, toLeft, _node);
+    }
+
+    void Release(Index _node) {
+        Links_[_node] = Link{.Right_ = FreeList_};
+        FreeList_ = _node;
+    }
+
+    // removes the node from the tree and returns it to the free list
+    void Erase(Index _node) {
+        log::WriteDecardTree("Erase ", _node);
+        Index parent = Links_[_node].Parent_;
+        bool isLeft = parent != Null && Links_[parent].Left_ == _node;
+        Index merged = Merge(Links_[_node].Left_, Links_[_node].Right_);
+        Replace(parent, isLeft, merged);
+        for (Index current = parent; current != Null; current = Links_[current].Parent_) {
+            Links_[current].Size_--;
+        }
+        Release(_node);
+    }
+
+    uint32_t GetIdx(Index _node) const {
+        uint32_t acc = GetLeftSize(_node);
+        for (Index current = _node; Links_[current].Parent_ != Null; current = Links_[current].Parent_) {
+            Index parent = Links_[current].Parent_;
+            if (Links_[parent].Right_ == current) {
+                acc += GetLeftSize(parent) + 1;
+            }
+        }
+        return acc;
+    }
+
+    Index Get(uint32_t _idx) const {
+        Index current = Root_;
+        while (current != Null) {
+            uint32_t leftSize = GetLeftSize(current);
+            if (leftSize == _idx) {
+                return current;
+            }
+            if (leftSize > _idx) {
+                current = Links_[current].Left_;
+            } else {
+                _idx -= leftSize + 1;
+                current = Links_[current].Right_;
+            }
+        }
+        return Null;
+    }
+
+    // builds the tree of nodes [_begin, _end) in linear time keeping the right spine on a stack,
+    // nodes have to be allocated and have priorities, returns the detached root
+    template <typename _NodeIterator>
+    Index BuildRange(_NodeIterator _begin, _NodeIterator _end) {
+        std::vector<Index> spine;
+        for (auto it = _begin; it != _end; ++it) {
+            Index node = *it;
+            Index last = Null;
+            while (!spine.empty() && Links_[spine.back()].Priority_ < Links_[node].Priority_) {
+                last = spine.back();
+                spine.pop_back();
+                // every node below the popped one is already popped
+                RecalculateSize(last);
+            }
+            SetLeft(node, last);
+            if (!spine.empty()) {
+                SetRight(spine.back(), node);
+            }
+            spine.push_back(node);
+        }
+        for (auto it = spine.rbegin(); it != spine.rend(); ++it) {
+            RecalculateSize(*it);
+        }
+        if (spine.empty()) {
+            return Null;
+        }
+        Links_[spine.front()].Parent_ = Null;
+        return spine.front();
+    }
+
+    // replaces the tree with the values of [_begin, _end) in their order in O(n),
+    // ranges of at least magic_numbers::BuildChunkSize are built by separate threads and merged,
+    // _onNode(node, value) is called for every node from the building thread
+    template <typename _Iterator, typename _OnNode>
+    void Build(_Iterator _begin, _Iterator _end, uint64_t _seed, _OnNode &&_onNode) {
+        Clear();
+        Values_.assign(_begin, _end);
+        Links_.resize(Values_.size());
+        uint32_t count = Values_.size();
+        uint32_t threadCount = std::clamp<uint32_t>(count / magic_numbers::BuildChunkSize, 1, magic_numbers::BuildThreadCount);
+        std::vector<Index> roots(threadCount, Null);
+        auto buildChunk = [&](uint32_t _chunk) {
+            Index begin = uint64_t(count) * _chunk / threadCount;
+            Index end = uint64_t(count) * (_chunk + 1) / threadCount;
+            std::mt19937 gen(_seed + _chunk);
+            for (Index node = begin; node < end; ++node) {
+                Links_[node].Priority_ = gen();
+                _onNode(node, Values_[node]);
+            }
+            auto nodes = std::views::iota(begin, end);
+            roots[_chunk] = BuildRange(nodes.begin(), nodes.end());
+        };
+        std::vector<std::thread> threads;
+        for (uint32_t chunk = 1; chunk < threadCount; ++chunk) {
+            threads.emplace_back(buildChunk, chunk);
+        }
+        buildChunk(0);
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        for (Index root : roots) {
+            Root_ = Merge(Root_, root);
+        }
+        log::WriteDecardTree("Build ", count, " threads=", threadCount);
+    }
+
+    // leftmost node of the subtree
+    Index First(Index _node) const {
+        while (_node != Null && Links_[_node].Left_ != Null) {
+            _node = Links_[_node].Left_;
+        }
+        return _node;
+    }
+
+    // node after _node in the array order, every link is passed twice over a full walk
+    Index Next(Index _node) const {
+        if (Links_[_node].Right_ != Null) {
+            return First(Links_[_node].Right_);
+        }
+        Index parent = Links_[_node].Parent_;
+        while (parent != Null && Links_[parent].Right_ == _node) {
+            _node = parent;
+            parent = Links_[parent].Parent_;
+        }
+        return parent;
+    }
+
+    // in-order cursor, stays valid while the tree isn't changed
+    struct Cursor {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = _Value;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const _Value*;
+        using reference = const _Value&;
+
+        const DecardTree *Tree_ = nullptr;
+        Index Node_ = Null;
+
+        bool Valid() const {
+            return Node_ != Null;
+        }
+
+        const _Value& operator*() const {
+            return Tree_->Values_[Node_];
+        }
+
+        const _Value* operator->() const {
+            return &Tree_->Values_[Node_];
+        }
+
+        Cursor& operator++() {
+            Node_ = Tree_->Next(Node_);
+            return *this;
+        }
+
+        Cursor operator++(int) {
+            Cursor result = *this;
+            ++*this;
+            return result;
+        }
+
+        bool operator==(const Cursor &_other) const {
+            return Node_ == _other.Node_;
+        }
+    };
+
+    Cursor begin() const {
+        return Cursor{this, First(Root_)};
+    }
+
+    Cursor end() const {
+        return Cursor{this, Null};
+    }
+
+    // cursor at the element _idx or the end
+    Cursor At(uint32_t _idx) const {
+        return Cursor{this, Get(_idx)};
+    }
+
+    Cursor AtNode(Index _node) const {
+        return Cursor{this, _node};
+    }
+
+    // appends up to _count elements from the position _idx
+    void Export(uint32_t _idx, uint32_t _count, std::vector<_Value> *_out) const {
+        _out->reserve(_out->size() + std::min(_count, Size() - std::min(_idx, Size())));
+        for (Cursor cursor = At(_idx); cursor.Valid() && _count; ++cursor, --_count) {
+            _out->push_back(*cursor);
+        }
+    }
+
+    struct Edit {
+        // position in the array before the batch
+        uint32_t Position_ = 0;
+        bool Erase_ = false;
+        // allocated nodes put before the element at the position, in their order
+        std::vector<Index> Nodes_{};
+    };
+
+    // applies all edits in one sweep from left to right: the rest of the tree is split at every position,
+    // inserted nodes are built into a tree and merged, erased elements are cut off and released,
+    // so k edits cost O(k log n) instead of a descent from the root and an index walk for each one
+    void ApplyBatch(std::vector<Edit> &_edits) {
+        log::WriteDecardTree("ApplyBatch ", _edits.size());
+        std::sort(_edits.begin(), _edits.end(), [] (const Edit &_lhs, const Edit &_rhs) {
+            return std::make_pair(_lhs.Position_, _lhs.Erase_) < std::make_pair(_rhs.Position_, _rhs.Erase_);
+        });
+        Index result = Null;
+        Index rest = Root_;
+        uint32_t consumed = 0;
+        for (auto &edit : _edits) {
+            auto [left, right] = SplitByIndex(rest, edit.Position_ - consumed);
+            result = Merge(result, left);
+            rest = right;
+            consumed = edit.Position_;
+            if (edit.Erase_) {
+                auto [erased, tail] = SplitByIndex(rest, 1);
+                if (erased != Null) {
+                    Release(erased);
+                }
+                rest = tail;
+                consumed++;
+            } else {
+                result = Merge(result, BuildRange(edit.Nodes_.begin(), edit.Nodes_.end()));
+            }
+        }
+        Root_ = Merge(result, rest);
+    }
+
+    void Replace(Index _parent, bool _left, Index _node) {
+        if (_parent == Null) {
+            Root_ = _node;
+            if (_node != Null) {
+                Links_[_node].Parent_ = Null;
+            }
+        } else if (_left) {
+            SetLeft(_parent, _node);
+        } else {
+            SetRight(_parent, _node);
+        }
+    }
+};
+
+}
@@ -29,10 +29,16 @@ struct IServerState {
 
     virtual void MoveIterationForClient(model::ClientId _id, model::IterationId _iteration) = 0;
 
+    // Whether the history after _iteration is still kept, so a client at _iteration can catch up without the state.
+    virtual bool HasHistorySince(model::IterationId _iteration) = 0;
+
+    // Replays the history pushed by the primary on a replica, the cells keep the ids given by the primary.
+    virtual void ApplyReplicatedHistory(const api::GenericResponse &_history) = 0;
+
     virtual void CutHistory() = 0;
 };
 
-struct ServerStateNop : IServerState {
+struct ServerStateNop final : IServerState {
     virtual ~ServerStateNop(){}
 
     ServerStateNop() = default;
@@ -77,6 +83,14 @@ struct ServerStateNop : IServerState {
         return;
     }
 
+    bool HasHistorySince(model::IterationId) override {
+        return false;
+    }
+
+    void ApplyReplicatedHistory(const api::GenericResponse &) override {
+        log::WriteServerState("ServerStateNop::ApplyReplicatedHistory");
+    }
+
     void CutHistory() override {
 
     }
@@ -176,15 +190,16 @@ template <typename _Derived>
 _Derived* DeletableObject<_Derived>::FindNear() {
     std::vector<_Derived*> seen;
     if (NearLive_->Deleted_) {
-        while (NearLive_->Deleted_) {
-            NearLive_->Unref();
-            seen.push_back(NearLive_);
-            NearLive_ = NearLive_->NearLive_;
+        _Derived *live = NearLive_;
+        while (live->Deleted_) {
+            seen.push_back(live);
+            live = live->NearLive_;
         }
-        NearLive_->Ref();
+        // every node of the chain holds only the reference to the next one, SetNear drops exactly it
         for (_Derived *node : seen) {
-            node->SetNear(NearLive_);
+            node->SetNear(live);
         }
+        SetNear(live);
     }
     return NearLive_;
 }
@@ -193,7 +208,7 @@ _Derived* DeletableObject<_Derived>::FindNear() {
 
 using CellStateDict = std::unordered_map<model::CellId, std::unique_ptr<CellState>>;
 
-struct ServerState : IServerState {
+struct ServerState final : IServerState {
     std::queue<model::CellId> QueueToRemove_;
     CellState Root_;
     CellStateDict States_;
@@ -212,9 +227,11 @@ struct ServerState : IServerState {
 
 
     model::CellId NextCellId_ = 1;
+    uint64_t LiveCells_ = 0;
     
     ServerState(const model::CellVector &_cells)
         : Root_(model::Cell(0, 0), &QueueToRemove_)
+        , LiveCells_(_cells.size())
     {
         log::WriteServerState("ServerState{_cells.size()=", _cells.size(), '}');
 
@@ -256,26 +273,43 @@ struct ServerState : IServerState {
         return *(it->second);
     }
 
+    // Requests forwarded by a replica may name a deleted cell whose history is already cut here,
+    // such a cell is gone and the request is dropped like any request to a deleted cell.
+    CellState* FindState(model::CellId _cellId) {
+        auto it = States_.find(_cellId);
+        if (it == States_.end()) {
+            log::WriteServerState("ServerState::FindState{forgotten cellId# ", _cellId, '}');
+            return nullptr;
+        }
+        return it->second.get();
+    }
+
     api::UpdateValueResponse UpdateValue(const api::UpdateValueRequest &_request) override {
         log::WriteServerState("ServerState::UpdateValue ", _request.CellId_, ' ',_request.Value_);
 
-        CellState &state = GetState(_request.CellId_);
-        if (!state.Deleted_) {
+        CellState *state = FindState(_request.CellId_);
+        if (state && !state->Deleted_) {
             Iteration_++;;
-            state.Value_ = _request.Value_;
-            state.Ref();
-            History_.emplace_back(model::UpdateValue{.Cell_ = state});
+            state->Value_ = _request.Value_;
+            state->Ref();
+            History_.emplace_back(model::UpdateValue{.Cell_ = *state});
         }
         return api::UpdateValueResponse();
     }
 
     void CleanQueue() {
+        log::SpanScope span("CleanQueue");
         log::WriteServerState("ServerState::CleanQueue ", QueueToRemove_.size());
         uint32_t count = 0;
         while (QueueToRemove_.size()) {
             model::CellId id =  QueueToRemove_.front();
-            std::unique_ptr<CellState> &state = States_[id];
             QueueToRemove_.pop();
+            // a cell comes to the queue every time it drops to the last reference, it may be cleaned already
+            auto it = States_.find(id);
+            if (it == States_.end()) {
+                continue;
+            }
+            std::unique_ptr<CellState> &state = it->second;
             if (state->ReferenceCount_ > 1) {
                 continue;
             }
@@ -289,24 +323,30 @@ struct ServerState : IServerState {
     }
 
     api::InsertValueResponse InsertValue(const api::InsertValueRequest &_request) override {
+        CellState *nearState = FindState(_request.NearCellId_);
+        if (!nearState) {
+            return api::InsertValueResponse(0);
+        }
         Iteration_++;
         model::CellId cellId = NextCellId_++;
 
         log::WriteServerState("ServerState::InsertValue ", _request.NearCellId_, ' ', cellId);
 
         CellState *newState = new CellState(model::Cell(cellId, _request.Value_), &QueueToRemove_);
-        CellState *nearState = &GetState(_request.NearCellId_);
         newState->SetNear(nearState);
         nearState->PutAfter(newState);
 
-        CellState *current = newState->Next_;
-        CellState *prev = newState;
-        while (current && current->NearLive_ != prev) {
+        // the deleted cells up to the next live one and that one have the new cell as the nearest live now,
+        // their links may skip over it after FindNear shortened them, so every one of them is moved
+        for (CellState *current = newState->Next_; current; current = current->Next_) {
             current->SetNear(newState);
-            prev = std::exchange(current, current->Next_);
+            if (!current->Deleted_) {
+                break;
+            }
         }
 
         States_.emplace(cellId, newState);
+        LiveCells_++;
         newState->Ref();
         History_.emplace_back(model::InsertValue{.NearCellId_ = newState->FindNear()->CellId_, .Cell_ = *newState});
         return api::InsertValueResponse(cellId);
@@ -314,18 +354,36 @@ struct ServerState : IServerState {
 
     api::DeleteValueResponse DeleteValue(const api::DeleteValueRequest &_request) override {
         log::WriteServerState("ServerState::DeleteValue ", _request.CellId_);
-        CellState &state = GetState(_request.CellId_);
+        CellState *state = FindState(_request.CellId_);
 
-        if (state.Deleted_) {
+        if (!state || state->Deleted_) {
             return api::DeleteValueResponse();
         }
         Iteration_++;
-        state.Deleted_ = true;
-        state.Ref();
+        state->Deleted_ = true;
+        LiveCells_--;
+        state->Ref();
         History_.emplace_back(model::DeleteValue{.CellId_ = _request.CellId_});
         return api::DeleteValueResponse();
     }
 
+    // The cell moved to another state: it's gone here like a deleted cell whose deletion is already cut,
+    // the history before the move still names it and keeps it until the history is cut.
+    void Detach(model::CellId _cellId) {
+        log::WriteServerState("ServerState::Detach ", _cellId);
+        CellState &state = GetState(_cellId);
+        state.Deleted_ = true;
+        LiveCells_--;
+        state.Ref();
+        if (&state == Root_.NearLive_) {
+            Root_.FindNear();
+        }
+        state.Unref();
+        if (state.Next_->NearLive_ == &state) {
+            state.Next_->SetNear(state.NearLive_);
+        }
+    }
+
     api::State LoadState() override {
         log::WriteServerState("ServerState::LoadState");
         std::vector<model::Cell> cells;
@@ -338,17 +396,17 @@ struct ServerState : IServerState {
                 log::WriteFullStateLog("ERROR [", idx, "] next is nullptr");
                 std::exit(1);
             }
-            log::WriteFullStateLog('[', idx, "] move from ", current->CellId_, " to ", current->Next_->CellId_);
+            log::WriteFullStateLog("[", idx, "] move from ", current->CellId_, " to ", current->Next_->CellId_);
             current = current->Next_;
 
             if (current == &Root_) {
                 break;
             }
             if (current->Deleted_) {
-                log::WriteFullStateLog('[', idx, "] skip ", current->CellId_);
+                log::WriteFullStateLog("[", idx, "] skip ", current->CellId_);
                 continue;
             }
-            log::WriteFullStateLog('[', idx++, "] add ", current->CellId_);
+            log::WriteFullStateLog("[", idx++, "] add ", current->CellId_);
             cells.push_back(*current);
         }
 
@@ -372,11 +430,10 @@ struct ServerState : IServerState {
         for (auto it = begin; it != History_.end(); ++it) {
             auto put = [&] (auto &cmd) {
                 if constexpr (std::is_same_v<model::InsertValue, std::decay_t<decltype(cmd)>>) {
-                    CellState &state = GetState(cmd.Cell_.CellId_);
+                    // the near cell was alive at the insertion, so the client knows it: clients apply
+                    // deletions after insertions, rewriting it to the current live neighbour loses
+                    // cells inserted between them in the same diff
                     response->Insertions_.push_back(cmd);
-                    if (state.Prev_->Deleted_) {
-                        response->Insertions_.back().NearCellId_ = state.FindNear()->CellId_;
-                    }
                     log::WriteHistoryLog(">>insert<< ", cmd.Cell_.CellId_, ' ', cmd.NearCellId_);
                 }
                 if constexpr (std::is_same_v<model::UpdateValue, std::decay_t<decltype(cmd)>>) {
@@ -399,6 +456,7 @@ struct ServerState : IServerState {
     }
 
     void ApplyHistory(model::IterationI _toIteration) {
+        log::SpanScope span("ApplyHistory");
         log::WriteServerState("ServerState::ApplyHistory ", _toIteration);
         auto update = [&] (auto cmd) {
             using type = std::decay_t<decltype(cmd)>;
@@ -448,6 +506,10 @@ struct ServerState : IServerState {
             OrderedSeenClients_.emplace(_iteration, _id);
             return;
         }
+        if (_iteration < it->second) {
+            // a resumed client goes back to its snapshot, the stale greater entry is cleaned lazily
+            OrderedSeenClients_.emplace(_iteration, _id);
+        }
         it->second = _iteration;
         log::WriteServerState("ServerState::MoveIterationForClient{Clean}");
         while (OrderedSeenClients_.size()) {
@@ -463,6 +525,30 @@ struct ServerState : IServerState {
         log::WriteServerState("ServerState::MoveIterationForClient{Cleaned}");
     }
 
+    bool HasHistorySince(model::IterationId _iteration) override {
+        return _iteration >= LastCutIteration_ && _iteration <= Iteration_;
+    }
+
+    // The primary sends insertions with the alive near cell, updates only for alive cells and every deletion once,
+    // so applying insertions, then updates, then deletions gives the same array and the same iteration.
+    void ApplyReplicatedHistory(const api::GenericResponse &_history) override {
+        log::WriteServerState("ServerState::ApplyReplicatedHistory ", _history.Iteration_);
+        for (auto &insert : _history.Insertions_) {
+            NextCellId_ = insert.Cell_.CellId_;
+            InsertValue(api::InsertValueRequest(insert.NearCellId_, insert.Cell_.Value_, 0));
+        }
+        for (auto &update : _history.Updates_) {
+            UpdateValue(api::UpdateValueRequest(update.Cell_.CellId_, update.Cell_.Value_, 0));
+        }
+        for (auto &del : _history.Deletions_) {
+            DeleteValue(api::DeleteValueRequest(del.CellId_, 0));
+        }
+        if (Iteration_ != _history.Iteration_) {
+            log::ForceWrite("Replica iteration ", Iteration_, " differs from the primary ", _history.Iteration_);
+            std::exit(1);
+        }
+    }
+
     void CutHistory() override {
         log::WriteServerState("ServerState::CutHistory");
         if (OrderedSeenClients_.size()) {